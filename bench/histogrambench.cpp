@@ -0,0 +1,66 @@
+// Cost of recording into pipeline timing histograms.
+// Reports nanoseconds per Histogram::Record and per StageStats::Record
+// (which also reads the clock), alone and while another thread keeps reading
+// snapshots as a metrics scraper would.
+
+#include "pipeline/histogram.h"
+#include "pipeline/stagestats.h"
+#include "hiddev/hidframe.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace kmicki::pipeline;
+
+template<class Fn>
+static void Measure(std::string const& name, int iterations, Fn record)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+        record(i);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(36) << name << std::right
+              << " records: " << std::setw(9) << iterations
+              << " ns/record: " << std::fixed << std::setprecision(2) << (double)ns/iterations << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = 10000000;
+    if(argc > 1)
+        iterations = std::max(1,std::atoi(argv[1]));
+
+    Histogram histogram;
+    StageStats stats;
+    auto now = kmicki::hiddev::GetMonotonicTimestamp();
+
+    Measure("Histogram::Record", iterations, [&](int i) { histogram.Record((uint64_t)i * 7919 % 5000000); });
+    Measure("StageStats::Record", iterations, [&](int i) { stats.Record(now); });
+
+    std::atomic<bool> run(true);
+    uint64_t snapshots = 0;
+    std::thread reader([&]
+    {
+        while(run)
+        {
+            auto snapshot = histogram.Read();
+            auto statsSnapshot = stats.GetLatency().Read();
+            snapshots += (snapshot.count > 0) + (statsSnapshot.count > 0);
+        }
+    });
+    Measure("Histogram::Record (with reader)", iterations, [&](int i) { histogram.Record((uint64_t)i * 7919 % 5000000); });
+    Measure("StageStats::Record (with reader)", iterations, [&](int i) { stats.Record(now); });
+    run = false;
+    reader.join();
+
+    auto snapshot = histogram.Read();
+    std::cout << "Histogram p50: " << snapshot.GetPercentile(0.5) << " p99: " << snapshot.GetPercentile(0.99)
+              << " max: " << snapshot.max << " (uniform 0-5000000), snapshots read: " << snapshots << std::endl;
+    std::cout << "StageStats " << stats.Describe() << std::endl;
+    return 0;
+}
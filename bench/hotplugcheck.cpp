@@ -0,0 +1,209 @@
+// Check of reconnecting to the controller on hotplug events, without a controller:
+// HidDevReader reads frames from a FIFO (SetDevicePath) and gets device add/remove events
+// from a ManualHotplugSource instead of udev. The FIFO is removed and created again to
+// play the controller disappearing and coming back.
+//   open     - frames are read and the device is reported connected
+//   remove   - remove event pauses reading (no frames, device reported lost)
+//   add      - add event reopens the device before the periodic reopen attempt would,
+//              frames flow again and reconnect is counted and timed (stats and metrics)
+// Exits with 1 if a check fails.
+// Usage: hotplugcheck [gone ms]
+
+#include "hiddev/hiddevreader.h"
+#include "hiddev/hiddevfinder.h"
+#include "hiddev/hotplug.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kmicki::hiddev;
+
+static const int cFrameLen = 64;
+static const int cScanTimeUs = 4000;
+static const int cReopenDelayMs = 500;      // Periodic reopen attempt of ReadDataRaw
+static const char cSerial[] = "hotplugcheck";
+
+// Writes a frame to the FIFO every scan period while it exists.
+class Feeder
+{
+    public:
+    Feeder(std::string const& _path)
+    : path(_path), fd(-1), run(true), thread()
+    {
+        Create();
+        thread = std::thread([this]
+        {
+            std::vector<char> frame(cFrameLen, 0);
+            for(uint32_t i = 0; run; ++i)
+            {
+                frame[0] = (char)i;
+                {
+                    std::lock_guard lock(fdMutex);
+                    if(fd >= 0 && write(fd, frame.data(), frame.size()) < 0)
+                    { }     // FIFO full while reader is paused
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(cScanTimeUs));
+            }
+        });
+    }
+
+    ~Feeder()
+    {
+        run = false;
+        thread.join();
+        Remove();
+    }
+
+    // Controller comes back: FIFO exists again.
+    void Create()
+    {
+        std::lock_guard lock(fdMutex);
+        mkfifo(path.c_str(), 0600);
+        fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    }
+
+    // Controller is gone: FIFO can't be opened anymore.
+    void Remove()
+    {
+        std::lock_guard lock(fdMutex);
+        unlink(path.c_str());
+        if(fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+    private:
+    std::string path;
+    std::mutex fdMutex;
+    int fd;
+    std::atomic<bool> run;
+    std::thread thread;
+};
+
+typedef std::chrono::steady_clock::time_point time_point;
+
+static double MsSince(time_point const& start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Wait until condition holds (checked every millisecond). Returns false on timeout.
+static bool WaitFor(std::function<bool()> condition, int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while(!condition())
+    {
+        if(std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Frames received within given time.
+static int CountFrames(Serve<HidDevReader::frame_t> & serve, int ms)
+{
+    int frames = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while(std::chrono::steady_clock::now() < deadline)
+        if(serve.WaitForNext(std::chrono::milliseconds(10)))
+            ++frames;
+    return frames;
+}
+
+// Current value of a metric of the checked device (-1 if not found).
+static double GetMetric(std::string const& name)
+{
+    auto labels = kmicki::metrics::DeviceLabels(GetDeviceId(cSerial));
+    for(auto const& sample : kmicki::metrics::Registry::Get().Collect())
+        if(sample.name == name && sample.labels == labels)
+            return sample.value;
+    return -1.0;
+}
+
+static bool Report(std::string const& name, bool ok, std::string const& details)
+{
+    std::cout << std::left << std::setw(8) << name << std::right << " " << details
+              << (ok ? "" : " - FAILED") << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    int goneMs = 100;
+    if(argc > 1)
+        goneMs = std::max(1, std::min(cReopenDelayMs / 2, std::atoi(argv[1])));
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelNone);
+
+    std::string fifo = "/tmp/sdmotion-hotplugcheck-" + std::to_string(getpid());
+    Feeder feeder(fifo);
+
+    auto* hotplug = new ManualHotplugSource();
+    bool ok = true;
+    {
+        HidDevReader reader(0x28de, 0x1205, 2, cFrameLen, cScanTimeUs, true, cSerial);
+        reader.SetHotplugSource(hotplug);
+        reader.SetDevicePath(fifo);
+
+        auto & serve = reader.GetServe();
+        reader.Start();
+
+        // open
+        bool connected = WaitFor([&] { return reader.GetReconnectStats().connected; }, 1000);
+        int frames = CountFrames(serve, 200);
+        ok = Report("open", connected && frames > 0,
+                    "connected: " + std::to_string(connected) + " frames in 200 ms: " + std::to_string(frames)) && ok;
+
+        // remove
+        auto removed = std::chrono::steady_clock::now();
+        feeder.Remove();
+        hotplug->Push({ HotplugAction::Remove, fifo });
+        bool lost = WaitFor([&] { auto stats = reader.GetReconnectStats(); return !stats.connected && stats.disconnects == 1; }, 1000);
+        CountFrames(serve, 10);     // Frames read before the event
+        frames = CountFrames(serve, goneMs / 2);
+        ok = Report("remove", lost && frames == 0,
+                    "lost: " + std::to_string(lost) + " frames while gone: " + std::to_string(frames)) && ok;
+
+        // add
+        std::this_thread::sleep_for(std::chrono::milliseconds(goneMs) - (std::chrono::steady_clock::now() - removed));
+        feeder.Create();
+        auto added = std::chrono::steady_clock::now();
+        hotplug->Push({ HotplugAction::Add, fifo });
+        bool reopened = WaitFor([&] { return reader.GetReconnectStats().connected; }, 2*cReopenDelayMs);
+        auto reopenMs = MsSince(added);
+        frames = CountFrames(serve, 200);
+        auto stats = reader.GetReconnectStats();
+        auto reconnects = GetMetric("sdmotion_device_reconnects_total");
+        auto latency = GetMetric("sdmotion_device_reconnect_latency_seconds");
+        auto maxLatency = GetMetric("sdmotion_device_reconnect_latency_max_seconds");
+        ok = Report("add", reopened && reopenMs < cReopenDelayMs / 2 && frames > 0
+                           && stats.reconnects == 1 && reconnects == 1.0
+                           && stats.lastLatencyUs >= (uint64_t)goneMs*1000 && stats.lastLatencyUs < (uint64_t)cReopenDelayMs*1000
+                           && latency == stats.lastLatencyUs / 1e6 && maxLatency == latency,
+                    "reopened: " + std::to_string(reopened) + " after event: " + std::to_string(reopenMs) + " ms"
+                    + " frames in 200 ms: " + std::to_string(frames)
+                    + " reconnects: " + std::to_string(stats.reconnects) + " (metric " + std::to_string((int)reconnects) + ")"
+                    + " latency: " + std::to_string(stats.lastLatencyUs / 1000) + " ms"
+                    + " (metric " + std::to_string((int)(latency * 1000)) + " ms, max " + std::to_string((int)(maxLatency * 1000)) + " ms)") && ok;
+
+        reader.StopServe(serve);
+        reader.Stop();
+    }
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,419 @@
+// End-to-end latency acceptance test.
+// A generator thread injects synthetic Steam Deck reports (default 250Hz) into a FIFO
+// read by the real pipeline (HidDevReader, MotionAdapter and JsonServer, or the reactor)
+// instead of /dev/hidrawX. A UDP client on loopback receives the JSON packets.
+// Every report carries its sequence number encoded in gyro axes (converted exactly),
+// so each packet is matched to the time its report was injected. Reports:
+//   latency      - from injection of the report to reception of its packet
+//                  (includes waiting for the 60Hz send tick)
+//   packet loss  - send ticks without a received packet
+//   frame loss   - reports injected but not converted by the pipeline
+//   jitter       - deviation of packet inter-arrival times from the send period
+// Runs headless on any Linux machine (no controller needed).
+// Returns 1 if limits given by --max-p99 or --max-loss are exceeded.
+// Usage: latencybench [--seconds <s>] [--rate <Hz>] [--port <port>] [--reactor]
+//                     [--max-p99 <us>] [--max-loss <ratio>] [--json <file>]
+
+#include "hiddev/hiddevreader.h"
+#include "hiddev/hidframe.h"
+#include "sdgyrodsu/motionadapter.h"
+#include "sdgyrodsu/sdhidframe.h"
+#include "motion/jsonserver.h"
+#include "motion/reactor.h"
+#include "log/log.h"
+
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kmicki::hiddev;
+using namespace kmicki::sdgyrodsu;
+using namespace kmicki::motion;
+
+static const int cFrameLen = 64;
+static const int cScanTimeUs = 4000;
+static const uint16_t cVID = 0x28de;
+static const uint16_t cPID = 0x1205;
+static const int cInterfaceNumber = 2;
+static const int cWarmUpMs = 1000;
+static const double cSendPeriodUs = 1000000.0 / 60;
+
+// Sequence number is split into two gyro axes, 14 bits each, shifted out of the deadzone.
+// Gyro values are raw/16 and are printed with 4 decimals, so they are decoded exactly.
+static const int cSequenceBits = 14;
+static const int cSequenceOffset = 8;
+static const uint32_t cSequenceMask = (1 << cSequenceBits) - 1;
+
+static void EncodeSequence(SdHidFrame & frame, uint32_t sequence)
+{
+    frame.GyroAxisRightToLeft = (int16_t)(cSequenceOffset + (sequence & cSequenceMask));
+    frame.GyroAxisTopToBottom = (int16_t)(cSequenceOffset + ((sequence >> cSequenceBits) & cSequenceMask));
+}
+
+static bool ParseNumber(std::string const& json, char const* name, double & value)
+{
+    auto pos = json.find(name);
+    if(pos == std::string::npos)
+        return false;
+    value = std::strtod(json.c_str() + pos + std::strlen(name), nullptr);
+    return true;
+}
+
+// Sequence number from gyro pitch (right to left) and roll (top to bottom).
+static bool DecodeSequence(std::string const& json, uint32_t & sequence)
+{
+    double pitch, roll;
+    if(!ParseNumber(json, "\"pitch\":", pitch) || !ParseNumber(json, "\"roll\":", roll))
+        return false;
+    long low = std::lround(pitch * 16) - cSequenceOffset;
+    long high = std::lround(roll * 16) - cSequenceOffset;
+    if(low < 0 || high < 0 || low > (long)cSequenceMask || high > (long)cSequenceMask)
+        return false;
+    sequence = (uint32_t)(low | (high << cSequenceBits));
+    return true;
+}
+
+struct Packet
+{
+    uint64_t received;  // Client time of reception
+    uint64_t sent;      // Service time of sending (timestamp field)
+    uint32_t sequence;  // Sequence number of the report
+    uint32_t frameId;   // Frame counter of the service
+};
+
+struct Report
+{
+    size_t packets;
+    double p50, p99, p999, max;     // Latency in microseconds
+    double packetLoss;
+    double frameLoss;
+    double jitter;                  // Standard deviation of inter-arrival time in microseconds
+    double jitterP99;               // 99th percentile of inter-arrival deviation in microseconds
+};
+
+class Harness
+{
+    public:
+    Harness(std::string const& _fifo, int _port, int _seconds, int _rateHz)
+    : fifo(_fifo), port(_port), seconds(_seconds), rateHz(_rateHz), run(true), measuring(false),
+      injected(), packets()
+    {
+        injected.resize((size_t)(seconds + 3) * rateHz * 2 + 1, 0);
+        packets.reserve((size_t)(seconds + 3) * 60 * 2);
+    }
+
+    void Start()
+    {
+        generator = std::thread(&Harness::Generate, this);
+        client = std::thread(&Harness::Receive, this);
+    }
+
+    void Measure()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(cWarmUpMs));
+        measuring = true;
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        measuring = false;
+    }
+
+    void Stop()
+    {
+        run = false;
+        generator.join();
+        client.join();
+    }
+
+    Report Evaluate()
+    {
+        Report report {};
+        std::vector<double> latencies;
+        std::vector<double> intervals;
+        uint64_t sequences = 0, frames = 0;
+
+        for(size_t i = 0; i < packets.size(); ++i)
+        {
+            auto const& packet = packets[i];
+            if(packet.sequence < injected.size() && injected[packet.sequence] != 0)
+                latencies.push_back((double)(packet.received - injected[packet.sequence]));
+            if(i == 0)
+                continue;
+            auto const& previous = packets[i-1];
+            intervals.push_back((double)(packet.received - previous.received));
+            if(packet.sequence > previous.sequence)
+            {
+                sequences += packet.sequence - previous.sequence;
+                frames += packet.frameId - previous.frameId;
+            }
+        }
+
+        report.packets = packets.size();
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) { return latencies.empty() ? 0.0 : latencies[(size_t)(p * (latencies.size() - 1))]; };
+        report.p50 = percentile(0.5);
+        report.p99 = percentile(0.99);
+        report.p999 = percentile(0.999);
+        report.max = latencies.empty() ? 0.0 : latencies.back();
+
+        if(packets.size() > 1)
+        {
+            double expected = (double)(packets.back().sent - packets.front().sent) / cSendPeriodUs + 1;
+            report.packetLoss = std::max(0.0, 1.0 - packets.size() / expected);
+        }
+        if(sequences > 0)
+            report.frameLoss = std::max(0.0, 1.0 - (double)frames / sequences);
+
+        if(!intervals.empty())
+        {
+            // Inter-arrival time of a packet sent on each tick is the send period.
+            // Intervals spanning lost packets are accounted for by packet loss.
+            std::vector<double> deviations;
+            double sum = 0.0;
+            for(auto interval : intervals)
+            {
+                auto ticks = std::max(1.0, std::round(interval / cSendPeriodUs));
+                auto deviation = interval - ticks * cSendPeriodUs;
+                deviations.push_back(std::abs(deviation));
+                sum += deviation * deviation;
+            }
+            report.jitter = std::sqrt(sum / intervals.size());
+            std::sort(deviations.begin(), deviations.end());
+            report.jitterP99 = deviations[(size_t)(0.99 * (deviations.size() - 1))];
+        }
+        return report;
+    }
+
+    private:
+    std::string fifo;
+    int port;
+    int seconds;
+    int rateHz;
+    std::atomic<bool> run;
+    std::atomic<bool> measuring;
+    std::thread generator;
+    std::thread client;
+
+    std::vector<uint64_t> injected;     // Injection time of every sequence number
+    std::vector<Packet> packets;
+
+    void Generate()
+    {
+        int fd = open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+        if(fd < 0)
+        {
+            std::cerr << "Could not open " << fifo << "." << std::endl;
+            return;
+        }
+
+        std::vector<char> frame(cFrameLen, 0);
+        SdHidFrame & sdFrame = *reinterpret_cast<SdHidFrame*>(frame.data());
+        sdFrame.Header = 0x40090001;
+        sdFrame.AccelAxisTopToBottom = 16384;
+        sdFrame.GyroAxisFrontToBack = -100;
+        uint32_t sequence = 0;
+        const long periodNs = 1000000000L / rateHz;
+
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while(run && sequence + 1 < injected.size())
+        {
+            next.tv_nsec += periodNs;
+            while(next.tv_nsec >= 1000000000)
+            {
+                next.tv_nsec -= 1000000000;
+                ++next.tv_sec;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+            sdFrame.Increment = ++sequence;
+            EncodeSequence(sdFrame, sequence);
+            injected[sequence] = GetMonotonicTimestamp();
+            if(write(fd, frame.data(), frame.size()) != (ssize_t)frame.size())
+                break;
+        }
+        close(fd);
+    }
+
+    void Receive()
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+        timeval timeout { 0, 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        sockaddr_in server {};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(port);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        char buf[1024];
+        auto nextRegistration = std::chrono::steady_clock::now();
+        while(run)
+        {
+            if(std::chrono::steady_clock::now() >= nextRegistration)
+            {
+                sendto(fd, "register", 8, 0, (sockaddr*)&server, sizeof(server));
+                nextRegistration += std::chrono::seconds(1);
+            }
+
+            auto len = recv(fd, buf, sizeof(buf) - 1, 0);
+            auto received = GetMonotonicTimestamp();
+            if(len <= 0 || !measuring)
+                continue;
+            buf[len] = 0;
+            std::string json(buf);
+
+            Packet packet { received };
+            double sent, frameId;
+            if(!DecodeSequence(json, packet.sequence) || !ParseNumber(json, "\"timestamp\":", sent)
+               || !ParseNumber(json, "\"frameId\":", frameId))
+                continue;
+            packet.sent = (uint64_t)sent;
+            packet.frameId = (uint32_t)frameId;
+            if(packets.size() < packets.capacity())
+                packets.push_back(packet);
+        }
+        close(fd);
+    }
+};
+
+static Report RunThreaded(Harness & harness, std::string const& fifo)
+{
+    {
+        HidDevReader reader(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs, true);
+        reader.SetDevicePath(fifo);
+        MotionAdapter adapter(reader, 0);
+        reader.SetNoGyro(adapter.NoGyro);
+        JsonServer server(adapter);
+
+        harness.Start();
+        harness.Measure();
+    }
+    harness.Stop();
+    return harness.Evaluate();
+}
+
+static Report RunReactor(Harness & harness, std::string const& fifo)
+{
+    {
+        Reactor reactor(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs);
+        reactor.AddDevice(0, std::string(), fifo);
+        std::thread service(&Reactor::Run, &reactor);
+
+        harness.Start();
+        harness.Measure();
+
+        reactor.Stop();
+        service.join();
+    }
+    harness.Stop();
+    return harness.Evaluate();
+}
+
+static void WriteJson(std::ostream & out, std::string const& mode, int rateHz, int seconds, Report const& report, bool passed)
+{
+    out << std::fixed << std::setprecision(1)
+        << "{\n  \"suite\": \"latencybench\",\n  \"mode\": \"" << mode << "\",\n"
+        << "  \"rate_hz\": " << rateHz << ",\n  \"seconds\": " << seconds << ",\n"
+        << "  \"packets\": " << report.packets << ",\n"
+        << "  \"latency_us\": { \"p50\": " << report.p50 << ", \"p99\": " << report.p99
+        << ", \"p999\": " << report.p999 << ", \"max\": " << report.max << " },\n"
+        << std::setprecision(6)
+        << "  \"packet_loss\": " << report.packetLoss << ",\n  \"frame_loss\": " << report.frameLoss << ",\n"
+        << std::setprecision(1)
+        << "  \"jitter_us\": { \"stddev\": " << report.jitter << ", \"p99\": " << report.jitterP99 << " },\n"
+        << "  \"passed\": " << (passed ? "true" : "false") << "\n}\n";
+}
+
+static void PrintUsage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [--seconds <s>] [--rate <Hz>] [--port <port>] [--reactor]" << std::endl
+              << "       [--max-p99 <us>] [--max-loss <ratio>] [--json <file>]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = 10;
+    int rateHz = 250;
+    int port = 27960;
+    bool useReactor = false;
+    double maxP99 = 0.0;
+    double maxLoss = -1.0;
+    std::string jsonPath;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(arg == "--seconds" && i+1 < argc)
+            seconds = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--rate" && i+1 < argc)
+            rateHz = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--port" && i+1 < argc)
+            port = std::atoi(argv[++i]);
+        else if(arg == "--reactor")
+            useReactor = true;
+        else if(arg == "--max-p99" && i+1 < argc)
+            maxP99 = std::atof(argv[++i]);
+        else if(arg == "--max-loss" && i+1 < argc)
+            maxLoss = std::atof(argv[++i]);
+        else if(arg == "--json" && i+1 < argc)
+            jsonPath = argv[++i];
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelNone);
+    setenv("SDMOTION_SERVER_PORT", std::to_string(port).c_str(), 1);
+
+    std::string fifo = "/tmp/sdmotion-latencybench-" + std::to_string(getpid());
+    if(mkfifo(fifo.c_str(), 0600) < 0)
+    {
+        std::cerr << "Could not create " << fifo << "." << std::endl;
+        return 1;
+    }
+
+    Harness harness(fifo, port, seconds, rateHz);
+    auto report = useReactor ? RunReactor(harness, fifo) : RunThreaded(harness, fifo);
+    unlink(fifo.c_str());
+
+    bool passed = report.packets > 0
+                  && (maxP99 <= 0.0 || report.p99 <= maxP99)
+                  && (maxLoss < 0.0 || (report.packetLoss <= maxLoss && report.frameLoss <= maxLoss));
+    std::string mode = useReactor ? "reactor" : "threaded";
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "mode: " << mode << " rate: " << rateHz << " Hz packets: " << report.packets << std::endl
+              << "latency [us] p50: " << report.p50 << " p99: " << report.p99
+              << " p99.9: " << report.p999 << " max: " << report.max << std::endl
+              << std::setprecision(3)
+              << "packet loss: " << report.packetLoss * 100 << " % frame loss: " << report.frameLoss * 100 << " %" << std::endl
+              << std::setprecision(1)
+              << "jitter [us] stddev: " << report.jitter << " p99: " << report.jitterP99 << std::endl
+              << (passed ? "PASSED" : "FAILED") << std::endl;
+
+    if(jsonPath == "-")
+        WriteJson(std::cout, mode, rateHz, seconds, report, passed);
+    else if(!jsonPath.empty())
+    {
+        std::ofstream file(jsonPath);
+        WriteJson(file, mode, rateHz, seconds, report, passed);
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,667 @@
+// Benchmark suite of pipeline primitives.
+// Every benchmark runs with 1, 2 and N consumer threads (N: CPUs - 1, at least 3),
+// producer pinned to CPU 0 and consumer i to CPU i (modulo number of CPUs):
+//   pipeout_latency      - one-way handoff latency through PipeOut (one pipe per consumer)
+//   pipeout_throughput   - frames delivered through PipeOut while producer sends nonstop
+//   serve_latency        - Broadcast::Publish to Serve::WaitForNext latency
+//   serve_throughput     - frames consumed from Broadcast while producer publishes nonstop
+//   signalout_roundtrip  - SignalOut signal and answer (one pair per consumer)
+//   tojson               - ToJson serialization into a buffer (consumers run it in parallel)
+//   tobinary             - ToBinary serialization, float32 samples (in parallel)
+//   convertmotiondata    - MotionConverter::ConvertMotionData (in parallel)
+//   handlemissedticks    - HandleMissedTicks per tick at debug log level, where it counts
+//                          missed ticks and logs them (log written to /dev/null, in parallel)
+// Prints a table, or machine-readable JSON with --json <file> ('-' for stdout).
+// Usage: pipelinebench [--json <file>] [--scale <x>] [--consumers <N>] [--filter <name>]
+
+#include "pipeline/pipeout.h"
+#include "pipeline/serve.h"
+#include "pipeline/signalout.h"
+#include "hiddev/hidframe.h"
+#include "hiddev/hiddevreader.h"
+#include "sdgyrodsu/motionconverter.h"
+#include "motion/wireformat.h"
+#include "sdgyrodsu/sdhidframe.h"
+#include "motion/simplemotion.h"
+#include "log/log.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kmicki::pipeline;
+using namespace kmicki::hiddev;
+using namespace kmicki::sdgyrodsu;
+using namespace kmicki::motion;
+
+static const int cFrameLen = 64;
+static const int cFrameRingLen = 256;
+static const int cBatchLen = 64;    // Operations timed together by parallel benchmarks
+
+struct Result
+{
+    std::string name;
+    int consumers;
+    uint64_t operations;
+    double seconds;
+    std::vector<int64_t> latencies;     // Nanoseconds per operation
+    long contextSwitches;
+    bool pinned;
+    std::vector<std::pair<std::string,double>> extra;
+};
+
+static int cpuCount = 1;
+
+static int64_t Now()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static long ContextSwitches()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// Pin calling thread to a CPU. Returns false if it could not be pinned.
+static bool Pin(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpuCount, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static void Unpin()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int i = 0; i < cpuCount; ++i)
+        CPU_SET(i, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+static void WriteStamp(frame_t & frame, int64_t value)
+{
+    std::memcpy(frame.data(), &value, sizeof(value));
+}
+
+static int64_t ReadStamp(frame_t const& frame)
+{
+    int64_t value;
+    std::memcpy(&value, frame.data(), sizeof(value));
+    return value;
+}
+
+// Runs consumer(i) on consumers pinned threads and producer() on the calling thread pinned to CPU 0.
+// Fills duration, context switches and pinning of the result.
+static void RunThreads(Result & result, int consumers, std::function<void(int)> consumer, std::function<void()> producer)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> pinned(Pin(0));
+    std::vector<std::thread> threads;
+    for(int i = 0; i < consumers; ++i)
+        threads.emplace_back([&, i]
+        {
+            if(!Pin(i + 1))
+                pinned = false;
+            ++ready;
+            consumer(i);
+        });
+    while(ready < consumers)
+        std::this_thread::yield();
+
+    auto switches = ContextSwitches();
+    auto start = Now();
+    producer();
+    for(auto & thread : threads)
+        thread.join();
+    result.seconds = (Now() - start) * 1e-9;
+    result.contextSwitches = ContextSwitches() - switches;
+    result.pinned = pinned;
+    Unpin();
+}
+
+static Result PipeOutLatency(int consumers, int iterations)
+{
+    Result result { "pipeout_latency", consumers };
+    std::vector<std::unique_ptr<PipeOut<frame_t>>> pipes;
+    std::vector<std::vector<int64_t>> latencies(consumers);
+    for(int i = 0; i < consumers; ++i)
+    {
+        pipes.emplace_back(new PipeOut<frame_t>(new frame_t(cFrameLen), new frame_t(cFrameLen), new frame_t(cFrameLen)));
+        latencies[i].reserve(iterations);
+    }
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        auto & pipe = *pipes[i];
+        auto const& data = pipe.GetPointer();
+        for(int n = 0; n < iterations; ++n)
+        {
+            pipe.WaitForData();
+            latencies[i].push_back(Now() - ReadStamp(*data));
+        }
+    },
+    [&]
+    {
+        for(int n = 0; n < iterations; ++n)
+        {
+            for(auto & pipe : pipes)
+            {
+                WriteStamp(pipe->GetDataToFill(), Now());
+                pipe->SendData();
+            }
+            for(auto & pipe : pipes)
+                while(!pipe->WasReceived())
+                    CpuRelax();
+        }
+    });
+
+    for(auto & x : latencies)
+        result.latencies.insert(result.latencies.end(), x.begin(), x.end());
+    result.operations = result.latencies.size();
+    return result;
+}
+
+// Producer side of throughput benchmarks: call send with sequence numbers 1, 2, ... for duration.
+// Returns the last sequence number sent.
+static int64_t SendFor(int durationMs, std::function<void(int64_t)> send)
+{
+    auto end = Now() + (int64_t)durationMs * 1000000;
+    int64_t sequence = 0;
+    do
+    {
+        for(int i = 0; i < cBatchLen; ++i)
+            send(++sequence);
+    }
+    while(Now() < end);
+    return sequence;
+}
+
+static Result PipeOutThroughput(int consumers, int durationMs)
+{
+    Result result { "pipeout_throughput", consumers };
+    std::vector<std::unique_ptr<PipeOut<frame_t>>> pipes;
+    std::vector<uint64_t> delivered(consumers, 0);
+    std::atomic<int64_t> lastSent(0);
+    std::atomic<bool> done(false);
+    for(int i = 0; i < consumers; ++i)
+        pipes.emplace_back(new PipeOut<frame_t>(new frame_t(cFrameLen), new frame_t(cFrameLen), new frame_t(cFrameLen)));
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        auto & pipe = *pipes[i];
+        auto const& data = pipe.GetPointer();
+        int64_t last = 0;
+        while(true)
+        {
+            if(!pipe.WaitForData(std::chrono::milliseconds(1)))
+            {
+                if(done)
+                    break;
+                continue;
+            }
+            auto sequence = ReadStamp(*data);
+            if(sequence > last)
+            {
+                last = sequence;
+                ++delivered[i];
+            }
+            if(done && sequence == lastSent)
+                break;
+        }
+    },
+    [&]
+    {
+        lastSent = SendFor(durationMs, [&](int64_t sequence)
+        {
+            for(auto & pipe : pipes)
+            {
+                WriteStamp(pipe->GetDataToFill(), sequence);
+                pipe->SendData();
+            }
+        });
+        done = true;
+    });
+
+    for(auto x : delivered)
+        result.operations += x;
+    result.extra.emplace_back("sent_per_second", lastSent * consumers / result.seconds);
+    result.extra.emplace_back("delivered_ratio", (double)result.operations / ((double)lastSent * consumers));
+    return result;
+}
+
+static Result ServeLatency(int consumers, int iterations)
+{
+    Result result { "serve_latency", consumers };
+    Broadcast<frame_t> broadcast(new frame_t(cFrameLen), cFrameRingLen);
+    std::vector<Serve<frame_t>*> serves;
+    std::vector<std::vector<int64_t>> latencies(consumers);
+    std::unique_ptr<std::atomic<int>[]> consumed(new std::atomic<int>[consumers]);
+    for(int i = 0; i < consumers; ++i)
+    {
+        serves.push_back(&broadcast.GetServe());
+        latencies[i].reserve(iterations);
+        consumed[i] = 0;
+    }
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        auto & serve = *serves[i];
+        auto const& data = serve.GetPointer();
+        for(int n = 0; n < iterations; ++n)
+        {
+            serve.WaitForNext();
+            latencies[i].push_back(Now() - ReadStamp(*data));
+            consumed[i].store(n + 1, std::memory_order_release);
+        }
+    },
+    [&]
+    {
+        frame_t frame(cFrameLen);
+        for(int n = 0; n < iterations; ++n)
+        {
+            WriteStamp(frame, Now());
+            broadcast.Publish(frame);
+            for(int i = 0; i < consumers; ++i)
+                while(consumed[i].load(std::memory_order_acquire) <= n)
+                    CpuRelax();
+        }
+    });
+
+    for(auto & x : latencies)
+        result.latencies.insert(result.latencies.end(), x.begin(), x.end());
+    result.operations = result.latencies.size();
+    return result;
+}
+
+static Result ServeThroughput(int consumers, int durationMs)
+{
+    Result result { "serve_throughput", consumers };
+    Broadcast<frame_t> broadcast(new frame_t(cFrameLen), cFrameRingLen);
+    std::vector<Serve<frame_t>*> serves;
+    std::vector<uint64_t> read(consumers, 0), overruns(consumers, 0);
+    std::atomic<int64_t> lastSent(0);
+    std::atomic<bool> done(false);
+    for(int i = 0; i < consumers; ++i)
+        serves.push_back(&broadcast.GetServe());
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        auto & serve = *serves[i];
+        auto const& data = serve.GetPointer();
+        while(true)
+        {
+            if(!serve.WaitForNext(std::chrono::milliseconds(1)))
+            {
+                if(done && !serve.TryNext())
+                    break;
+                continue;
+            }
+            ++read[i];
+            if(done && ReadStamp(*data) == lastSent)
+                break;
+        }
+        overruns[i] = serve.GetOverrunCount();
+    },
+    [&]
+    {
+        frame_t frame(cFrameLen);
+        lastSent = SendFor(durationMs, [&](int64_t sequence)
+        {
+            WriteStamp(frame, sequence);
+            broadcast.Publish(frame);
+        });
+        done = true;
+    });
+
+    uint64_t lost = 0;
+    for(int i = 0; i < consumers; ++i)
+    {
+        result.operations += read[i];
+        lost += overruns[i];
+    }
+    result.extra.emplace_back("published_per_second", lastSent / result.seconds);
+    result.extra.emplace_back("overrun_ratio", (double)lost / ((double)lastSent * consumers));
+    return result;
+}
+
+static Result SignalOutRoundTrip(int consumers, int iterations)
+{
+    Result result { "signalout_roundtrip", consumers };
+    std::vector<std::unique_ptr<SignalOut>> pings, pongs;
+    for(int i = 0; i < consumers; ++i)
+    {
+        pings.emplace_back(new SignalOut());
+        pongs.emplace_back(new SignalOut());
+    }
+    result.latencies.reserve(iterations);
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        for(int n = 0; n < iterations; ++n)
+        {
+            pings[i]->WaitForSignal();
+            pongs[i]->SendSignal();
+        }
+    },
+    [&]
+    {
+        for(int n = 0; n < iterations; ++n)
+        {
+            auto start = Now();
+            for(auto & ping : pings)
+                ping->SendSignal();
+            for(auto & pong : pongs)
+                pong->WaitForSignal();
+            result.latencies.push_back(Now() - start);
+        }
+    });
+
+    result.operations = result.latencies.size();
+    return result;
+}
+
+// Run operation in parallel on consumer threads, timing batches of cBatchLen operations.
+static Result Parallel(std::string const& name, int consumers, int iterations, std::function<uint64_t(int,int)> operation)
+{
+    Result result { name, consumers };
+    int batches = std::max(1, iterations / cBatchLen);
+    std::vector<std::vector<int64_t>> latencies(consumers);
+    std::vector<uint64_t> sinks(consumers, 0);
+    std::atomic<bool> go(false);
+
+    RunThreads(result, consumers, [&](int i)
+    {
+        latencies[i].reserve(batches);
+        uint64_t sink = 0;
+        while(!go)
+            CpuRelax();
+        for(int b = 0; b < batches; ++b)
+        {
+            auto start = Now();
+            for(int n = 0; n < cBatchLen; ++n)
+                sink += operation(i, b * cBatchLen + n);
+            latencies[i].push_back((Now() - start) / cBatchLen);
+        }
+        sinks[i] = sink;
+    },
+    [&]
+    {
+        go = true;
+    });
+
+    uint64_t sink = 0;
+    for(int i = 0; i < consumers; ++i)
+    {
+        result.latencies.insert(result.latencies.end(), latencies[i].begin(), latencies[i].end());
+        sink += sinks[i];
+    }
+    result.operations = (uint64_t)batches * cBatchLen * consumers;
+    result.extra.emplace_back("checksum", (double)(sink & 0xFFFF));
+    return result;
+}
+
+static SimpleMotionData SampleMotion(int n)
+{
+    SimpleMotionData data {};
+    data.timestamp = 1234567890123 + n;
+    data.sensor_timestamp = 1234567886123 + n;
+    data.sample_timestamp = 1234567886000 + n;
+    data.accel_x = 0.0123f * (n % 100);
+    data.accel_y = -0.9812f;
+    data.accel_z = 0.1534f;
+    data.gyro_pitch = 12.345f;
+    data.gyro_yaw = -0.5f * (n % 7);
+    data.gyro_roll = 123.25f;
+    data.frame_id = n;
+    data.device_id = 0x1234abcd;
+    return data;
+}
+
+static Result ToJsonBench(int consumers, int iterations)
+{
+    return Parallel("tojson", consumers, iterations, [](int, int n)
+    {
+        char buffer[cMaxJsonLen];
+        auto len = ToJson(SampleMotion(n), buffer);
+        return (uint64_t)len + (uint8_t)buffer[len-1];
+    });
+}
+
+static Result ToBinaryBench(int consumers, int iterations)
+{
+    return Parallel("tobinary", consumers, iterations, [](int, int n)
+    {
+        char buffer[cMaxBinaryPacketLen];
+        auto len = ToBinary(SampleMotion(n), n, false, cDefaultFields, buffer);
+        return (uint64_t)len + (uint8_t)buffer[len-1];
+    });
+}
+
+static Result ConvertMotionDataBench(int consumers, int iterations)
+{
+    std::vector<frame_t> frames(consumers, frame_t(cFrameLen, 0));
+    struct Last { float rtl, ftb, ttb; };
+    std::vector<Last> last(consumers, Last { 0.0f, 0.0f, 0.0f });
+    return Parallel("convertmotiondata", consumers, iterations, [&](int i, int n)
+    {
+        auto & frame = *reinterpret_cast<SdHidFrame*>(frames[i].data());
+        frame.Increment = n;
+        frame.AccelAxisRightToLeft = (int16_t)(n * 37);
+        frame.AccelAxisTopToBottom = 16384;
+        frame.AccelAxisFrontToBack = (int16_t)(n * 11);
+        frame.GyroAxisRightToLeft = (int16_t)(n * 5);
+        frame.GyroAxisTopToBottom = 100;
+        frame.GyroAxisFrontToBack = -100;
+        SimpleMotionData data;
+        MotionConverter::ConvertMotionData(frame, data, last[i].rtl, last[i].ftb, last[i].ttb, n);
+        return (uint64_t)(data.gyro_pitch + data.accel_x);
+    });
+}
+
+static Result HandleMissedTicksBench(int consumers, int iterations)
+{
+    static const int cPeriod = 250;
+    std::vector<std::pair<int,int>> counters(consumers, { 0, 0 });
+
+    // Below debug level HandleMissedTicks returns at once: measure the counting path,
+    // with messages about missed frames written to /dev/null (log goes to stderr).
+    kmicki::log::FlushLog();
+    int savedStderr = dup(STDERR_FILENO);
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    dup2(null, STDERR_FILENO);
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelDebug);
+
+    auto result = Parallel("handlemissedticks", consumers, iterations, [&](int i, int n)
+    {
+        // Same arguments as the read stage, roughly 1 frame in 100 missed
+        HandleMissedTicks("HidDevReader::ReadData", "HID frames", n % 100 != 0, counters[i].first, cPeriod, counters[i].second);
+        return (uint64_t)counters[i].second;
+    });
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelDefault);
+    kmicki::log::FlushLog();
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStderr);
+    close(null);
+    return result;
+}
+
+static int64_t Percentile(std::vector<int64_t> const& sorted, double p)
+{
+    if(sorted.empty())
+        return 0;
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+static void PrintTable(std::vector<Result> & results)
+{
+    for(auto & result : results)
+    {
+        auto & l = result.latencies;
+        std::sort(l.begin(), l.end());
+        std::cout << std::left << std::setw(20) << result.name << std::right
+                  << " consumers: " << std::setw(2) << result.consumers
+                  << " ops/s: " << std::setw(12) << std::fixed << std::setprecision(0) << result.operations / result.seconds;
+        if(!l.empty())
+            std::cout << " p50: " << std::setw(7) << Percentile(l, 0.5) << " ns"
+                      << " p99: " << std::setw(7) << Percentile(l, 0.99) << " ns"
+                      << " max: " << std::setw(8) << l.back() << " ns";
+        std::cout << " ctx/op: " << std::setprecision(3) << (double)result.contextSwitches / result.operations;
+        for(auto const& x : result.extra)
+            std::cout << " " << x.first << ": " << std::setprecision(3) << x.second;
+        std::cout << (result.pinned ? "" : " (not pinned)") << std::endl;
+    }
+}
+
+static void WriteJson(std::ostream & out, std::vector<Result> & results, double scale)
+{
+    out << std::setprecision(6);
+    out << "{\n  \"suite\": \"pipelinebench\",\n  \"cpus\": " << cpuCount << ",\n  \"scale\": " << scale << ",\n  \"results\": [";
+    bool first = true;
+    for(auto & result : results)
+    {
+        auto & l = result.latencies;
+        std::sort(l.begin(), l.end());
+        double mean = 0.0;
+        for(auto x : l)
+            mean += x;
+        if(!l.empty())
+            mean /= l.size();
+
+        out << (first ? "\n" : ",\n") << "    { \"name\": \"" << result.name << "\""
+            << ", \"consumers\": " << result.consumers
+            << ", \"operations\": " << result.operations
+            << ", \"seconds\": " << result.seconds
+            << ", \"ops_per_second\": " << result.operations / result.seconds
+            << ", \"pinned\": " << (result.pinned ? "true" : "false")
+            << ", \"context_switches_per_op\": " << (double)result.contextSwitches / result.operations;
+        if(!l.empty())
+            out << ", \"latency_ns\": { \"mean\": " << mean
+                << ", \"p50\": " << Percentile(l, 0.5)
+                << ", \"p99\": " << Percentile(l, 0.99)
+                << ", \"p999\": " << Percentile(l, 0.999)
+                << ", \"max\": " << l.back() << " }";
+        for(auto const& x : result.extra)
+            out << ", \"" << x.first << "\": " << x.second;
+        out << " }";
+        first = false;
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv)
+{
+    std::string jsonPath;
+    std::string filter;
+    double scale = 1.0;
+    cpuCount = std::max(1u, std::thread::hardware_concurrency());
+    int maxConsumers = std::max(3, cpuCount - 1);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(arg == "--json" && i+1 < argc)
+            jsonPath = argv[++i];
+        else if(arg == "--scale" && i+1 < argc)
+            scale = std::max(0.001, std::atof(argv[++i]));
+        else if(arg == "--consumers" && i+1 < argc)
+            maxConsumers = std::max(1, std::atoi(argv[++i]));
+        else if(arg == "--filter" && i+1 < argc)
+            filter = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--json <file>] [--scale <x>] [--consumers <N>] [--filter <name>]" << std::endl;
+            return 1;
+        }
+    }
+
+    // As in the service. Log goes to stderr, so that output of benchmarks can go to stdout.
+    kmicki::log::SetLogOutput(kmicki::log::LogOutput::Stderr);
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelDefault);
+
+    struct Benchmark
+    {
+        char const* name;
+        Result (*run)(int, int);
+        int iterations;     // Operations per consumer (throughput: duration in milliseconds)
+    };
+    Benchmark benchmarks[] = {
+        { "pipeout_latency",     PipeOutLatency,         20000 },
+        { "pipeout_throughput",  PipeOutThroughput,        500 },
+        { "serve_latency",       ServeLatency,           20000 },
+        { "serve_throughput",    ServeThroughput,          500 },
+        { "signalout_roundtrip", SignalOutRoundTrip,     20000 },
+        { "tojson",              ToJsonBench,           200000 },
+        { "tobinary",            ToBinaryBench,        2000000 },
+        { "convertmotiondata",   ConvertMotionDataBench, 2000000 },
+        { "handlemissedticks",   HandleMissedTicksBench, 2000000 }
+    };
+
+    std::vector<int> consumerCounts { 1, 2 };
+    if(maxConsumers > 2)
+        consumerCounts.push_back(maxConsumers);
+    else
+        consumerCounts.resize(maxConsumers);
+
+    std::vector<Result> results;
+    for(auto const& benchmark : benchmarks)
+    {
+        if(!filter.empty() && std::string(benchmark.name).find(filter) == std::string::npos)
+            continue;
+        for(auto consumers : consumerCounts)
+        {
+            results.push_back(benchmark.run(consumers, std::max(1, (int)(benchmark.iterations * scale))));
+            std::cerr << "." << std::flush;
+        }
+    }
+    std::cerr << std::endl;
+
+    if(jsonPath.empty())
+        PrintTable(results);
+    else if(jsonPath == "-")
+        WriteJson(std::cout, results, scale);
+    else
+    {
+        std::ofstream file(jsonPath);
+        if(!file)
+        {
+            std::cerr << "Could not write " << jsonPath << "." << std::endl;
+            return 1;
+        }
+        WriteJson(file, results, scale);
+    }
+
+    return 0;
+}
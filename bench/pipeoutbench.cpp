@@ -0,0 +1,127 @@
+// Ping-pong benchmark of PipeOut handoff.
+// Two threads bounce a frame through a pair of PipeOut objects.
+// Reports one-way handoff latency and context switches per handoff
+// for the lock-free PipeOut and for the previous mutex/condition variable
+// implementation (kept here as a reference).
+
+#include "pipeline/pipeout.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <sys/resource.h>
+
+using namespace kmicki::pipeline;
+
+// Reference: PipeOut before lock-free rewrite.
+template<class T>
+class LockingPipeOut
+{
+    public:
+    LockingPipeOut(T* inst1, T* inst2, T* inst3)
+    : bufMod(inst1),bufSent(inst2),bufRcv(inst3),bufWasSent(false)
+    { }
+
+    std::unique_ptr<T> const& GetPointerToFill() { return bufMod; }
+    std::unique_ptr<T> const& GetPointer() { return bufRcv; }
+
+    void SendData()
+    {
+        {
+            std::lock_guard lock(bufSentMutex);
+            bufSent.swap(bufMod);
+            bufWasSent = true;
+        }
+        bufSentConditionVariable.notify_all();
+    }
+
+    void WaitForData()
+    {
+        std::unique_lock lock(bufSentMutex);
+        bufSentConditionVariable.wait(lock,[&] { return bufWasSent; });
+        bufSent.swap(bufRcv);
+        bufWasSent = false;
+    }
+
+    private:
+    std::unique_ptr<T> bufMod,bufSent,bufRcv;
+    std::mutex bufSentMutex;
+    std::condition_variable bufSentConditionVariable;
+    bool bufWasSent;
+};
+
+typedef std::vector<char> frame_t;
+
+static const int cFrameLen = 64;
+
+static long ThreadContextSwitches()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD,&usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+template<class Pipe>
+void PingPong(std::string const& name, int iterations)
+{
+    Pipe ping(new frame_t(cFrameLen),new frame_t(cFrameLen),new frame_t(cFrameLen));
+    Pipe pong(new frame_t(cFrameLen),new frame_t(cFrameLen),new frame_t(cFrameLen));
+
+    std::vector<int64_t> roundTrips(iterations);
+    long switchesA = 0, switchesB = 0;
+
+    std::thread echo([&]
+    {
+        auto start = ThreadContextSwitches();
+        for(int i = 0; i < iterations; ++i)
+        {
+            ping.WaitForData();
+            (*pong.GetPointerToFill())[0] = (*ping.GetPointer())[0];
+            pong.SendData();
+        }
+        switchesB = ThreadContextSwitches() - start;
+    });
+
+    auto start = ThreadContextSwitches();
+    for(int i = 0; i < iterations; ++i)
+    {
+        (*ping.GetPointerToFill())[0] = (char)i;
+        auto t0 = std::chrono::steady_clock::now();
+        ping.SendData();
+        pong.WaitForData();
+        roundTrips[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+    switchesA = ThreadContextSwitches() - start;
+    echo.join();
+
+    std::sort(roundTrips.begin(),roundTrips.end());
+    auto percentile = [&](double p) { return roundTrips[(size_t)(p*(iterations-1))]/2; };
+    int64_t sum = 0;
+    for(auto rt : roundTrips)
+        sum += rt;
+
+    std::cout << std::left << std::setw(16) << name << std::right
+              << " handoffs: " << std::setw(8) << 2*iterations
+              << " mean: " << std::setw(7) << sum/iterations/2 << " ns"
+              << " p50: " << std::setw(7) << percentile(0.5) << " ns"
+              << " p99: " << std::setw(7) << percentile(0.99) << " ns"
+              << " ctx switches/handoff: " << std::fixed << std::setprecision(3)
+              << (double)(switchesA + switchesB)/(2*iterations) << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = 100000;
+    if(argc > 1)
+        iterations = std::max(1,std::atoi(argv[1]));
+
+    PingPong<LockingPipeOut<frame_t>>("mutex/condvar",iterations);
+    PingPong<PipeOut<frame_t>>("lock-free",iterations);
+
+    return 0;
+}
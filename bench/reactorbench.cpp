@@ -0,0 +1,323 @@
+// End-to-end benchmark of threaded pipeline versus single-threaded reactor.
+// A generator thread writes synthetic Steam Deck reports at 250Hz into a FIFO
+// that the service reads instead of /dev/hidrawX, and a UDP client on loopback
+// receives the JSON motion data.
+// Reports per mode:
+//   wakeups/s - context switches of service threads per second
+//   input     - latency from report write to its read by the service (sensorTimestamp)
+//   send      - latency from send timestamp to reception by the client
+//   e2e       - latency from report write to reception by the client
+//               (includes waiting for the 60Hz send tick)
+
+#include "hiddev/hiddevreader.h"
+#include "hiddev/hidframe.h"
+#include "sdgyrodsu/motionadapter.h"
+#include "motion/jsonserver.h"
+#include "motion/reactor.h"
+#include "log/log.h"
+
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+using namespace kmicki::hiddev;
+using namespace kmicki::sdgyrodsu;
+using namespace kmicki::motion;
+
+static const int cFrameLen = 64;
+static const int cScanTimeUs = 4000;
+static const uint16_t cVID = 0x28de;
+static const uint16_t cPID = 0x1205;
+static const int cInterfaceNumber = 2;
+static const int cWarmUpMs = 1000;
+
+struct Sample
+{
+    uint64_t received;
+    uint64_t sent;
+    uint64_t read;
+};
+
+static long TaskContextSwitches(std::string const& tid)
+{
+    std::ifstream status("/proc/self/task/" + tid + "/status");
+    std::string line;
+    long switches = 0;
+    while(std::getline(status, line))
+        if(line.rfind("voluntary_ctxt_switches:", 0) == 0 || line.rfind("nonvoluntary_ctxt_switches:", 0) == 0)
+            switches += std::atol(line.substr(line.find(':') + 1).c_str());
+    return switches;
+}
+
+// Sum of context switches of all threads of the process except excluded ones.
+static long ContextSwitches(std::vector<pid_t> const& excluded)
+{
+    long switches = 0;
+    DIR* dir = opendir("/proc/self/task");
+    if(dir == nullptr)
+        return 0;
+    while(dirent* entry = readdir(dir))
+    {
+        if(entry->d_name[0] == '.')
+            continue;
+        pid_t tid = std::atoi(entry->d_name);
+        if(std::find(excluded.begin(), excluded.end(), tid) == excluded.end())
+            switches += TaskContextSwitches(entry->d_name);
+    }
+    closedir(dir);
+    return switches;
+}
+
+static uint64_t ParseField(std::string const& json, char const* name)
+{
+    auto pos = json.find(name);
+    if(pos == std::string::npos)
+        return 0;
+    return std::strtoull(json.c_str() + pos + std::strlen(name), nullptr, 10);
+}
+
+class Bench
+{
+    public:
+    Bench(std::string const& _fifo, int _port, int _seconds)
+    : fifo(_fifo), port(_port), seconds(_seconds), run(true), measuring(false),
+      generatorTid(0), clientTid(0), writeTimes(), samples()
+    {
+        writeTimes.reserve((seconds + 2) * 250 * 2);
+    }
+
+    void Start()
+    {
+        generator = std::thread(&Bench::Generate, this);
+        client = std::thread(&Bench::Receive, this);
+    }
+
+    void Stop()
+    {
+        run = false;
+        generator.join();
+        client.join();
+    }
+
+    // Run for requested time and return context switches of service threads during measurement.
+    long Measure()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(cWarmUpMs));
+        std::vector<pid_t> excluded { gettid(), generatorTid.load(), clientTid.load() };
+        auto switches = ContextSwitches(excluded);
+        measuring = true;
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        measuring = false;
+        return ContextSwitches(excluded) - switches;
+    }
+
+    void Report(std::string const& name, long switches)
+    {
+        std::vector<int64_t> input, send, e2e;
+        for(auto const& sample : samples)
+        {
+            // Report read by the service is the last one written before it was read.
+            auto written = std::upper_bound(writeTimes.begin(), writeTimes.end(), sample.read);
+            if(written == writeTimes.begin())
+                continue;
+            --written;
+            input.push_back(sample.read - *written);
+            send.push_back(sample.received - sample.sent);
+            e2e.push_back(sample.received - *written);
+        }
+
+        auto percentile = [](std::vector<int64_t> & values, double p) -> int64_t
+        {
+            if(values.empty())
+                return 0;
+            std::sort(values.begin(), values.end());
+            return values[(size_t)(p*(values.size()-1))];
+        };
+
+        std::cout << std::left << std::setw(9) << name << std::right
+                  << " samples: " << std::setw(5) << samples.size()
+                  << " wakeups/s: " << std::setw(6) << switches / seconds
+                  << " input p50/p99: " << std::setw(4) << percentile(input, 0.5) << "/" << std::setw(5) << percentile(input, 0.99) << " us"
+                  << " send p50/p99: " << std::setw(4) << percentile(send, 0.5) << "/" << std::setw(5) << percentile(send, 0.99) << " us"
+                  << " e2e p50/p99: " << std::setw(5) << percentile(e2e, 0.5) << "/" << std::setw(5) << percentile(e2e, 0.99) << " us"
+                  << std::endl;
+    }
+
+    private:
+    std::string fifo;
+    int port;
+    int seconds;
+    std::atomic<bool> run;
+    std::atomic<bool> measuring;
+    std::atomic<pid_t> generatorTid;
+    std::atomic<pid_t> clientTid;
+    std::thread generator;
+    std::thread client;
+
+    std::vector<uint64_t> writeTimes;
+    std::vector<Sample> samples;
+
+    void Generate()
+    {
+        generatorTid = gettid();
+        int fd = open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+        if(fd < 0)
+        {
+            std::cerr << "Could not open " << fifo << "." << std::endl;
+            return;
+        }
+
+        std::vector<char> frame(cFrameLen, 0);
+        SdHidFrame & sdFrame = *reinterpret_cast<SdHidFrame*>(frame.data());
+        sdFrame.Header = 0x40090001;
+        uint32_t increment = 0;
+
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while(run)
+        {
+            next.tv_nsec += cScanTimeUs * 1000;
+            if(next.tv_nsec >= 1000000000)
+            {
+                next.tv_nsec -= 1000000000;
+                ++next.tv_sec;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+            sdFrame.Increment = ++increment;
+            sdFrame.AccelAxisRightToLeft = (int16_t)(1000.0 * std::sin(increment * 0.01));
+            sdFrame.AccelAxisTopToBottom = 16384;
+            sdFrame.AccelAxisFrontToBack = (int16_t)(1000.0 * std::cos(increment * 0.01));
+            sdFrame.GyroAxisRightToLeft = (int16_t)(500.0 * std::sin(increment * 0.02));
+            sdFrame.GyroAxisTopToBottom = 100;
+            sdFrame.GyroAxisFrontToBack = -100;
+
+            if(writeTimes.size() < writeTimes.capacity())
+                writeTimes.push_back(GetMonotonicTimestamp());
+            if(write(fd, frame.data(), frame.size()) != (ssize_t)frame.size())
+                break;
+        }
+        close(fd);
+    }
+
+    void Receive()
+    {
+        clientTid = gettid();
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+        timeval timeout { 0, 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        sockaddr_in server {};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(port);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        char buf[1024];
+        auto nextRegistration = std::chrono::steady_clock::now();
+        samples.reserve((seconds + 2) * 60 * 2);
+        while(run)
+        {
+            if(std::chrono::steady_clock::now() >= nextRegistration)
+            {
+                sendto(fd, "register", 8, 0, (sockaddr*)&server, sizeof(server));
+                nextRegistration += std::chrono::seconds(1);
+            }
+
+            auto len = recv(fd, buf, sizeof(buf) - 1, 0);
+            auto received = GetMonotonicTimestamp();
+            if(len <= 0 || !measuring)
+                continue;
+            buf[len] = 0;
+            std::string json(buf);
+            if(samples.size() < samples.capacity())
+                samples.push_back({ received, ParseField(json, "\"timestamp\":"), ParseField(json, "\"sensorTimestamp\":") });
+        }
+        close(fd);
+    }
+};
+
+static void SetPort(int port)
+{
+    setenv("SDMOTION_SERVER_PORT", std::to_string(port).c_str(), 1);
+}
+
+static void BenchThreaded(std::string const& fifo, int port, int seconds)
+{
+    SetPort(port);
+    Bench bench(fifo, port, seconds);
+    long switches;
+    {
+        HidDevReader reader(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs, true);
+        reader.SetDevicePath(fifo);
+        MotionAdapter adapter(reader, 0);
+        reader.SetNoGyro(adapter.NoGyro);
+        JsonServer server(adapter);
+
+        bench.Start();
+        switches = bench.Measure();
+    }
+    bench.Stop();
+    bench.Report("threaded", switches);
+}
+
+static void BenchReactor(std::string const& fifo, int port, int seconds)
+{
+    SetPort(port);
+    Bench bench(fifo, port, seconds);
+    long switches;
+    {
+        Reactor reactor(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs);
+        reactor.AddDevice(0, std::string(), fifo);
+        std::thread service(&Reactor::Run, &reactor);
+
+        bench.Start();
+        switches = bench.Measure();
+
+        reactor.Stop();
+        service.join();
+    }
+    bench.Stop();
+    bench.Report("reactor", switches);
+}
+
+int main(int argc, char** argv)
+{
+    // Usage: reactorbench [seconds] [port]
+    int seconds = 5;
+    int port = 27860;
+    if(argc > 1)
+        seconds = std::max(1, std::atoi(argv[1]));
+    if(argc > 2)
+        port = std::atoi(argv[2]);
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelDefault);
+
+    std::string fifo = "/tmp/sdmotion-reactorbench-" + std::to_string(getpid());
+    if(mkfifo(fifo.c_str(), 0600) < 0)
+    {
+        std::cerr << "Could not create " << fifo << "." << std::endl;
+        return 1;
+    }
+
+    BenchThreaded(fifo, port, seconds);
+    BenchReactor(fifo, port + 1, seconds);
+
+    unlink(fifo.c_str());
+    return 0;
+}
@@ -0,0 +1,340 @@
+// Load test of client registry with thousands of simulated clients.
+// registry - cost of registering, refreshing and expiring clients (synthetic IPv4 and IPv6
+//            addresses, synthetic time) in ClientRegistry and in the previous vector of clients
+//            searched linearly and expired with remove_if (kept here as a reference).
+//            Stale check is the cost of checking for stale clients once a second
+//            while all clients refresh their registration every second.
+// send     - MotionSocket send tick to clients on IPv4 and IPv6 loopback, while idle and while
+//            another thread keeps receiving registrations that change subscriptions.
+//            Sending reads a snapshot of clients, so it doesn't wait for registrations
+//            (on a single CPU both threads still share it).
+// Usage: registrybench [clients] [ticks] [port]
+
+#include "motion/clientregistry.h"
+#include "motion/motionsocket.h"
+#include "motion/simplemotion.h"
+#include "log/log.h"
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace kmicki::motion;
+typedef std::chrono::steady_clock::time_point time_point;
+
+static const std::chrono::seconds cTimeout(30);
+static const int cRefreshSeconds = 120;
+
+// Reference: registry before hash table and timer wheel.
+class LinearRegistry
+{
+    public:
+    void Register(ClientAddress const& address, Subscription const& subscription, time_point const& now)
+    {
+        std::lock_guard lock(clientsMutex);
+        auto client = std::find_if(clients.begin(), clients.end(), [&](Client const& other) { return other.address == address; });
+        if(client != clients.end())
+        {
+            client->lastSeen = now;
+            client->subscription = subscription;
+        }
+        else
+            clients.push_back({ address, now, subscription });
+    }
+
+    size_t Expire(time_point const& now)
+    {
+        std::lock_guard lock(clientsMutex);
+        auto stale = std::remove_if(clients.begin(), clients.end(),
+                                    [&](Client const& client) { return (now - client.lastSeen) > cTimeout; });
+        size_t removed = clients.end() - stale;
+        clients.erase(stale, clients.end());
+        return removed;
+    }
+
+    private:
+    struct Client
+    {
+        ClientAddress address;
+        time_point lastSeen;
+        Subscription subscription;
+    };
+
+    std::mutex clientsMutex;
+    std::vector<Client> clients;
+};
+
+// Every other client IPv6, the rest IPv4.
+static std::vector<ClientAddress> SyntheticAddresses(int count)
+{
+    std::vector<ClientAddress> addresses;
+    for(int i = 0; i < count; ++i)
+    {
+        if(i % 2)
+        {
+            sockaddr_in6 address {};
+            address.sin6_family = AF_INET6;
+            address.sin6_port = htons(1024 + i % 60000);
+            address.sin6_addr.s6_addr[0] = 0xfd;
+            address.sin6_addr.s6_addr[14] = (uint8_t)(i >> 8);
+            address.sin6_addr.s6_addr[15] = (uint8_t)i;
+            addresses.emplace_back((sockaddr*)&address, sizeof(address));
+        }
+        else
+        {
+            sockaddr_in address {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(1024 + i % 60000);
+            address.sin_addr.s_addr = htonl(0x0a000000 + i);
+            addresses.emplace_back((sockaddr*)&address, sizeof(address));
+        }
+    }
+    return addresses;
+}
+
+static double NsPer(std::chrono::steady_clock::time_point const& start, int count)
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void ReportRegistry(std::string const& name, int count, double added, double refreshed, double checked, double expired)
+{
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(1)
+              << " clients: " << std::setw(6) << count
+              << " register: " << std::setw(8) << added << " ns"
+              << " refresh: " << std::setw(8) << refreshed << " ns"
+              << " expire: " << std::setw(8) << expired << " ns per client"
+              << " stale check: " << std::setw(10) << checked << " ns per second" << std::endl;
+}
+
+static void BenchRegistry(int count)
+{
+    auto addresses = SyntheticAddresses(count);
+    Subscription subscription(MotionSocket::cDefaultSendRateHz);
+    auto t0 = std::chrono::steady_clock::now();
+
+    {
+        LinearRegistry registry;
+        auto start = std::chrono::steady_clock::now();
+        for(auto const& address : addresses)
+            registry.Register(address, subscription, t0);
+        auto added = NsPer(start, count);
+        start = std::chrono::steady_clock::now();
+        for(auto const& address : addresses)
+            registry.Register(address, subscription, t0 + std::chrono::seconds(10));
+        auto refreshed = NsPer(start, count);
+        // Clients refresh every second and stale clients are checked every second, then all go silent
+        int second = 10;
+        int64_t checks = 0;
+        for(; second < 10 + cRefreshSeconds; ++second)
+        {
+            for(auto const& address : addresses)
+                registry.Register(address, subscription, t0 + std::chrono::seconds(second));
+            auto check = std::chrono::steady_clock::now();
+            registry.Expire(t0 + std::chrono::seconds(second));
+            checks += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - check).count();
+        }
+        start = std::chrono::steady_clock::now();
+        for(size_t removed = 0; removed < addresses.size(); ++second)
+            removed += registry.Expire(t0 + std::chrono::seconds(second));
+        ReportRegistry("linear", count, added, refreshed, (double)checks / cRefreshSeconds, NsPer(start, count));
+    }
+
+    {
+        ClientRegistry registry(cTimeout);
+        auto start = std::chrono::steady_clock::now();
+        for(auto const& address : addresses)
+            registry.Register(address, subscription, t0);
+        registry.Publish();
+        auto added = NsPer(start, count);
+        start = std::chrono::steady_clock::now();
+        for(auto const& address : addresses)
+            registry.Register(address, subscription, t0 + std::chrono::seconds(10));
+        registry.Publish();
+        auto refreshed = NsPer(start, count);
+        int second = 10;
+        int64_t checks = 0;
+        for(; second < 10 + cRefreshSeconds; ++second)
+        {
+            for(auto const& address : addresses)
+                registry.Register(address, subscription, t0 + std::chrono::seconds(second));
+            auto check = std::chrono::steady_clock::now();
+            registry.Expire(t0 + std::chrono::seconds(second));
+            registry.Publish();
+            checks += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - check).count();
+        }
+        start = std::chrono::steady_clock::now();
+        for(; registry.GetCount() > 0; ++second)
+        {
+            registry.Expire(t0 + std::chrono::seconds(second));
+            registry.Publish();
+        }
+        ReportRegistry("hashed", count, added, refreshed, (double)checks / cRefreshSeconds, NsPer(start, count));
+    }
+}
+
+// Client socket on IPv4 or IPv6 loopback (alternating).
+static int OpenClient(int n)
+{
+    return socket(n % 2 ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+}
+
+static void Register(int fd, int port, int n, char const* subscription)
+{
+    if(n % 2)
+    {
+        sockaddr_in6 server {};
+        server.sin6_family = AF_INET6;
+        server.sin6_port = htons(port);
+        server.sin6_addr = in6addr_loopback;
+        sendto(fd, subscription, std::strlen(subscription), 0, (sockaddr*)&server, sizeof(server));
+    }
+    else
+    {
+        sockaddr_in server {};
+        server.sin_family = AF_INET;
+        server.sin_port = htons(port);
+        server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sendto(fd, subscription, std::strlen(subscription), 0, (sockaddr*)&server, sizeof(server));
+    }
+}
+
+static SimpleMotionData SampleMotion(int n)
+{
+    SimpleMotionData data {};
+    data.timestamp = 1234567890123 + (uint64_t)n * 1000000 / MotionSocket::cDefaultSendRateHz;     // Send ticks
+    data.sensor_timestamp = 1234567886123 + n;
+    data.sample_timestamp = 1234567886000 + n;
+    data.accel_y = -0.9812f;
+    data.gyro_yaw = -0.5f * (n % 7);
+    data.frame_id = n;
+    return data;
+}
+
+static void ReportSend(std::string const& name, size_t clientCount, std::vector<int64_t> & ticks, int registrations)
+{
+    std::sort(ticks.begin(), ticks.end());
+    int64_t sum = 0;
+    for(auto tick : ticks)
+        sum += tick;
+
+    std::cout << std::left << std::setw(8) << name << std::right
+              << " clients: " << std::setw(6) << clientCount
+              << " per tick mean: " << std::setw(9) << sum / (int64_t)ticks.size() << " ns"
+              << " p50: " << std::setw(9) << ticks[ticks.size()/2] << " ns"
+              << " p99: " << std::setw(9) << ticks[(size_t)(0.99*(ticks.size()-1))] << " ns"
+              << " registrations: " << std::setw(6) << registrations << std::endl;
+}
+
+static char const* const cSubscriptions[] =
+{
+    "register",
+    "format=binary rate=30",
+    "format=json rate=20 fields=gyro",
+    "format=binary16 fields=all"
+};
+
+static void BenchSend(int count, int tickCount, int port)
+{
+    setenv("SDMOTION_SERVER_PORT", std::to_string(port).c_str(), 1);
+    MotionSocket socket;
+
+    // Clients keep their sockets, so datagrams sent to them are received (or dropped when their queues are full)
+    std::vector<int> clients;
+    for(int i = 0; i < count; ++i)
+    {
+        int fd = OpenClient(i);
+        if(fd < 0)
+            break;
+        clients.push_back(fd);
+        Register(fd, port, i, cSubscriptions[i % 4]);
+        if(i % 10 == 9)
+            socket.ReceiveRegistrations();      // Don't let receive queue overflow
+    }
+    usleep(10000);
+    socket.ReceiveRegistrations();
+
+    std::vector<int64_t> ticks(tickCount);
+    auto sendTicks = [&]
+    {
+        for(int i = 0; i < tickCount; ++i)
+        {
+            auto data = SampleMotion(i);
+            auto start = std::chrono::steady_clock::now();
+            socket.Send(data);
+            ticks[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+
+    sendTicks();
+    ReportSend("idle", socket.GetClientCount(), ticks, 0);
+
+    // Registration thread as in JsonServer, fed by refreshes that change subscriptions
+    // (every batch of registrations publishes a new snapshot of all clients)
+    std::atomic<bool> run(true);
+    std::atomic<int> registrations(0);
+    std::thread churn([&]
+    {
+        for(int n = 0; run; ++n)
+        {
+            auto i = (size_t)n % clients.size();
+            Register(clients[i], port, i, cSubscriptions[(i + n / clients.size() + 1) % 4]);
+            if(n % 10 == 9)
+            {
+                registrations += socket.ReceiveRegistrations();
+                socket.RemoveStaleClients();
+            }
+        }
+        registrations += socket.ReceiveRegistrations();
+    });
+    sendTicks();
+    run = false;
+    churn.join();
+    ReportSend("churn", socket.GetClientCount(), ticks, registrations);
+
+    for(int fd : clients)
+        close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    int clients = 5000;
+    int ticks = 300;
+    int port = 27880;
+    if(argc > 1)
+        clients = std::max(1, std::atoi(argv[1]));
+    if(argc > 2)
+        ticks = std::max(1, std::atoi(argv[2]));
+    if(argc > 3)
+        port = std::atoi(argv[3]);
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelNone);
+
+    // Socket per simulated client
+    rlimit files;
+    if(getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    for(int count : { clients / 10, clients })
+        BenchRegistry(std::max(1, count));
+    for(int count : { clients / 10, clients })
+        BenchSend(std::max(1, count), ticks, port);
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Cost of sending one tick of motion data to a growing number of clients.
+// Clients are UDP sockets on loopback registered with MotionSocket (JSON format).
+// Compares MotionSocket::Send (one sendmmsg per tick) with the previous loop of
+// sendto calls, each under a mutex (kept here as a reference).
+// Reports mean and p99 time per tick and per datagram.
+// Usage: sendbench [ticks] [port]
+
+#include "motion/motionsocket.h"
+#include "motion/simplemotion.h"
+#include "log/log.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace kmicki::motion;
+
+static int OpenClient(int port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    sockaddr_in local {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (sockaddr*)&local, sizeof(local));
+
+    sockaddr_in server {};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(fd, "register", 8, 0, (sockaddr*)&server, sizeof(server));
+    return fd;
+}
+
+static sockaddr_in GetAddress(int fd)
+{
+    sockaddr_in address {};
+    socklen_t len = sizeof(address);
+    getsockname(fd, (sockaddr*)&address, &len);
+    return address;
+}
+
+static SimpleMotionData SampleMotion(int n)
+{
+    SimpleMotionData data {};
+    data.timestamp = 1234567890123 + n;
+    data.sensor_timestamp = 1234567886123 + n;
+    data.sample_timestamp = 1234567886000 + n;
+    data.accel_x = 0.0123f * (n % 100);
+    data.accel_y = -0.9812f;
+    data.accel_z = 0.1534f;
+    data.gyro_pitch = 12.345f;
+    data.gyro_yaw = -0.5f * (n % 7);
+    data.gyro_roll = 123.25f;
+    data.frame_id = n;
+    return data;
+}
+
+// Throw away what clients received, so that their receive queues don't overflow.
+static void Drain(std::vector<int> const& clients)
+{
+    char buf[1024];
+    for(int fd : clients)
+        while(recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+}
+
+static void Report(std::string const& name, int clientCount, std::vector<int64_t> & ticks)
+{
+    std::sort(ticks.begin(), ticks.end());
+    int64_t sum = 0;
+    for(auto tick : ticks)
+        sum += tick;
+    auto mean = sum / (int64_t)ticks.size();
+
+    std::cout << std::left << std::setw(8) << name << std::right
+              << " clients: " << std::setw(4) << clientCount
+              << " per tick mean: " << std::setw(8) << mean << " ns"
+              << " p99: " << std::setw(8) << ticks[(size_t)(0.99*(ticks.size()-1))] << " ns"
+              << " per datagram: " << std::setw(6) << mean / clientCount << " ns" << std::endl;
+}
+
+static void Bench(int clientCount, int tickCount, int port)
+{
+    setenv("SDMOTION_SERVER_PORT", std::to_string(port).c_str(), 1);
+    MotionSocket socket;
+
+    std::vector<int> clients;
+    std::vector<sockaddr_in> addresses;
+    for(int i = 0; i < clientCount; ++i)
+    {
+        clients.push_back(OpenClient(port));
+        addresses.push_back(GetAddress(clients.back()));
+    }
+    usleep(10000);
+    socket.ReceiveRegistrations();
+
+    std::vector<int64_t> ticks(tickCount);
+
+    // Reference: sendto per client under a mutex.
+    std::mutex sendMutex;
+    for(int i = 0; i < tickCount; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        char json[cMaxJsonLen];
+        auto len = ToJson(SampleMotion(i), json);
+        for(auto const& address : addresses)
+        {
+            std::lock_guard lock(sendMutex);
+            sendto(socket.GetFd(), json, len, 0, (sockaddr const*)&address, sizeof(address));
+        }
+        ticks[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        Drain(clients);
+    }
+    Report("sendto", clientCount, ticks);
+
+    for(int i = 0; i < tickCount; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        socket.Send(SampleMotion(i));
+        ticks[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        Drain(clients);
+    }
+    Report("sendmmsg", clientCount, ticks);
+
+    for(int fd : clients)
+        close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    int tickCount = 2000;
+    int port = 27880;
+    if(argc > 1)
+        tickCount = std::max(1, std::atoi(argv[1]));
+    if(argc > 2)
+        port = std::atoi(argv[2]);
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelNone);
+
+    int clientCounts[] = { 1, 5, 20, 50 };
+    for(int clientCount : clientCounts)
+        Bench(clientCount, tickCount, port++);
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+// Checks of the motion data send path:
+//   json        - ToJson output is byte-for-byte the same as the previous ostringstream
+//                 serializer (kept here as a reference) for sample, edge and random values
+//   allocations - MotionSocket::Send to clients of various subscriptions never calls operator new
+//                 once warmed up
+// Also reports time per packet of both serializers.
+// Exits with 1 if a check fails.
+// Usage: sendpathcheck [random values] [port]
+
+#include "motion/simplemotion.h"
+#include "motion/motionsocket.h"
+#include "log/log.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace kmicki::motion;
+
+// Allocations made by the current thread while counting is on.
+static thread_local bool countAllocations = false;
+static thread_local uint64_t allocations = 0;
+
+static void* Allocate(size_t size)
+{
+    if(countAllocations)
+        ++allocations;
+    if(void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) { return Allocate(size); }
+void* operator new[](size_t size) { return Allocate(size); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+    if(countAllocations)
+        ++allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+void* operator new[](size_t size, std::nothrow_t const& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+// Reference: ToJson before the to_chars serializer.
+static std::string ReferenceToJson(const SimpleMotionData& data)
+{
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(4);
+    
+    json << "{"
+         << "\"timestamp\":" << data.timestamp << ","
+         << "\"sensorTimestamp\":" << data.sensor_timestamp << ","
+         << "\"sampleTimestamp\":" << data.sample_timestamp << ","
+         << "\"accel\":{"
+         << "\"x\":" << data.accel_x << ","
+         << "\"y\":" << data.accel_y << ","
+         << "\"z\":" << data.accel_z
+         << "},"
+         << "\"gyro\":{"
+         << "\"pitch\":" << data.gyro_pitch << ","
+         << "\"yaw\":" << data.gyro_yaw << ","
+         << "\"roll\":" << data.gyro_roll
+         << "},"
+         << "\"frameId\":" << data.frame_id << ","
+         << "\"deviceId\":" << data.device_id << ","
+         << "\"magnitude\":{"
+         << "\"accel\":" << data.accel_magnitude << ","
+         << "\"gyro\":" << data.gyro_magnitude
+         << "}"
+         << "}";
+         
+    return json.str();
+}
+
+static SimpleMotionData MakeMotion(std::vector<float> const& floats, uint64_t timestamp, uint32_t id)
+{
+    SimpleMotionData data {};
+    data.timestamp = timestamp;
+    data.sensor_timestamp = timestamp / 3;
+    data.sample_timestamp = ~timestamp;
+    data.accel_x = floats[0];
+    data.accel_y = floats[1];
+    data.accel_z = floats[2];
+    data.gyro_pitch = floats[3];
+    data.gyro_yaw = floats[4];
+    data.gyro_roll = floats[5];
+    data.frame_id = id;
+    data.device_id = ~id;
+    data.accel_magnitude = floats[6];
+    data.gyro_magnitude = floats[7];
+    data.buttons1 = id;
+    data.buttons2 = ~id;
+    data.left_stick_x = data.left_stick_y = data.right_stick_x = data.right_stick_y = INT16_MIN;
+    data.left_trigger = data.right_trigger = INT16_MIN;
+    data.left_pad_x = data.left_pad_y = data.right_pad_x = data.right_pad_y = INT16_MIN;
+    return data;
+}
+
+static bool CheckJson(int randomCount)
+{
+    std::vector<float> edges { 0.0f, -0.0f, 1.0f, -1.0f, 0.00005f, -0.00005f, 0.00015f, 0.99995f, 123.45675f,
+                               FLT_MAX, -FLT_MAX, FLT_MIN, -FLT_MIN, FLT_TRUE_MIN, 1e10f, -3.5e20f,
+                               INFINITY, -INFINITY, NAN, -NAN };
+    std::vector<SimpleMotionData> cases;
+    for(size_t i = 0; i < edges.size(); ++i)
+        cases.push_back(MakeMotion(std::vector<float>(8, edges[i]), i == 0 ? 0 : UINT64_MAX - i, i == 0 ? 0 : UINT32_MAX - i));
+
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<float> sensor(-40.0f, 40.0f);
+    for(int i = 0; i < randomCount; ++i)
+    {
+        std::vector<float> floats(8);
+        for(auto & value : floats)
+        {
+            if(i % 2 == 0)
+                value = sensor(random);
+            else
+            {
+                // Any bit pattern: all magnitudes, denormals, infinities and NaNs
+                uint32_t bits = (uint32_t)random();
+                std::memcpy(&value, &bits, sizeof(value));
+            }
+        }
+        cases.push_back(MakeMotion(floats, random(), (uint32_t)random()));
+    }
+
+    size_t maxLen = 0;
+    int mismatches = 0;
+    for(auto const& data : cases)
+    {
+        char buffer[cMaxJsonLen];
+        std::string json(buffer, ToJson(data, buffer));
+        std::string reference = ReferenceToJson(data);
+        maxLen = std::max(maxLen, ToJson(data, buffer, cAllFields));
+        if(json != reference && ++mismatches <= 3)
+            std::cout << "  mismatch:" << std::endl << "    " << reference << std::endl << "    " << json << std::endl;
+    }
+
+    std::cout << std::left << std::setw(12) << "json" << std::right
+              << " cases: " << std::setw(8) << cases.size()
+              << " mismatches: " << mismatches
+              << " longest (all fields): " << maxLen << "/" << cMaxJsonLen << " bytes" << std::endl;
+    return mismatches == 0 && maxLen <= cMaxJsonLen;
+}
+
+static void TimeSerializers(int iterations)
+{
+    auto data = MakeMotion({ 0.0123f, -0.9812f, 0.1534f, 12.345f, -0.5f, 123.25f, 0.99f, 124.0f }, 1234567890123, 12345);
+
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+    {
+        data.frame_id = i;
+        sink += ReferenceToJson(data).size();
+    }
+    auto reference = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+    {
+        char buffer[cMaxJsonLen];
+        data.frame_id = i;
+        sink += ToJson(data, buffer);
+        asm volatile("" : : "r"(buffer) : "memory");
+    }
+    auto current = std::chrono::steady_clock::now() - start;
+
+    auto perPacket = [&](std::chrono::nanoseconds time) { return (double)time.count() / iterations; };
+    std::cout << std::left << std::setw(12) << "serialize" << std::right << std::fixed << std::setprecision(1)
+              << " ostringstream: " << perPacket(reference) << " ns/packet"
+              << " to_chars: " << perPacket(current) << " ns/packet"
+              << " (checksum " << (sink & 0xFFFF) << ")" << std::endl;
+}
+
+static int Client(int port, char const* registration)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    sockaddr_in server {};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(fd, registration, std::strlen(registration), 0, (sockaddr*)&server, sizeof(server));
+    return fd;
+}
+
+static bool CheckAllocations(int port, int sends)
+{
+    setenv("SDMOTION_SERVER_PORT", std::to_string(port).c_str(), 1);
+    MotionSocket socket;
+    std::vector<int> clients { Client(port, "register"), Client(port, "format=binary"), Client(port, "format=binary16"),
+                               Client(port, "format=json fields=all rate=25 coords=device"),
+                               Client(port, "format=binary fields=gyro,inputs rate=30") };
+    usleep(10000);
+    socket.ReceiveRegistrations();
+    kmicki::log::FlushLog();
+
+    auto data = MakeMotion({ 0.0123f, -0.9812f, 0.1534f, 12.345f, -0.5f, 123.25f, 0.99f, 124.0f }, 1234567890123, 1);
+    // Ticks at the send rate, so clients at lower rates are due too
+    auto tickUs = 1000000 / MotionSocket::cDefaultSendRateHz;
+    for(int i = 0; i < 100; ++i)
+    {
+        data.timestamp += tickUs;
+        socket.Send(data);
+    }
+
+    countAllocations = true;
+    for(int i = 0; i < sends; ++i)
+    {
+        data.frame_id = i;
+        data.timestamp += tickUs;
+        socket.Send(data);
+    }
+    countAllocations = false;
+
+    for(int fd : clients)
+        close(fd);
+
+    std::cout << std::left << std::setw(12) << "allocations" << std::right
+              << " clients: " << socket.GetClientCount()
+              << " sends: " << sends
+              << " operator new calls: " << allocations << std::endl;
+    return socket.GetClientCount() == clients.size() && allocations == 0;
+}
+
+int main(int argc, char** argv)
+{
+    int randomCount = 1000000;
+    int port = 27870;
+    if(argc > 1)
+        randomCount = std::max(0, std::atoi(argv[1]));
+    if(argc > 2)
+        port = std::atoi(argv[2]);
+
+    kmicki::log::SetLogLevel(kmicki::log::LogLevelNone);
+
+    bool ok = CheckJson(randomCount);
+    TimeSerializers(200000);
+    ok = CheckAllocations(port, 10000) && ok;
+
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
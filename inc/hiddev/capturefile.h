@@ -0,0 +1,59 @@
+#ifndef _KMICKI_HIDDEV_CAPTUREFILE_H_
+#define _KMICKI_HIDDEV_CAPTUREFILE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace kmicki::hiddev
+{
+    // Capture file layout:
+    //   CaptureHeader (version 1 ends before deviceId)
+    //   records: uint64_t timestamp (CLOCK_MONOTONIC µs when frame was read)
+    //            followed by frameLen bytes of frame data
+    struct CaptureHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t frameLen;
+        uint32_t deviceId;      // Controller the frames were read from (since version 2)
+    };
+
+    extern const char cCaptureMagic[8];
+    extern const uint32_t cCaptureVersion;
+
+    // Read-only, memory-mapped capture file.
+    class CaptureFile
+    {
+        public:
+        CaptureFile() = delete;
+        CaptureFile(CaptureFile const&) = delete;
+        CaptureFile& operator=(CaptureFile const&) = delete;
+
+        // Map capture file. Throws std::runtime_error if file can't be mapped or is not a capture.
+        CaptureFile(std::string const& path);
+        ~CaptureFile();
+
+        int GetFrameLen() const;
+        // ID of the recorded controller (0 in version 1 captures).
+        uint32_t GetDeviceId() const;
+        // Number of complete frames (incomplete record at the end is ignored).
+        size_t GetFrameCount() const;
+
+        uint64_t GetTimestamp(size_t const& index) const;
+        char const* GetFrame(size_t const& index) const;
+
+        private:
+        char const* map;
+        size_t mapLen;
+        size_t headerLen;
+        int frameLen;
+        uint32_t deviceId;
+        size_t recordLen;
+        size_t frameCount;
+
+        char const* GetRecord(size_t const& index) const;
+    };
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _KMICKI_HIDDEV_CAPTUREWRITER_H_
+#define _KMICKI_HIDDEV_CAPTUREWRITER_H_
+
+#include "hiddevreader.h"
+#include "capturefile.h"
+#include "pipeline/thread.h"
+
+#include <cstdio>
+
+namespace kmicki::hiddev
+{
+    // Writes every frame served by HidDevReader (with its timestamp) to a capture file.
+    // Capture can be played back with HidDevReader's replay constructor.
+    class CaptureWriter : public pipeline::Thread
+    {
+        public:
+        CaptureWriter() = delete;
+        CaptureWriter(HidDevReader & _reader, std::string const& _path);
+        ~CaptureWriter();
+
+        // Create capture file and start writing frames. Starts reader.
+        // Throws std::runtime_error if file can't be created.
+        void StartCapture();
+        void StopCapture();
+
+        protected:
+        void Execute() override;
+        void FlushPipes() override;
+
+        private:
+        HidDevReader & reader;
+        std::string path;
+        FILE* file;
+        pipeline::Serve<HidDevReader::frame_t> * frameServe;
+    };
+}
+
+#endif
@@ -19,8 +19,11 @@ namespace kmicki::hiddev
         bool Close();
         bool IsOpen();
 
+        // Interrupt Read when fd becomes readable. Caller is responsible for resetting fd.
+        void SetWakeFd(int fd);
+
         private:
-        pollfd fileDescriptors[1];
+        pollfd fileDescriptors[2];
         int & file;
         std::string filePath;
         timespec timeout;
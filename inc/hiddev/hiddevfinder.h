@@ -2,11 +2,32 @@
 #define _KMICKI_HIDDEV_HIDDEVFINDER_H_
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 namespace kmicki::hiddev
 {
     // find which X among /dev/usb/hiddevX fits provided VID+PID
     int FindHidDevNo(uint16_t vid, uint16_t pid);
+
+    // hidraw device of a controller
+    struct HidRawDeviceInfo
+    {
+        std::string path;       // /dev/hidrawX
+        std::string serial;     // USB serial number (USB port path if device has none)
+        uint32_t id;            // Stable ID of the device derived from serial
+    };
+
+    // find all /dev/hidrawX of the provided VID+PID and USB interface number
+    std::vector<HidRawDeviceInfo> FindHidRawDevices(uint16_t vid, uint16_t pid, int interfaceNumber);
+
+    // find /dev/hidrawX of the provided VID+PID and USB interface number
+    // serial: take only device of this serial (empty - first found)
+    // returns empty string if not found
+    std::string FindHidRawPath(uint16_t vid, uint16_t pid, int interfaceNumber, std::string const& serial = std::string());
+
+    // Stable ID of the device with provided serial (FNV-1a hash)
+    uint32_t GetDeviceId(std::string const& serial);
 }
 
 #endif
@@ -2,14 +2,20 @@
 #define _KMICKI_HIDDEV_HIDDEVREADER_H_
 
 #include <vector>
-#include <shared_mutex>
 
 #include "pipeline/thread.h"
 #include "pipeline/signalout.h"
 #include "pipeline/pipeout.h"
 #include "pipeline/serve.h"
+#include "pipeline/eventfd.h"
+#include "pipeline/stagestats.h"
+#include "metrics/metrics.h"
 
 #include "hiddevfile.h"
+#include "hidframe.h"
+#include "capturefile.h"
+#include "hotplug.h"
+#include "pipeline/seqlock.h"
 
 using namespace kmicki::pipeline;
 
@@ -17,13 +23,27 @@ namespace kmicki::hiddev
 {
     void HandleMissedTicks(std::string name, std::string tickName, bool received, int & ticks, int period, int & nonMissed);
 
+    // Connection state of the input device
+    struct ReconnectStats
+    {
+        bool connected;             // Device is open and being read
+        uint64_t disconnects;       // Times the device was lost
+        uint64_t reconnects;        // Times the device was reopened after being lost
+        uint64_t lastLatencyUs;     // Time from losing the device to reopening it (last reconnect)
+        uint64_t maxLatencyUs;      // Longest reconnect time so far
+    };
+
+    class HidRawDev;
+
     // Reads periodic data from a given HID device (/dev/usb/hiddevX)
-    // in constant-length frames and provides most recent frame.
+    // in constant-length frames and serves them to consumers.
+    // Every consumer can get either the most recent frame or all frames in order
+    // (as long as it does not fall behind by more than cFrameRingLen frames).
     class HidDevReader
     {
         public:
 
-        typedef std::vector<char> frame_t;
+        typedef HidFrame frame_t;
 
         HidDevReader() = delete;
 
@@ -42,7 +62,7 @@ namespace kmicki::hiddev
 
         // Constructor.
         // Starts pipeline.
-        // Uses hidapi (hidraw) to obtain data from device.
+        // Uses /dev/hidrawX directly or hidapi (hidraw) to obtain data from device.
         // vId: vendor ID
         // pId: product ID
         // interfaceNumber: interface number of the device
@@ -53,7 +73,20 @@ namespace kmicki::hiddev
         //           If it will be much higher then the generated frames will be out of sync
         //           (a block of consecutive frames and then skip)
         // maxScanTime: maximum scan time
-        HidDevReader(uint16_t const& vId, uint16_t const& pId, const int& interfaceNumber, int const& _frameLen, int const& scanTimeUs);
+        // useHidRaw: read /dev/hidrawX directly instead of through hidapi
+        // serial: read only device with this USB serial number (see FindHidRawDevices), empty - first found.
+        //         Supported only with useHidRaw.
+        HidDevReader(uint16_t const& vId, uint16_t const& pId, const int& interfaceNumber, int const& _frameLen, int const& scanTimeUs, bool useHidRaw = true, std::string const& serial = std::string());
+
+        // Constructor.
+        // Starts pipeline.
+        // Plays back frames from a capture file (see CaptureWriter) instead of reading a device.
+        // capturePath: path of the capture file
+        // frameLen: Size of single HID data frame (has to match the capture)
+        // speed: Playback speed relative to real time (1.0 - real time). 
+        //        0 plays frames as fast as possible.
+        // loop: Start over when end of capture is reached
+        HidDevReader(std::string const& capturePath, int const& _frameLen, double const& speed = 1.0, bool const& loop = false);
 
         // Destructor. 
         // Stops pipeline.
@@ -83,6 +116,32 @@ namespace kmicki::hiddev
 
         void SetNoGyro(SignalOut& _noGyro);
 
+        // Replace source of device add/remove events (takes ownership).
+        // Has to be called while frame grabbing is stopped.
+        void SetHotplugSource(HotplugSource* source);
+
+        // Read from given device node instead of looking the device up (hidraw input only).
+        // Has to be called while frame grabbing is stopped.
+        void SetDevicePath(std::string const& path);
+
+        // Get connection state of the input device.
+        ReconnectStats GetReconnectStats();
+
+        // ID of the controller (see GetDeviceId in hiddevfinder.h): derived from serial number,
+        // recorded one when replaying a capture, 0 if unknown.
+        uint32_t GetDeviceId();
+
+        // Has frame grabbing ended on its own (end of replayed capture)?
+        bool IsFinished();
+
+        // Timing of frames at stage boundaries (see StageStats). Can be read while grabbing frames.
+        // Read: frame read from the device, before it is handed over.
+        StageStats const& GetReadStats();
+        // Process: frame extracted from hiddev records (nullptr if input needs no processing).
+        StageStats const* GetProcessStats();
+        // Publish: frame published to consumers.
+        StageStats const& GetPublishStats();
+
         private:
 
         // Pipeline threads
@@ -91,18 +150,67 @@ namespace kmicki::hiddev
         {
             public:
             ReadData() = delete;
-            ReadData(int const& _frameLen);
+            // deviceId: ID of the controller metrics are labelled with
+            ReadData(int const& _frameLen, uint32_t const& _deviceId = 0);
             ~ReadData();
 
             void SetStartMarker(std::vector<char> const& marker);
 
-            PipeOut<std::vector<char>> Data;
+            // Publish frames directly to consumers instead of sending them through Data.
+            void ServeFrames(Broadcast<frame_t> & _frameServe);
+
+            // Set signal requesting reenabling of the gyro (if supported by the input).
+            virtual void SetNoGyro(SignalOut& _noGyro);
+
+            // Set source of device add/remove events (if supported by the input).
+            virtual void SetHotplugSource(HotplugSource* _hotplug);
+
+            // Set device node to read from (if supported by the input).
+            virtual void SetDevicePath(std::string const& _path);
+
+            ReconnectStats GetReconnectStats();
+
+            uint32_t GetDeviceId();
+
+            PipeOut<frame_t> Data;
             SignalOut Unsynced;
 
+            StageStats ReadStats;
+            StageStats PublishStats;    // if frames are served directly
+
             protected:
 
             void FlushPipes() override;
+            // Send filled data to the next operation.
+            void SendFrame();
+            // Wait until the next operation took the frame sent last
+            // (every consumer is done with it when frames are served directly).
+            // Returns false if the thread should stop.
+            bool WaitUntilConsumed();
+            // Update connection state.
+            void ReportConnected();
+            void ReportDisconnected();
+            // Count gyro reenabled by the input.
+            void ReportGyroReenabled();
+            // Count restart of reading after frames got out of sync.
+            void ReportUnsynced();
             std::vector<char> startMarker;
+
+            private:
+            Broadcast<frame_t> * frameServe;
+
+            ReconnectStats reconnectStats;
+            uint64_t disconnectedAt;
+            SeqLock<ReconnectStats> publishedReconnectStats;
+
+            uint32_t deviceId;
+            metrics::Gauge connectedMetric;
+            metrics::Counter disconnectsMetric;
+            metrics::Counter reconnectsMetric;
+            metrics::Gauge reconnectLatencyMetric;
+            metrics::Gauge maxReconnectLatencyMetric;
+            metrics::Counter gyroReenablesMetric;
+            metrics::Counter unsyncedMetric;
         };
 
         class ReadDataFile : public ReadData
@@ -110,6 +218,7 @@ namespace kmicki::hiddev
             public:
             ReadDataFile() = delete;
             ReadDataFile(std::string const& _inputFilePath, int const& _frameLen, int const& _scanTimeUs);
+            ~ReadDataFile();
 
             void ReconnectInput();
             void DisconnectInput();
@@ -119,7 +228,7 @@ namespace kmicki::hiddev
             void Execute() override;
 
             private:
-            bool CheckData(std::unique_ptr<std::vector<char>> const& data, ssize_t readCnt);
+            bool CheckData(std::unique_ptr<frame_t> const& data, ssize_t readCnt);
             HidDevFile inputFile;
         };
         
@@ -130,7 +239,7 @@ namespace kmicki::hiddev
             ReadDataApi(uint16_t const& vId, uint16_t const& pId, const int& _interfaceNumber, int const& _frameLen, int const& _scanTimeUs);
             ~ReadDataApi();
 
-            void SetNoGyro(SignalOut& _noGyro);
+            void SetNoGyro(SignalOut& _noGyro) override;
 
             protected:
 
@@ -145,38 +254,67 @@ namespace kmicki::hiddev
             SignalOut *noGyro;
         };
 
-        class ProcessData : public Thread
+        class ReadDataRaw : public ReadData
         {
             public:
-            ProcessData() = delete;
-            ProcessData(int const& _frameLen, ReadData & _data, int const& scanTimeUs);
-            ~ProcessData();
+            ReadDataRaw() = delete;
+            ReadDataRaw(uint16_t const& vId, uint16_t const& pId, const int& _interfaceNumber, int const& _frameLen, int const& _scanTimeUs, std::string const& _serial);
+            ~ReadDataRaw();
 
-            PipeOut<frame_t> Frame;
-            SignalOut ReadStuck;
+            void SetNoGyro(SignalOut& _noGyro) override;
+            void SetHotplugSource(HotplugSource* _hotplug) override;
+            void SetDevicePath(std::string const& _path) override;
 
             protected:
 
             void Execute() override;
-            void FlushPipes() override;
 
             private:
-            ReadData & readData;
-            PipeOut<std::vector<char>> & data;
+            uint16_t vId;
+            uint16_t pId;
+            int interfaceNumber;
+            int scanTimeUs;
+            std::string serial;
+            std::string devicePath;
 
-            std::chrono::microseconds timeout;
+            // Wakes the reading to reenable gyro.
+            EventFd wake;
+            SignalOut *noGyro;
+            HotplugSource *hotplug;
+
+            // Handle pending hotplug events. Closes device if it was removed.
+            void HandleHotplug(HidRawDev & dev);
+            void EnableGyro(HidRawDev & dev);
+        };
+
+        class ReadDataReplay : public ReadData
+        {
+            public:
+            ReadDataReplay() = delete;
+            ReadDataReplay(std::string const& _capturePath, int const& _frameLen, double const& _speed, bool const& _loop);
+            ~ReadDataReplay();
+
+            protected:
+
+            void Execute() override;
+
+            private:
+            CaptureFile capture;
+            double speed;
+            bool loop;
         };
 
-        class ServeFrame : public Thread
+        class ProcessData : public Thread
         {
             public:
-            ServeFrame() = delete;
-            ServeFrame(PipeOut<frame_t> & _frame);
-            ~ServeFrame();
+            ProcessData() = delete;
+            ProcessData(int const& _frameLen, ReadData & _data, Broadcast<frame_t> & _frame, int const& scanTimeUs);
+            ~ProcessData();
 
-            Serve<frame_t> & GetServe();
+            SignalOut ReadStuck;
 
-            void StopServe(Serve<frame_t> & serve);
+            StageStats ProcessStats;
+            StageStats PublishStats;
 
             protected:
 
@@ -184,32 +322,39 @@ namespace kmicki::hiddev
             void FlushPipes() override;
 
             private:
-            void WaitForServes();
-            void HandleMissedFrames(int &serveCnt, std::vector<int> &missedTicks, std::vector<int> &nonMissedTicks, std::vector<std::string> &serveNames);
-            PipeOut<frame_t> & frame;
-            std::vector<std::unique_ptr<Serve<frame_t>>> frames;
-            std::vector<Serve<frame_t>::ServeLock> GetServeLocks();
-            std::shared_mutex framesMutex;
-            std::condition_variable_any framesCv;
+            ReadData & readData;
+            PipeOut<frame_t> & data;
+            Broadcast<frame_t> & frame;
+            frame_t frameBuffer;
+
+            std::chrono::microseconds timeout;
+
+            metrics::Counter readStuckMetric;
         };
 
         static const int cInputRecordLen;
         static const int cByteposInput;
+        static const int cFrameRingLen;
 
         int frameLen;
 
         std::string inputFilePath;
         
         std::vector<std::unique_ptr<Thread>> pipeline;
-        ServeFrame * serve;
+        std::unique_ptr<Broadcast<frame_t>> serve;
+        std::unique_ptr<HotplugSource> hotplug;
         ReadData* readData;
-        ReadDataApi* readDataApi;
+        ProcessData* processData;
+
+        // Exported stage timing (destroyed before the pipeline)
+        std::vector<std::unique_ptr<metrics::StageSummary>> stageSummaries;
 
         // Mutex
         std::mutex startStopMutex;
 
         void AddOperation(pipeline::Thread * operation);
 
+        // Scheduling of the stages is taken from environment (stages READ and PROCESS, see ThreadConfig::FromEnv).
         void ConstructPipeline(ReadData* _readData, int const& _frameLen, int const& scanTimeUs, bool useProcessData = true);
 
         
@@ -0,0 +1,23 @@
+#ifndef _KMICKI_HIDDEV_HIDFRAME_H_
+#define _KMICKI_HIDDEV_HIDFRAME_H_
+
+#include <vector>
+#include <cstdint>
+
+namespace kmicki::hiddev
+{
+    // Data of a single HID frame together with the time it was read.
+    class HidFrame : public std::vector<char>
+    {
+        public:
+        using std::vector<char>::vector;
+
+        // CLOCK_MONOTONIC time in microseconds right after the read returned
+        uint64_t Timestamp = 0;
+    };
+
+    // Current CLOCK_MONOTONIC time in microseconds (of the pipeline's clock, see pipeline::GetClock)
+    uint64_t GetMonotonicTimestamp();
+}
+
+#endif
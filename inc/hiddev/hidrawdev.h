@@ -0,0 +1,64 @@
+#ifndef _KMICKI_HIDDEV_HIDRAWDEV_
+#define _KMICKI_HIDDEV_HIDRAWDEV_
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+namespace kmicki::hiddev
+{
+    // HID device accessed directly through /dev/hidrawX.
+    // Reading waits with epoll on the device and on additional
+    // wake file descriptors (e.g. eventfd), so it can be interrupted at any time.
+    class HidRawDev
+    {
+        public:
+        HidRawDev() = delete;
+        // serial: open only device with this serial number (empty - first found)
+        HidRawDev(const uint16_t& _vId, const uint16_t _pId, const int& _interfaceNumber, int readTimeoutUs, std::string const& _serial = std::string());
+        ~HidRawDev();
+
+        bool Open();
+        // Open given device node instead of looking it up by vendor/product ID
+        // (e.g. a FIFO fed with recorded reports). Empty path restores the lookup.
+        void SetPath(std::string const& _path);
+        // Read one report straight into data.
+        // Returns number of bytes read, 0 on timeout or when woken by wake descriptor,
+        // negative value on error (e.g. device was removed).
+        int Read(std::vector<char> & data);
+        // Read one report into data without waiting.
+        // Returns number of bytes read, 0 if no report is pending, negative value on error.
+        int TryRead(std::vector<char> & data);
+        bool Close();
+        bool IsOpen();
+        bool EnableGyro();
+        bool Write(std::vector<unsigned char> & data);
+
+        // Interrupt Read when fd becomes readable. Caller is responsible for resetting fd.
+        bool AddWakeFd(int fd);
+
+        // Wait only for wake descriptors (e.g. while device is closed).
+        // Returns true if any of them became readable.
+        bool Wait(int timeoutMs);
+
+        // Path of the opened device.
+        std::string const& GetPath();
+
+        // Descriptor of the opened device (-1 if closed), for waiting on it in an external event loop.
+        int GetFd();
+
+        private:
+        uint16_t vId;
+        uint16_t pId;
+        int interfaceNumber;
+        int timeout;
+        std::string serial;
+        std::string fixedPath;
+
+        std::string path;
+        int dev;
+        int epoll;
+    };
+}
+
+#endif
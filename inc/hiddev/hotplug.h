@@ -0,0 +1,92 @@
+#ifndef _KMICKI_HIDDEV_HOTPLUG_H_
+#define _KMICKI_HIDDEV_HOTPLUG_H_
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <mutex>
+
+#include "pipeline/eventfd.h"
+
+struct sd_device;
+struct sd_device_monitor;
+struct sd_event;
+
+namespace kmicki::hiddev
+{
+    enum class HotplugAction
+    {
+        Add,
+        Remove
+    };
+
+    struct HotplugEvent
+    {
+        HotplugAction action;
+        std::string devName;    // e.g. /dev/hidraw3
+    };
+
+    // Source of hidraw device add/remove events.
+    // Its descriptor can be waited on together with the device (poll/epoll).
+    class HotplugSource
+    {
+        public:
+        virtual ~HotplugSource();
+
+        // File descriptor that is readable when events are pending.
+        virtual int GetFd() = 0;
+
+        // Take next pending event. Returns false if there are no more.
+        virtual bool TryEvent(HotplugEvent & event) = 0;
+    };
+
+    // Hotplug events from udev (sd_device_monitor).
+    // Reports additions of hidraw devices of provided VID+PID and USB interface number
+    // and removals of any hidraw device (sysfs of removed device can't be inspected anymore).
+    class UdevHotplugSource : public HotplugSource
+    {
+        public:
+        UdevHotplugSource() = delete;
+        UdevHotplugSource(UdevHotplugSource const&) = delete;
+        UdevHotplugSource& operator=(UdevHotplugSource const&) = delete;
+
+        // Throws std::runtime_error if monitor can't be started.
+        UdevHotplugSource(uint16_t const& _vId, uint16_t const& _pId, int const& _interfaceNumber);
+        ~UdevHotplugSource();
+
+        int GetFd() override;
+        bool TryEvent(HotplugEvent & event) override;
+
+        private:
+        static int HandleDevice(sd_device_monitor* monitor, sd_device* device, void* userdata);
+
+        uint16_t vId;
+        uint16_t pId;
+        int interfaceNumber;
+
+        sd_device_monitor* monitor;
+        sd_event* event;
+
+        std::deque<HotplugEvent> pending;
+    };
+
+    // Hotplug events pushed by hand (e.g. to test reconnecting without a device).
+    class ManualHotplugSource : public HotplugSource
+    {
+        public:
+        ManualHotplugSource();
+
+        // Queue event. Can be called from any thread.
+        void Push(HotplugEvent const& event);
+
+        int GetFd() override;
+        bool TryEvent(HotplugEvent & event) override;
+
+        private:
+        pipeline::EventFd signal;
+        std::mutex pendingMutex;
+        std::deque<HotplugEvent> pending;
+    };
+}
+
+#endif
@@ -1,8 +1,24 @@
 #ifndef _KMICKI_LOG_LOG_H_
 #define _KMICKI_LOG_LOG_H_
 
+#include <atomic>
+#include <optional>
+#include <ostream>
+#include <streambuf>
 #include <string>
-#include <sstream>
+#include <string_view>
+
+// Most verbose level compiled in (0 - none ... 3 - trace).
+// Messages above it are removed at compile time when logged through Log or KMICKI_LOGF,
+// e.g. build with -DSDMOTION_LOG_MAX_LEVEL=1 to drop all debug and trace logging.
+#ifndef SDMOTION_LOG_MAX_LEVEL
+#define SDMOTION_LOG_MAX_LEVEL 3
+#endif
+
+// Log formatted message without evaluating its arguments if the level is disabled.
+// Usage: { KMICKI_LOGF(LogLevelTrace) << "Frame " << Describe(frame); }
+#define KMICKI_LOGF(level) \
+    if(!::kmicki::log::IsLogEnabled(level)) ; else ::kmicki::log::LogF(level)
 
 namespace kmicki::log
 {
@@ -14,30 +30,88 @@ namespace kmicki::log
         LogLevelTrace    =   3
     };
 
-    extern LogLevel currentLogType;
+    // Where messages are written by the background log writer.
+    enum class LogOutput
+    {
+        Stdout,     // one line per message
+        Stderr,     // one line per message (when stdout carries data)
+        Journal     // structured journald entries (sd_journal_send)
+    };
+
+    // Messages longer than that are truncated.
+    static const int cMaxMessageLen = 512;
+
+    extern std::atomic<LogLevel> currentLogType;
 
     void SetLogLevel(LogLevel type);
 
-    LogLevel const& GetLogLevel();
+    // Set log level from SDMOTION_LOG_LEVEL environment variable
+    // (none, default, debug, trace or 0-3). Uses defaultType if not set.
+    void SetLogLevelFromEnv(LogLevel defaultType);
+
+    LogLevel GetLogLevel();
+
+    // Default: journal if stdout of the process is connected to journald
+    // (JOURNAL_STREAM, e.g. when run as systemd service), stdout otherwise.
+    // SDMOTION_LOG_OUTPUT environment variable (stdout, stderr or journal) overrides it.
+    void SetLogOutput(LogOutput output);
+
+    inline bool IsLogEnabled(LogLevel type)
+    {
+        return type <= SDMOTION_LOG_MAX_LEVEL && type <= currentLogType.load(std::memory_order_relaxed);
+    }
+
+    // Queue message for the background writer.
+    // Copies it into a preallocated per-thread ring without allocating or locking.
+    // If the ring is full, the message is dropped (and counted).
+    void WriteLog(std::string_view message, LogLevel type);
 
     // Log a string message
-    void Log(std::string message,LogLevel type = LogLevelDefault);
+    inline void Log(std::string_view message, LogLevel type = LogLevelDefault)
+    {
+        if(IsLogEnabled(type))
+            WriteLog(message, type);
+    }
+
+    // Wait until all messages logged so far are written.
+    void FlushLog();
+
+    // Stream buffer over a fixed array. Characters that don't fit are dropped.
+    class FixedStreamBuf : public std::streambuf
+    {
+        public:
+        FixedStreamBuf(char * buffer, size_t size);
+        std::string_view View() const;
+        void Reset();
+
+        protected:
+        int_type overflow(int_type c) override;
+
+        private:
+        char * begin;
+        size_t size;
+    };
 
     // class for logging formatted message
     // Behaves like output stream and message gets logged on destruction.
+    // Formats on the stack without allocating; does nothing if the level is disabled
+    // (but arguments are still evaluated - use KMICKI_LOGF to skip them).
     // Usage: { LogF() << "This is an example message number " << nr << "!"; }
-    class LogF : protected std::ostringstream
+    class LogF
     {
         public:
 
         LogF(LogLevel type = LogLevelDefault);
         ~LogF();
 
+        LogF(LogF const&) = delete;
+        LogF& operator=(LogF const&) = delete;
+
         template<class T>
         LogF& operator<<(T const& val)
         {
-            if(logType <= currentLogType)
-                *((std::ostringstream*)this) << val;            
+            if(stream)
+                stream->out << val;
             return *this;
         }
 
@@ -45,8 +119,18 @@ namespace kmicki::log
         void LogNow();
 
         private:
+        struct Stream
+        {
+            Stream(char * buffer, size_t size);
+
+            FixedStreamBuf buf;
+            std::ostream out;
+        };
+
         LogLevel logType;
+        char text[cMaxMessageLen];
+        std::optional<Stream> stream;
     };
 }
 
-#endif
\ No newline at end of file
+#endif
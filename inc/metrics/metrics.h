@@ -0,0 +1,150 @@
+#ifndef _KMICKI_METRICS_METRICS_H_
+#define _KMICKI_METRICS_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "pipeline/stagestats.h"
+
+namespace kmicki::metrics
+{
+    typedef std::vector<std::pair<std::string,std::string>> Labels;
+
+    // Labels identifying a controller (see GetDeviceId).
+    Labels DeviceLabels(uint32_t const& deviceId);
+
+    enum class MetricType : uint8_t
+    {
+        Counter = 0,
+        Gauge = 1,
+        Summary = 2
+    };
+
+    // Single value of a metric taken by Registry::Collect.
+    struct Sample
+    {
+        std::string family;     // metric name (HELP/TYPE are per family)
+        std::string name;       // family with suffix (e.g. _sum)
+        std::string help;
+        MetricType type;
+        Labels labels;
+        double value;
+    };
+
+    // Metric registered in the Registry for its whole lifetime
+    // (final classes register at the end of construction and unregister at the start of destruction).
+    // Every metric is written by a single thread (the one owning it),
+    // so updating it never contends with other writers and never waits for readers.
+    class Metric
+    {
+        public:
+        Metric(Metric const&) = delete;
+        Metric& operator=(Metric const&) = delete;
+        virtual ~Metric();
+
+        // Append current value(s) to samples. Called by readers.
+        virtual void Collect(std::vector<Sample> & samples) const = 0;
+
+        protected:
+        Metric(std::string const& _name, std::string const& _help, Labels const& _labels);
+
+        void Register();
+        void Unregister();
+
+        Sample MakeSample(MetricType type, double value) const;
+
+        std::string name;
+        std::string help;
+        Labels labels;
+    };
+
+    // Monotonically increasing count.
+    class Counter final : public Metric
+    {
+        public:
+        Counter(std::string const& _name, std::string const& _help, Labels const& _labels = Labels());
+        ~Counter();
+
+        // Methods to be used by the writer:
+        void Increment(uint64_t const& count = 1);
+
+        uint64_t Get() const;
+        void Collect(std::vector<Sample> & samples) const override;
+
+        private:
+        // Own cache line - writers of neighbouring metrics don't invalidate each other.
+        alignas(64) std::atomic<uint64_t> value;
+    };
+
+    // Value that goes up and down.
+    class Gauge final : public Metric
+    {
+        public:
+        Gauge(std::string const& _name, std::string const& _help, Labels const& _labels = Labels());
+        ~Gauge();
+
+        // Methods to be used by the writer:
+        void Set(double const& _value);
+
+        double Get() const;
+        void Collect(std::vector<Sample> & samples) const override;
+
+        private:
+        alignas(64) std::atomic<double> value;
+    };
+
+    // Exports timing of a pipeline stage boundary as two summaries
+    // (sdmotion_stage_latency_seconds and sdmotion_stage_interval_seconds) labelled with the stage.
+    // StageStats is written by its stage and read here without locking.
+    class StageSummary final : public Metric
+    {
+        public:
+        StageSummary(std::string const& stage, pipeline::StageStats const& _stats, Labels const& _labels = Labels());
+        ~StageSummary();
+
+        void Collect(std::vector<Sample> & samples) const override;
+
+        private:
+        pipeline::StageStats const& stats;
+    };
+
+    // All live metrics of the process.
+    // Registering (on construction of metrics) and collecting share a mutex,
+    // updating metric values never touches it.
+    class Registry
+    {
+        public:
+        static Registry & Get();
+
+        void Add(Metric * metric);
+        void Remove(Metric * metric);
+
+        // Current values of all metrics, grouped by family.
+        std::vector<Sample> Collect();
+
+        private:
+        Registry() = default;
+
+        std::mutex metricsMutex;
+        std::vector<Metric*> metrics;
+    };
+
+    // Prometheus text exposition format (version 0.0.4).
+    std::string FormatPrometheus(std::vector<Sample> const& samples);
+
+    // Compact binary snapshot (little-endian):
+    //   header: magic "SDMMETR\0", uint32 version, uint32 sample count, uint64 CLOCK_MONOTONIC time [us]
+    //   sample: uint8 type, uint16 name length, name, uint16 label count,
+    //           per label: uint16 key length, key, uint16 value length, value,
+    //           double value
+    std::string FormatBinary(std::vector<Sample> const& samples);
+
+    static const char cBinaryMagic[8] = { 'S','D','M','M','E','T','R','\0' };
+    static const uint32_t cBinaryVersion = 1;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _KMICKI_METRICS_METRICSSERVER_H_
+#define _KMICKI_METRICS_METRICSSERVER_H_
+
+#include "pipeline/thread.h"
+#include <string>
+
+namespace kmicki::metrics
+{
+    // Serves metrics of the Registry on a Unix domain stream socket, one request per connection.
+    // Request is either a single line:
+    //   text (or empty line) - Prometheus text format
+    //   binary               - binary snapshot (see FormatBinary)
+    // or an HTTP GET of /metrics (text) or /snapshot (binary), e.g.:
+    //   curl --unix-socket <path> http://localhost/metrics
+    // Runs on its own thread; collecting never blocks threads updating the metrics.
+    class MetricsServer : public pipeline::Thread
+    {
+        public:
+        MetricsServer() = delete;
+        // Listen on path (replaces stale socket file). Starts serving.
+        // Throws std::runtime_error if socket can't be created.
+        MetricsServer(std::string const& _path);
+        ~MetricsServer();
+
+        // Socket path from SDMOTION_METRICS_SOCKET environment variable (empty - metrics not served).
+        static std::string GetPathFromEnv();
+
+        protected:
+        void Execute() override;
+        void FlushPipes() override;
+
+        private:
+        std::string path;
+        int listenFd;
+
+        void HandleClient(int clientFd);
+    };
+}
+
+#endif
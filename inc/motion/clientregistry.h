@@ -0,0 +1,138 @@
+#ifndef _KMICKI_MOTION_CLIENTREGISTRY_H_
+#define _KMICKI_MOTION_CLIENTREGISTRY_H_
+
+#include "motion/subscription.h"
+#include "pipeline/snapshot.h"
+#include <sys/socket.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kmicki::motion
+{
+    // IPv4 or IPv6 address and port of a client.
+    // Only family, address, port (and IPv6 scope) are kept, so equal addresses are equal byte for byte.
+    struct ClientAddress
+    {
+        sockaddr_storage storage;
+        socklen_t length;
+
+        ClientAddress();
+        ClientAddress(sockaddr const* address, socklen_t const& addressLength);
+
+        sockaddr const* Get() const;
+
+        // IPv4 mapped to IPv6 is shown as IPv4, e.g. "127.0.0.1:4242" or "[::1]:4242"
+        std::string ToString() const;
+
+        bool operator==(ClientAddress const& other) const;
+    };
+
+    struct ClientAddressHash
+    {
+        size_t operator()(ClientAddress const& address) const;
+    };
+
+    // Registered clients of a motion socket.
+    // Registrations are looked up by address in a hash table and expire through a hashed timer wheel,
+    // so neither registering nor expiring scans all clients.
+    // Clients are published to senders as an immutable snapshot (pipeline::Snapshot),
+    // so sending never waits for registrations.
+    class ClientRegistry
+    {
+        public:
+        typedef std::chrono::steady_clock::time_point time_point;
+
+        struct Client
+        {
+            ClientAddress address;
+            Subscription subscription;
+            size_t encoding;        // Index in Clients::encodings
+        };
+
+        // Published list of clients
+        struct Clients
+        {
+            std::vector<Client> clients;
+            std::vector<Subscription> encodings;   // Distinct encodings of subscriptions
+            uint64_t generation;                    // Different in every published list
+        };
+
+        // Access to published clients for one thread.
+        class Reader
+        {
+            public:
+            Reader(ClientRegistry & registry);
+
+            // Current clients. Stay valid until the next Load.
+            Clients const& Load();
+
+            private:
+            pipeline::Snapshot<Clients>::Reader reader;
+        };
+
+        enum class Change
+        {
+            None,           // Registration refreshed
+            Added,
+            Subscription    // Subscription changed
+        };
+
+        ClientRegistry(std::chrono::seconds const& _timeout);
+
+        // Methods to be used by the thread receiving registrations:
+
+        // Register client or refresh its registration. Changes are published by Publish.
+        Change Register(ClientAddress const& address, Subscription const& subscription, time_point const& now);
+
+        // Remove clients not seen within timeout. Changes are published by Publish.
+        // Returns number of clients removed.
+        size_t Expire(time_point const& now);
+
+        // Publish changes of registrations to senders (if any).
+        void Publish();
+
+        // Published clients.
+        Clients const& GetClients() const;
+
+        // Methods to be used by any thread:
+
+        size_t GetCount() const;
+
+        private:
+        struct Registration
+        {
+            Subscription subscription;
+            time_point lastSeen;
+        };
+
+        typedef std::unordered_map<ClientAddress, Registration, ClientAddressHash> Registrations;
+
+        std::chrono::seconds timeout;
+
+        std::mutex registrationsMutex;
+        Registrations registrations;
+        bool changed;
+
+        // Timer wheel: slot of every second holds registrations to check when it passes
+        // (elements of unordered_map keep their address until erased).
+        // A client is checked at lastSeen + timeout as of its registration;
+        // if it was seen since then it is scheduled again (refreshing doesn't touch the wheel).
+        std::vector<std::vector<Registrations::value_type*>> wheel;
+        std::vector<Registrations::value_type*> due;   // Slot being processed
+        int64_t wheelSecond;        // Last second processed
+
+        pipeline::Snapshot<Clients> published;
+        uint64_t generation;
+        std::atomic<size_t> count;
+
+        static int64_t ToSecond(time_point const& time);
+        void Schedule(Registrations::value_type & registration, time_point const& time);
+    };
+}
+
+#endif
@@ -3,10 +3,11 @@
 
 #include "motion/simplemotion.h"
 #include "sdgyrodsu/motionadapter.h"
+#include "motion/motionsocket.h"
+#include "pipeline/eventfd.h"
 #include <thread>
-#include <netinet/in.h>
 #include <mutex>
-#include <shared_mutex>
+#include <atomic>
 #include <vector>
 #include <chrono>
 
@@ -17,46 +18,46 @@ namespace kmicki::motion
         public:
         JsonServer() = delete;
         JsonServer(kmicki::sdgyrodsu::MotionAdapter & _motionSource);
+        // Serve motion data of multiple controllers (tagged with their device IDs).
+        JsonServer(std::vector<kmicki::sdgyrodsu::MotionAdapter*> const& _motionSources);
         ~JsonServer();
 
+        // Serve motion data of another controller (e.g. connected later). Can be called while serving.
+        // Motion source has to outlive the server.
+        void AddMotionSource(kmicki::sdgyrodsu::MotionAdapter & motionSource);
+
+        // Timing of motion data serialized and sent. Can be read at any time.
+        pipeline::StageStats const& GetSerializeStats();
+        pipeline::StageStats const& GetSendStats();
+
         private:
         
-        struct Client
-        {
-            sockaddr_in address;
-            std::chrono::steady_clock::time_point lastSeen;
-            
-            bool operator==(sockaddr_in const& other) const;
-            bool operator!=(sockaddr_in const& other) const;
-        };
-
         std::mutex mainMutex;
         std::mutex stopSendMutex;
-        std::mutex socketSendMutex;
-        std::shared_mutex clientsMutex;
 
         bool stop;
         bool stopSending;
 
-        int socketFd;
-        int broadcastPort;
+        // Interrupt waiting for clients and between sends
+        pipeline::EventFd stopEvent;
+        pipeline::EventFd stopSendEvent;
+
+        std::unique_ptr<MotionSocket> socket;
 
-        kmicki::sdgyrodsu::MotionAdapter & motionSource;
+        std::mutex motionSourcesMutex;
+        std::vector<kmicki::sdgyrodsu::MotionAdapter*> motionSources;
+        std::atomic<bool> motionSourcesAdded;   // Send thread hasn't taken new sources yet
         std::unique_ptr<std::thread> serverThread;
 
         void serverTask();
         void sendTask();
+        void stopSendTask(std::unique_ptr<std::thread> & sendThread);
+        // Take motion sources added since the last call and start their frame grab (send thread).
+        void takeMotionSources(std::vector<kmicki::sdgyrodsu::MotionAdapter*> & sources);
         void Start();
-        
-        std::vector<Client> clients;
-        
-        void AddClient(const sockaddr_in& clientAddr);
-        void RemoveStaleClients();
-        void BroadcastMotionData(const SimpleMotionData& data);
-        
-        static const int cDefaultPort = 27760;
-        static const int cSendRateHz = 60;  // 60Hz output (down from 250Hz input)
-        static const std::chrono::seconds cClientTimeout;
+
+        static constexpr int cSendRateHz = 60;  // 60Hz output (down from 250Hz input)
+        static const int cCleanupPeriodMs = 2000;   // Period of stale clients removal when no client registers
     };
 }
 
@@ -0,0 +1,133 @@
+#ifndef _KMICKI_MOTION_MOTIONSOCKET_H_
+#define _KMICKI_MOTION_MOTIONSOCKET_H_
+
+#include "motion/simplemotion.h"
+#include "motion/subscription.h"
+#include "motion/clientregistry.h"
+#include "pipeline/stagestats.h"
+#include "metrics/metrics.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+#include <chrono>
+
+namespace kmicki::motion
+{
+    // Destination of datagrams of a MotionSocket that has no UDP socket (e.g. output of a simulation).
+    class PacketSink
+    {
+        public:
+        virtual ~PacketSink();
+
+        // Datagram to client at given address.
+        virtual void Write(sockaddr const* address, socklen_t const& addressLength, char const* packet, size_t const& len) = 0;
+    };
+
+    // UDP socket serving motion data to registered clients (IPv6 socket accepting IPv4 too, IPv4 only as fallback).
+    // Any datagram received from a client registers it (or refreshes its registration).
+    // Contents of the datagram are the client's subscription (see Subscription).
+    // Clients that don't refresh registration within cClientTimeout are removed.
+    class MotionSocket
+    {
+        public:
+        // Bind to port from SDMOTION_SERVER_PORT environment variable (default cDefaultPort).
+        // sendRateHz: rate of Send calls (maximum rate of subscriptions)
+        // Throws std::runtime_error if socket can't be created or bound.
+        MotionSocket(int const& _sendRateHz = cDefaultSendRateHz);
+        // Write datagrams to sink instead of a UDP socket (sink has to outlive the socket).
+        // Clients are registered only by Register.
+        MotionSocket(PacketSink & _sink, int const& _sendRateHz = cDefaultSendRateHz);
+        ~MotionSocket();
+
+        MotionSocket(MotionSocket const&) = delete;
+        MotionSocket& operator=(MotionSocket const&) = delete;
+
+        // Descriptor to wait on for incoming registrations (-1 if writing to a sink).
+        int GetFd() const;
+
+        // Register clients of all pending datagrams without blocking.
+        // Returns number of datagrams received.
+        int ReceiveRegistrations();
+
+        // Register client or refresh its registration as if it sent a datagram.
+        void Register(ClientAddress const& address, Subscription const& subscription);
+
+        void RemoveStaleClients();
+
+        size_t GetClientCount();
+
+        // Send tick: send motion data of every controller to clients due at their rates,
+        // with a single sendmmsg call (more if some datagrams fail).
+        // Time of the tick is timestamp of the first motion data. Clients are due by that time
+        // on the grid of send ticks (started by the first call), not by number of calls,
+        // so ticks without fresh motion data (not sent) don't change rates of clients.
+        // Every distinct encoding of subscriptions is serialized once per motion data.
+        // Sends to a snapshot of clients, so it doesn't wait for registrations.
+        // Datagram headers are prepared once per snapshot of clients.
+        // Has to be called by one thread at a time (stage timing is single-writer).
+        void Send(SimpleMotionData const* data, size_t const& count);
+        void Send(SimpleMotionData const& data);
+
+        // Timing of motion data serialized and sent (latency since sensor_timestamp).
+        pipeline::StageStats const& GetSerializeStats();
+        pipeline::StageStats const& GetSendStats();
+
+        static const int cDefaultPort = 27760;
+        static constexpr int cDefaultSendRateHz = 60;
+        static const std::chrono::seconds cClientTimeout;
+
+        private:
+        // Without UDP socket
+        MotionSocket(PacketSink * _sink, int const& _sendRateHz);
+
+        // Register client of a datagram received now (published by PublishClients)
+        void RegisterClient(ClientAddress const& address, Subscription const& subscription, std::chrono::steady_clock::time_point const& now);
+
+        // Client with given rate gets current tick
+        bool IsDue(int const& rateHz) const;
+
+        // Packet of given rate in current tick (sequence of binary formats)
+        uint64_t GetSlot(int const& rateHz) const;
+
+        void PublishClients();
+
+        // Prepare datagram headers for clients and given number of motion data per tick.
+        void PrepareMessages(ClientRegistry::Clients const& clients, size_t const& count);
+
+        int sendRateHz;
+        int socketFd;
+        PacketSink * sink;
+        ClientRegistry registry;
+        ClientRegistry::Reader clientsReader;   // Used by the sending thread
+
+        // Used only by the sending thread (vectors only grow, so steady sending doesn't allocate):
+        bool started;
+        uint64_t startTime;         // Timestamp of the first send tick (microseconds)
+        uint64_t tick;              // Send ticks since before the first one, by time
+        uint64_t lastTick;          // Tick of the previous Send call
+        // Datagram headers are prepared for a snapshot of clients and reused until it changes.
+        uint64_t preparedGeneration;            // Generation of clients prepared for
+        size_t preparedCount;                   // Motion data per tick prepared for
+        std::vector<char> encodingsDue;         // Some client of the encoding is due in current tick
+        std::vector<char> packetBuffers;        // cMaxPacketLen per motion data and encoding
+        std::vector<iovec> packets;             // Per motion data and encoding (length set when serialized)
+        std::vector<char> clientsDue;
+        std::vector<mmsghdr> clientMessages;    // Per motion data and client, pointing to packets
+        std::vector<mmsghdr> messages;          // Datagrams of a tick when not all clients are due
+
+        pipeline::StageStats serializeStats;
+        pipeline::StageStats sendStats;
+
+        metrics::StageSummary serializeSummary;
+        metrics::StageSummary sendSummary;
+        metrics::Gauge clientsMetric;
+        metrics::Gauge encodingsMetric;
+        metrics::Counter datagramsMetric;
+        metrics::Counter bytesMetric;
+        metrics::Counter sendErrorsMetric;
+        metrics::Counter batchesMetric;
+        metrics::Counter partialBatchesMetric;
+    };
+}
+
+#endif
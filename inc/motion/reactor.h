@@ -0,0 +1,133 @@
+#ifndef _KMICKI_MOTION_REACTOR_H_
+#define _KMICKI_MOTION_REACTOR_H_
+
+#include "motion/simplemotion.h"
+#include "motion/motionsocket.h"
+#include "motion/sendtick.h"
+#include "hiddev/hidrawdev.h"
+#include "hiddev/hidframe.h"
+#include "hiddev/hotplug.h"
+#include "sdgyrodsu/motionconverter.h"
+#include "pipeline/signalout.h"
+#include "pipeline/eventfd.h"
+#include "pipeline/stagestats.h"
+#include "metrics/metrics.h"
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+
+namespace kmicki::motion
+{
+    // Whole service in a single thread.
+    // One epoll loop waits on hidraw devices, the UDP socket, a send timer and hotplug events,
+    // and reads, converts, serializes and sends motion data inline.
+    // Sends exactly what JsonServer does with HidDevReader and MotionAdapter pipelines,
+    // without any hand-offs between threads. Like JsonServer, it reads and sends only while
+    // clients are registered: devices are closed and send timer disarmed when the last one expires.
+    // Controllers connected later (new serial numbers) are added on hotplug events,
+    // or looked for periodically when hotplug events are unavailable.
+    class Reactor
+    {
+        public:
+        Reactor() = delete;
+        Reactor(Reactor const&) = delete;
+        Reactor& operator=(Reactor const&) = delete;
+
+        // Serve controllers of provided VID+PID and USB interface number.
+        // Throws std::runtime_error if socket or epoll can't be created.
+        Reactor(uint16_t const& _vId, uint16_t const& _pId, int const& _interfaceNumber, int const& _frameLen, int const& _scanTimeUs);
+        ~Reactor();
+
+        // Add controller with provided serial number (empty - first found).
+        // path: read from this device node instead of looking the controller up.
+        // Has to be called before Run.
+        void AddDevice(uint32_t const& deviceId, std::string const& serial = std::string(), std::string const& path = std::string());
+
+        // Serve until Stop is called. Runs on the calling thread.
+        void Run();
+
+        // Make Run return. Can be called from any thread and from signal handler.
+        void Stop();
+
+        // Timing of frames at stage boundaries (see StageStats). Can be read while Run is running.
+        // index: order in which devices were added
+        pipeline::StageStats const& GetReadStats(size_t index);
+        pipeline::StageStats const& GetConvertStats(size_t index);
+        pipeline::StageStats const& GetSerializeStats();
+        pipeline::StageStats const& GetSendStats();
+
+        private:
+        struct Device
+        {
+            Device(uint32_t const& _id, hiddev::HidRawDev* _dev, int const& frameLen);
+
+            uint32_t id;
+            std::string serial;
+            std::unique_ptr<hiddev::HidRawDev> dev;
+            pipeline::SignalOut noGyro;
+            sdgyrodsu::MotionConverter converter;
+            hiddev::HidFrame frame;
+            SimpleMotionData motion;
+            uint64_t disconnectedAt;    // when device was lost (0 - not lost)
+            uint64_t maxReconnectLatency;
+            pipeline::StageStats readStats;
+            pipeline::StageStats convertStats;
+
+            metrics::StageSummary readSummary;
+            metrics::StageSummary convertSummary;
+            metrics::Gauge connectedMetric;
+            metrics::Counter disconnectsMetric;
+            metrics::Counter reconnectsMetric;
+            metrics::Gauge reconnectLatencyMetric;
+            metrics::Gauge maxReconnectLatencyMetric;
+            metrics::Counter gyroReenablesMetric;
+        };
+
+        uint16_t vId;
+        uint16_t pId;
+        int interfaceNumber;
+        int frameLen;
+        int scanTimeUs;
+
+        int epoll;
+        int timer;
+        pipeline::EventFd stopEvent;
+        bool stop;      // set by Run only (Stop signals stopEvent)
+        bool active;    // streaming to clients
+
+        MotionSocket socket;
+        SendTick sendTick;
+        std::unique_ptr<hiddev::HotplugSource> hotplug;
+        std::vector<std::unique_ptr<Device>> devices;
+
+        std::chrono::steady_clock::time_point nextReopen;
+        std::chrono::steady_clock::time_point nextCleanup;
+        std::chrono::steady_clock::time_point nextRescan;
+
+        void Activate();
+        void Deactivate();
+
+        void OpenDevice(size_t index);
+        // lost: device was lost (counted as disconnect), not closed on purpose
+        void CloseDevice(size_t index, bool lost = false);
+        void OpenClosedDevices();
+        // Add controllers with serial numbers not served yet
+        void AddNewDevices();
+
+        void HandleDevice(size_t index, uint32_t events);
+        void HandleSocket();
+        void HandleTimer();
+        void HandleHotplug();
+
+        bool Watch(int fd, uint64_t token);
+        void Unwatch(int fd);
+
+        static constexpr int cSendRateHz = 60;  // Same as JsonServer
+        static const int cReopenDelayMs = 500;  // Period of reopen attempts while device is gone
+        static const int cCleanupPeriodMs = 2000;   // Period of stale clients removal
+        static const int cRescanPeriodMs = 2000;    // Period of looking for new controllers without hotplug events
+    };
+}
+
+#endif
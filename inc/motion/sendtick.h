@@ -0,0 +1,39 @@
+#ifndef _KMICKI_MOTION_SENDTICK_H_
+#define _KMICKI_MOTION_SENDTICK_H_
+
+#include "motion/simplemotion.h"
+#include "motion/motionsocket.h"
+#include <vector>
+#include <cstdint>
+
+namespace kmicki::motion
+{
+    // Decision what to send in a send tick, shared by JsonServer, Reactor and Simulation:
+    // the most recent motion data of every controller, unless it was already sent
+    // (same frame_id) or there is none yet (frame_id 0), stamped with time of the tick.
+    class SendTick
+    {
+        public:
+        SendTick() = delete;
+        // traceName: name of trace scope of sending (string literal)
+        SendTick(MotionSocket & _socket, char const* _traceName);
+
+        // Forget motion data sent so far (sending is started over).
+        void Reset();
+
+        // Offer the most recent motion data of controller at given index for the current tick.
+        void Offer(size_t const& index, SimpleMotionData const& data);
+
+        // Send motion data offered since the last call that wasn't sent yet.
+        // Returns number of motion data sent.
+        size_t Send();
+
+        private:
+        MotionSocket & socket;
+        char const* traceName;
+        std::vector<uint32_t> lastFrameIds;     // Sent last, per controller
+        std::vector<SimpleMotionData> fresh;    // To send in current tick
+    };
+}
+
+#endif
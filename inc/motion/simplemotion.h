@@ -2,13 +2,16 @@
 #define _KMICKI_MOTION_SIMPLEMOTION_H_
 
 #include <cstdint>
+#include <cstddef>
 #include <string>
 
 namespace kmicki::motion
 {
     struct SimpleMotionData
     {
-        uint64_t timestamp;      // Microseconds since epoch
+        uint64_t timestamp;      // Microseconds (CLOCK_MONOTONIC) when the packet was sent
+        uint64_t sensor_timestamp; // Microseconds (CLOCK_MONOTONIC) when the HID frame was read from the device
+        uint64_t sample_timestamp; // Microseconds (CLOCK_MONOTONIC) of the sample derived from device clock (drift-corrected)
         float accel_x;          // Acceleration X-axis (G units)
         float accel_y;          // Acceleration Y-axis (G units)  
         float accel_z;          // Acceleration Z-axis (G units)
@@ -16,14 +19,48 @@ namespace kmicki::motion
         float gyro_yaw;         // Gyroscope yaw (degrees/second)
         float gyro_roll;        // Gyroscope roll (degrees/second)
         uint32_t frame_id;      // Frame counter
+        uint32_t device_id;     // Stable ID of the controller (derived from its serial number)
         float accel_magnitude;  // Total acceleration magnitude
         float gyro_magnitude;   // Total gyroscope magnitude
+
+        // Controller inputs of the same HID frame (raw values)
+        uint32_t buttons1;      // Button bits (see SdHidFrame::Buttons1)
+        uint32_t buttons2;      // Button bits (see SdHidFrame::Buttons2)
+        int16_t left_stick_x;
+        int16_t left_stick_y;
+        int16_t right_stick_x;
+        int16_t right_stick_y;
+        int16_t left_trigger;   // L2 analog
+        int16_t right_trigger;  // R2 analog
+        int16_t left_pad_x;     // Left trackpad
+        int16_t left_pad_y;
+        int16_t right_pad_x;    // Right trackpad
+        int16_t right_pad_y;
+    };
+
+    // Groups of fields sent to a client (timestamps, frame ID and device ID are always sent).
+    enum MotionField : uint32_t
+    {
+        FieldAccel      = 0x01,
+        FieldGyro       = 0x02,
+        FieldMagnitude  = 0x04,
+        FieldInputs     = 0x08
     };
 
+    static const uint32_t cDefaultFields = FieldAccel | FieldGyro | FieldMagnitude;
+    static const uint32_t cAllFields = cDefaultFields | FieldInputs;
+
     // Helper function to calculate magnitudes
     void CalculateMagnitudes(SimpleMotionData& data);
     
-    // Convert to JSON string
+    // Upper bound of JSON length (all fields, every number at its longest)
+    static const size_t cMaxJsonLen = 1024;
+
+    // Write JSON of selected fields (MotionField flags) to buffer (at least cMaxJsonLen bytes) without allocating.
+    // Returns length of JSON (buffer is not null-terminated).
+    size_t ToJson(const SimpleMotionData& data, char * buffer, uint32_t const& fields = cDefaultFields);
+
+    // Convert to JSON string (default fields)
     std::string ToJson(const SimpleMotionData& data);
 }
 
@@ -0,0 +1,38 @@
+#ifndef _KMICKI_MOTION_SIMULATION_H_
+#define _KMICKI_MOTION_SIMULATION_H_
+
+#include "hiddev/capturefile.h"
+#include <ostream>
+#include <string>
+#include <cstdint>
+
+namespace kmicki::motion
+{
+    // Deterministic, faster than real time replay of a capture through the service's stages:
+    // HidDevReader replays the capture to MotionAdapter on a virtual clock following the recorded
+    // frame times, and motion data is sent on every 60Hz tick (SendTick) through MotionSocket
+    // to a single client with the default subscription. Datagrams are written to a stream
+    // (one per line) instead of a socket.
+    // The clock moves past a tick only after it was sent, and the next frame is replayed only
+    // after the previous one was converted (see VirtualClock), so the same capture always
+    // produces the same output, byte for byte.
+    class Simulation
+    {
+        public:
+        Simulation() = delete;
+        // Throws std::runtime_error if capture can't be opened or its frame length doesn't match.
+        Simulation(std::string const& _capturePath, int const& _frameLen);
+
+        // Run the whole capture. Returns number of packets written.
+        uint64_t Run(std::ostream & out);
+
+        private:
+        std::string capturePath;
+        int frameLen;
+        hiddev::CaptureFile capture;
+
+        static constexpr int cSendRateHz = 60;  // Same as JsonServer
+    };
+}
+
+#endif
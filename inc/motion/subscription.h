@@ -0,0 +1,57 @@
+#ifndef _KMICKI_MOTION_SUBSCRIPTION_H_
+#define _KMICKI_MOTION_SUBSCRIPTION_H_
+
+#include "motion/simplemotion.h"
+#include "motion/wireformat.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace kmicki::motion
+{
+    // Convention of motion axes sent to a client.
+    enum class Coordinates : uint8_t
+    {
+        Default = 0,    // As converted by MotionConverter
+        Device = 1      // Axes of the controller's IMU as reported by the device (no sign changes):
+                        // x right to left, y front to back, z top to bottom, gyro around the same axes
+    };
+
+    // What a client wants to receive, requested by its registration datagram:
+    //   whitespace-separated tokens <key>=<value>, unknown tokens are ignored
+    //   (so any other datagram, e.g. "register", is a subscription with default values):
+    //     format=json|binary|binary16             (default: json)
+    //     rate=<Hz>                               (default and maximum: send rate of the server)
+    //     fields=<field>[,<field>...]|all         accel, gyro, magnitude, inputs (default: accel,gyro,magnitude)
+    //     coords=default|device                   (default: default)
+    struct Subscription
+    {
+        WireFormat format;
+        uint32_t fields;            // MotionField flags
+        Coordinates coordinates;
+        int rateHz;
+
+        Subscription(int const& _rateHz);
+
+        static Subscription Parse(char const* datagram, size_t const& len, int const& maxRateHz);
+
+        // Same packets (given the same send tick)
+        bool SameEncoding(Subscription const& other) const;
+
+        bool operator==(Subscription const& other) const;
+        bool operator!=(Subscription const& other) const;
+
+        // e.g. "json 60Hz accel,gyro,magnitude default"
+        std::string Describe() const;
+    };
+
+    // Longest packet of any subscription
+    static const size_t cMaxPacketLen = std::max(cMaxJsonLen, cMaxBinaryPacketLen);
+
+    // Write packet of motion data as requested by subscription to buffer (at least cMaxPacketLen bytes).
+    // Returns length of the packet.
+    size_t Encode(SimpleMotionData const& data, Subscription const& subscription, uint32_t const& sequence, char * buffer);
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _KMICKI_MOTION_WIREFORMAT_H_
+#define _KMICKI_MOTION_WIREFORMAT_H_
+
+#include "motion/simplemotion.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace kmicki::motion
+{
+    // Format of motion data packets sent to a client (selected by its subscription).
+    enum class WireFormat : uint8_t
+    {
+        Json = 0,           // ToJson text (default)
+        Binary = 1,         // ToBinary, float32 samples
+        BinaryInt16 = 2     // ToBinary, int16 samples in device units
+    };
+
+    char const* GetWireFormatName(WireFormat const& format);
+
+    // Binary packet (version 1), little-endian, fixed layout without padding:
+    //   BinaryHeader
+    //   sections of fields present in flags, in this order:
+    //     accel       float32[3] x, y, z              | int16[3] in 1/cBinaryAccelPerG G
+    //     gyro        float32[3] pitch, yaw, roll     | int16[3] in 1/cBinaryGyroPerDps degrees/second
+    //     magnitude   float32[2] accel, gyro          | uint16[2] in the same units
+    //     inputs      BinaryInputs
+    //   Integer samples saturate at the limits of their type; NaN is sent as 0.
+    struct BinaryHeader
+    {
+        char magic[2];              // "SM"
+        uint8_t version;            // cBinaryWireVersion
+        uint8_t flags;              // cBinaryFlagInt16 | (MotionField flags << cBinaryFieldsShift)
+        uint32_t sequence;          // Send tick at the client's rate (consecutive for every client and device)
+        uint32_t deviceId;
+        uint32_t frameId;
+        uint64_t timestamp;         // Microseconds (CLOCK_MONOTONIC) when the packet was sent
+        uint64_t sensorTimestamp;   // Microseconds (CLOCK_MONOTONIC) when the HID frame was read
+        uint64_t sampleTimestamp;   // Microseconds (CLOCK_MONOTONIC) of the sample from device clock
+    };
+
+    struct BinaryInputs
+    {
+        uint32_t buttons1;
+        uint32_t buttons2;
+        int16_t leftStick[2];       // x, y
+        int16_t rightStick[2];
+        int16_t triggers[2];        // left, right
+        int16_t leftPad[2];
+        int16_t rightPad[2];
+    };
+
+    static_assert(std::endian::native == std::endian::little, "Binary wire format is written in host byte order.");
+    static_assert(sizeof(BinaryHeader) == 40 && sizeof(BinaryInputs) == 28,
+                  "Binary wire format layout must not contain padding.");
+
+    static const char cBinaryWireMagic[2] = { 'S','M' };
+    static const uint8_t cBinaryWireVersion = 1;
+    static const uint8_t cBinaryFlagInt16 = 0x01;    // Sections are in int16 device units
+    static const int cBinaryFieldsShift = 1;
+    static const int cBinaryAccelPerG = 0x4000;
+    static const int cBinaryGyroPerDps = 16;
+    static const size_t cMaxBinaryPacketLen = sizeof(BinaryHeader) + 8*sizeof(float) + sizeof(BinaryInputs);
+
+    // Write binary packet of selected fields (MotionField flags) to buffer (at least cMaxBinaryPacketLen bytes).
+    // Returns length of the packet.
+    size_t ToBinary(SimpleMotionData const& data, uint32_t const& sequence, bool const& int16, 
+                    uint32_t const& fields, char * buffer);
+}
+
+#endif
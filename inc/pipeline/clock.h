@@ -0,0 +1,118 @@
+#ifndef _KMICKI_PIPELINE_CLOCK_H_
+#define _KMICKI_PIPELINE_CLOCK_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "eventfd.h"
+
+namespace kmicki::pipeline
+{
+    // Source of time of the pipeline: timestamps of frames and motion data, stage timing,
+    // pacing of replay and of sending.
+    // Time points are of steady_clock (CLOCK_MONOTONIC).
+    // Timeouts that only detect stalls (bounded waits on pipes, client expiry, device reopening)
+    // stay on real time.
+    class Clock
+    {
+        public:
+        typedef std::chrono::steady_clock::time_point time_point;
+
+        virtual ~Clock();
+
+        virtual time_point Now() = 0;
+
+        // Wait until time comes. Returns false if stop was signaled first.
+        virtual bool WaitUntil(time_point const& time, EventFd & stop) = 0;
+
+        // Wait until time comes in a thread producing events at that time (frame source).
+        // Virtual clock is moved forward to the time instead.
+        // Returns false if stop was signaled first.
+        virtual bool AdvanceTo(time_point const& time, EventFd & stop) = 0;
+
+        // Time moves only when frame sources advance it (see VirtualClock):
+        // a frame source has to wait until its frame is consumed before advancing further.
+        virtual bool IsVirtual();
+
+        // Calling thread is driven by the clock from now on and waits for given time next.
+        // Virtual clock moves past every time such thread waits for (WaitUntil) only after
+        // the thread is done with it (waits again, calls Expect or Forget).
+        // Real clock doesn't wait for anybody.
+        virtual void Expect(time_point const& time);
+        // Calling thread is not driven by the clock anymore.
+        virtual void Forget();
+    };
+
+    // Real time.
+    class SystemClock : public Clock
+    {
+        public:
+        time_point Now() override;
+        bool WaitUntil(time_point const& time, EventFd & stop) override;
+        bool AdvanceTo(time_point const& time, EventFd & stop) override;
+    };
+
+    // Time that moves only when a frame source advances it.
+    // Threads waiting for a time are woken when the time reaches it, so the pipeline
+    // runs as fast as frames are produced, with timestamps of the source.
+    // Time steps through every time a thread driven by the clock (see Expect) waits for,
+    // and waits there until the thread is done. Together with frame sources waiting until
+    // their frames are consumed, every such thread sees the same frames on every run.
+    class VirtualClock : public Clock
+    {
+        public:
+        VirtualClock(time_point const& start = time_point());
+
+        time_point Now() override;
+        bool WaitUntil(time_point const& time, EventFd & stop) override;
+        bool AdvanceTo(time_point const& time, EventFd & stop) override;
+        bool IsVirtual() override;
+        void Expect(time_point const& time) override;
+        void Forget() override;
+
+        private:
+        // Thread driven by the clock
+        struct Waiter
+        {
+            bool waiting;           // for deadline
+            bool busy;              // woken at its deadline and not done yet
+            time_point deadline;
+            std::chrono::steady_clock::time_point wokenAt;   // Real time
+        };
+
+        std::atomic<int64_t> now;           // Nanoseconds since epoch of steady_clock
+        std::mutex waitersMutex;
+        std::condition_variable advanced;   // Time moved forward
+        std::condition_variable done;       // Thread driven by the clock is done with its time
+        std::map<std::thread::id,Waiter> waiters;
+
+        // Move time forward to given time (never backwards). Requires lock of waitersMutex.
+        void Set(time_point const& time);
+    };
+
+    // Clock of the pipeline (SystemClock unless replaced).
+    Clock & GetClock();
+
+    // Replace clock of the pipeline (nullptr - back to SystemClock).
+    // Has to be done while pipeline threads don't run. Clock has to outlive its use.
+    void SetClock(Clock * clock);
+
+    // Replaces clock of the pipeline while it exists (back to SystemClock when destroyed,
+    // also when leaving the scope by exception).
+    class ScopedClock
+    {
+        public:
+        ScopedClock(Clock & clock);
+        ~ScopedClock();
+
+        ScopedClock(ScopedClock const&) = delete;
+        ScopedClock& operator=(ScopedClock const&) = delete;
+    };
+}
+
+#endif
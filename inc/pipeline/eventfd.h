@@ -0,0 +1,38 @@
+#ifndef _KMICKI_PIPELINE_EVENTFD_H_
+#define _KMICKI_PIPELINE_EVENTFD_H_
+
+#include <chrono>
+
+namespace kmicki::pipeline
+{
+    // Linux eventfd wrapper.
+    // Allows waking a thread blocked in poll/epoll on other file descriptors.
+    class EventFd
+    {
+        public:
+        EventFd();
+        ~EventFd();
+
+        EventFd(EventFd const&) = delete;
+        EventFd& operator=(EventFd const&) = delete;
+
+        // File descriptor to be added to poll/epoll set (readable when signaled).
+        int GetFd() const;
+
+        // Signal the event.
+        void Signal();
+        // Reset the event. Returns true if it was signaled.
+        bool Clear();
+        // Wait until the event is signaled or timeout passes (without resetting it).
+        // Returns true if it was signaled.
+        bool Wait(std::chrono::milliseconds timeout);
+        // Wait until the event is signaled or time comes (without resetting it).
+        // Returns true if it was signaled.
+        bool WaitUntil(std::chrono::steady_clock::time_point const& time);
+
+        private:
+        int fd;
+    };
+}
+
+#endif
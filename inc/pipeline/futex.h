@@ -0,0 +1,26 @@
+#ifndef _KMICKI_PIPELINE_FUTEX_H_
+#define _KMICKI_PIPELINE_FUTEX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+
+namespace kmicki::pipeline
+{
+    // Thin wrappers around Linux futex syscall (process-private).
+    // Used to park a thread on a 32-bit atomic word without a mutex.
+
+    // Block while word == expected. Returns when woken, when value differs
+    // or on spurious wakeup. Caller has to recheck its condition.
+    void FutexWait(std::atomic<uint32_t> & word, uint32_t expected);
+
+    // Same as above, but gives up at deadline (CLOCK_MONOTONIC).
+    // Returns false if deadline has passed.
+    bool FutexWaitUntil(std::atomic<uint32_t> & word, uint32_t expected, std::chrono::steady_clock::time_point deadline);
+
+    // Wake up to count threads waiting on word.
+    void FutexWake(std::atomic<uint32_t> & word, int count = 1);
+    void FutexWakeAll(std::atomic<uint32_t> & word);
+}
+
+#endif
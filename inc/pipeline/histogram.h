@@ -0,0 +1,64 @@
+#ifndef _KMICKI_PIPELINE_HISTOGRAM_H_
+#define _KMICKI_PIPELINE_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace kmicki::pipeline
+{
+    // Log-linear histogram of 64-bit values (HDR histogram layout).
+    // Every power of two is split into cSubBuckets buckets,
+    // so any recorded value is known within 1/cSubBuckets (~6%).
+    // Written by a single thread without locks or read-modify-write instructions;
+    // any number of threads can read it at the same time.
+    class Histogram
+    {
+        public:
+        static const int cSubBucketBits = 4;
+        static const int cSubBuckets = 1 << cSubBucketBits;
+        static const int cBucketCount = (64 - cSubBucketBits + 1) * cSubBuckets;
+
+        // Copy of the histogram taken by a reader.
+        struct Snapshot
+        {
+            uint64_t count;
+            uint64_t sum;
+            uint64_t max;
+            std::vector<uint64_t> counts;   // per bucket
+
+            // Value below which given fraction (0-1) of recorded values lie
+            // (upper bound of the bucket it falls into).
+            uint64_t GetPercentile(double fraction) const;
+            double GetMean() const;
+        };
+
+        Histogram();
+
+        Histogram(Histogram const&) = delete;
+        Histogram& operator=(Histogram const&) = delete;
+
+        // Methods to be used by the writer:
+
+        void Record(uint64_t value);
+
+        // Methods to be used by readers:
+
+        // Copy current state. Values recorded during copying may be partially included.
+        Snapshot Read() const;
+
+        // Number of the bucket the value falls into.
+        static int GetBucket(uint64_t value);
+        // Lowest value that falls into the bucket.
+        static uint64_t GetBucketLowerBound(int bucket);
+        // Highest value that falls into the bucket.
+        static uint64_t GetBucketUpperBound(int bucket);
+
+        private:
+        std::atomic<uint64_t> counts[cBucketCount];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+}
+
+#endif
@@ -3,11 +3,16 @@
 
 #include <memory>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
 
 namespace kmicki::pipeline
 {
     // For sending pipelined object to the next thread in pipeline
-    // With triple buffering (T - object's type)
+    // With lock-free triple buffering (T - object's type).
+    // Single producer, single consumer. Buffers are handed over
+    // by a single atomic exchange. Consumer is parked on a futex
+    // only when there is nothing pending.
     template<class T>
     class PipeOut
     {
@@ -57,10 +62,15 @@ namespace kmicki::pipeline
         void Flush();
 
         private:
-        std::unique_ptr<T> bufMod,bufSent,bufRcv;
-        std::mutex bufSentMutex;
-        std::condition_variable bufSentConditionVariable;
-        bool bufWasSent;
+        // Lowest bit of the sent buffer's address marks it as not yet received.
+        static constexpr uintptr_t cFresh = 1;
+        static_assert(alignof(T) > cFresh, "PipeOut needs spare low bit in object's address.");
+
+        void WakeReceiver();
+
+        std::unique_ptr<T> bufMod,bufRcv;
+        std::atomic<uintptr_t> bufSent;
+        std::atomic<uint32_t> rcvParked;
     };
 }
 
@@ -1,4 +1,6 @@
 #include "pipeout.h"
+#include "futex.h"
+#include "trace/trace.h"
 
 namespace kmicki::pipeline
 {
@@ -12,14 +14,16 @@ namespace kmicki::pipeline
 
     template<class T>
     PipeOut<T>::PipeOut(T* inst1, T* inst2, T* inst3)
-    : bufMod(inst1),bufSent(inst2),bufRcv(inst3),
-      bufSentMutex(), bufSentConditionVariable(),
-      bufWasSent(false)
+    : bufMod(inst1),bufRcv(inst3),
+      bufSent(reinterpret_cast<uintptr_t>(inst2)),
+      rcvParked(0)
     { }
 
     template<class T>
     PipeOut<T>::~PipeOut()
-    { }
+    { 
+        delete reinterpret_cast<T*>(bufSent.load() & ~cFresh);
+    }
 
     template<class T>
     T & PipeOut<T>::GetDataToFill()
@@ -36,19 +40,16 @@ namespace kmicki::pipeline
     template<class T>
     void PipeOut<T>::SendData()
     {
-        {
-            std::lock_guard lock(bufSentMutex);
-            bufSent.swap(bufMod);
-            bufWasSent = true;
-        }
-        bufSentConditionVariable.notify_all();
+        trace::Instant("PipeOut::Send",trace::GetFrameId(*bufMod));
+        auto sent = bufSent.exchange(reinterpret_cast<uintptr_t>(bufMod.release()) | cFresh);
+        bufMod.reset(reinterpret_cast<T*>(sent & ~cFresh));
+        WakeReceiver();
     }
 
     template<class T>
     bool PipeOut<T>::WasReceived()
     {
-        std::lock_guard lock(bufSentMutex);
-        return !bufWasSent;
+        return (bufSent.load() & cFresh) == 0;
     }
 
     template<class T>
@@ -67,47 +68,63 @@ namespace kmicki::pipeline
     template<class T>
     void PipeOut<T>::WaitForData()
     {
-        std::unique_lock lock(bufSentMutex);
-        bufSentConditionVariable.wait(lock,[&] { return bufWasSent; });
-        bufSent.swap(bufRcv);
-        bufWasSent = false;
+        while(!TryData())
+        {
+            // Announce parking before the last check,
+            // so that sender either sees it or its data is seen here.
+            rcvParked.store(1);
+            if(WasReceived())
+            {
+                trace::Scope scope("PipeOut::Wait");
+                FutexWait(rcvParked,1);
+            }
+            rcvParked.store(0);
+        }
     }
 
     template<class T>
     template<class R,class P>
     bool PipeOut<T>::WaitForData(std::chrono::duration<R,P> timeout)
     {
-        std::unique_lock lock(bufSentMutex);
-        if(bufSentConditionVariable.wait_for(lock,timeout,[&](){ return bufWasSent; }))
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while(!TryData())
         {
-            bufSent.swap(bufRcv);
-            bufWasSent = false;
-            return true;
+            bool inTime = true;
+            rcvParked.store(1);
+            if(WasReceived())
+            {
+                trace::Scope scope("PipeOut::Wait");
+                inTime = FutexWaitUntil(rcvParked,1,deadline);
+            }
+            rcvParked.store(0);
+            if(!inTime)
+                return TryData();
         }
-        return false;
+        return true;
     }
 
     template<class T>
     bool PipeOut<T>::TryData()
     {
-        std::lock_guard lock(bufSentMutex);
-        if(bufWasSent)
-        {
-            bufSent.swap(bufRcv);
-            bufWasSent = false;
-            return true;
-        }
-        return false;
+        if(WasReceived())
+            return false;
+        auto sent = bufSent.exchange(reinterpret_cast<uintptr_t>(bufRcv.release()));
+        bufRcv.reset(reinterpret_cast<T*>(sent & ~cFresh));
+        return true;
     }
 
     template<class T>
     void PipeOut<T>::Flush()
     {
-        {
-            std::lock_guard lock(bufSentMutex);
-            bufWasSent = true;
-        }
-        bufSentConditionVariable.notify_all();
+        bufSent.fetch_or(cFresh);
+        WakeReceiver();
+    }
+
+    template<class T>
+    void PipeOut<T>::WakeReceiver()
+    {
+        if(rcvParked.load() != 0 && rcvParked.exchange(0) != 0)
+            FutexWake(rcvParked);
     }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,41 @@
+#ifndef _KMICKI_PIPELINE_SEQLOCK_H_
+#define _KMICKI_PIPELINE_SEQLOCK_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace kmicki::pipeline
+{
+    // Holds most recent value of type T written by a single thread.
+    // Any number of threads can read it without blocking the writer
+    // or each other. Reader retries only if it overlapped with a write.
+    // T has to be trivially copyable.
+    template<class T>
+    class SeqLock
+    {
+        public:
+        SeqLock();
+        SeqLock(T const& initial);
+
+        // Methods to be used by the writer:
+
+        // Replace the value.
+        void Store(T const& value);
+
+        // Methods to be used by readers:
+
+        // Get consistent copy of the value.
+        T Load() const;
+        // Number of stores so far.
+        uint32_t GetVersion() const;
+
+        private:
+        // Even - value is stable, odd - value is being written.
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+}
+
+#include "seqlock.hpp"
+
+#endif
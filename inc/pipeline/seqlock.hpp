@@ -0,0 +1,53 @@
+#include "seqlock.h"
+
+#include <cstring>
+#include <type_traits>
+
+namespace kmicki::pipeline
+{
+    // Definition of SeqLock
+
+    template<class T>
+    SeqLock<T>::SeqLock()
+    : SeqLock(T())
+    { }
+
+    template<class T>
+    SeqLock<T>::SeqLock(T const& initial)
+    : sequence(0), value(initial)
+    { 
+        static_assert(std::is_trivially_copyable_v<T>, "SeqLock copies value byte by byte.");
+    }
+
+    template<class T>
+    void SeqLock<T>::Store(T const& newValue)
+    {
+        auto seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&value,&newValue,sizeof(T));
+        sequence.store(seq+2,std::memory_order_release);
+    }
+
+    template<class T>
+    T SeqLock<T>::Load() const
+    {
+        T result;
+        while(true)
+        {
+            auto before = sequence.load(std::memory_order_acquire);
+            if((before & 1) != 0)
+                continue;
+            std::memcpy(&result,&value,sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(sequence.load(std::memory_order_relaxed) == before)
+                return result;
+        }
+    }
+
+    template<class T>
+    uint32_t SeqLock<T>::GetVersion() const
+    {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+}
@@ -1,76 +1,162 @@
 #ifndef _KMICKI_PIPELINE_SERVE_H_
 #define _KMICKI_PIPELINE_SERVE_H_
 
+#include <memory>
 #include <mutex>
-#include <condition_variable>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 
 namespace kmicki::pipeline
 {
-    // Serve object of type T to a single client
+    template<class T>
+    class Broadcast;
+
+    // Consumer's end of the Broadcast.
+    // Holds its own copy of the most recently consumed object
+    // and its own position (cursor) in the Broadcast's ring.
     template<class T>
     class Serve
     {
         public:
+        Serve() = delete;
+        Serve(Broadcast<T> & _source);
+        ~Serve();
 
-        class ConsumeLock
-        {
-            public:
-            ConsumeLock() = delete;
-            ConsumeLock(std::mutex & _mutex,std::condition_variable & _cv, bool & _served);
-            ConsumeLock(ConsumeLock&& other);
-            ~ConsumeLock();
-
-            private:
-            std::unique_lock<std::mutex> lock;
-            bool & served;
-            bool moved;
-        };
+        // Get pointer to consumer's copy of served data.
+        // Use together with methods below.
+        std::unique_ptr<T> const& GetPointer();
 
-        Serve();
-        Serve(std::unique_ptr<T> const& _object);
-        ~Serve();
-        void SetObject(std::unique_ptr<T> const& _object);
-        bool IsObjectSet();
+        // Methods consuming the most recent object (older ones are skipped):
+
+        // Wait for object newer than the last consumed one and copy it.
+        void WaitForData();
+        // Wait for newer object with timeout.
+        // Returns true when data was obtained.
+        template<class R, class P>
+        bool WaitForData(std::chrono::duration<R,P> timeout);
+        // Copy the most recent object if it was not consumed yet. If not return false.
+        bool TryData();
 
+        // Methods consuming every object in order:
+
+        // Wait for next object and copy it.
+        // Returns false if the wait was flushed without new object.
+        bool WaitForNext();
+        // Wait for next object with timeout.
+        // Returns true when data was obtained.
+        template<class R, class P>
+        bool WaitForNext(std::chrono::duration<R,P> timeout);
+        // Copy next object if there is one. If not return false.
+        // Call in a loop to drain all objects published since last read.
+        bool TryNext();
+        // Number of objects lost because consumer fell behind by whole ring.
+        uint64_t GetOverrunCount();
+
+        // Check if the most recent object was already consumed.
         bool WasConsumed();
-        // Use following if lock was acquired already by creating ServeLock
-        bool WasConsumedNoLock();
-        
-        // Get pointer to data being served.
-        // Use together with WaitForData()
-        std::unique_ptr<T> const& GetPointer();
 
-        ConsumeLock GetConsumeLock();
+        // Force current or next wait of this consumer to continue.
+        // Safe to call from any thread.
+        void Flush();
+
+        private:
+        friend class Broadcast<T>;
+
+        // Wait until tryData succeeds, serve is flushed or deadline passes.
+        template<class F>
+        bool WaitFor(F tryData, std::chrono::steady_clock::time_point const* deadline);
 
-        // Force the wait to continue.
+        // Note that consumer found nothing new to consume at its cursor (is done with older objects).
+        void MarkCaughtUp();
+
+        Broadcast<T> & source;
+        std::unique_ptr<T> object;
+        uint64_t cursor;
+        uint64_t overruns;
+        // Cursor at which consumer last found nothing new. Read by producer.
+        std::atomic<uint64_t> caughtUp;
+        // Set by Flush, cleared by the wait that it ends.
+        std::atomic<bool> flushed;
+    };
+
+    // Serve object of type T to any number of consumers.
+    // Producer writes each object once into a ring of seqlock-protected slots.
+    // Consumers copy them out without taking any lock and are parked
+    // on a futex only when they wait for the next object.
+    // Consumer that is not further behind than the ring's capacity sees every object.
+    // T has to be a contiguous container of trivially copyable elements
+    // that does not change its size (like frame of bytes).
+    // If T has a Timestamp member, it is served together with the elements.
+    template<class T>
+    class Broadcast
+    {
+        public:
+        Broadcast() = delete;
+        // Broadcast grabs ownership of the prototype instance.
+        // Its size determines size of every published object.
+        // capacity: number of objects kept in the ring.
+        Broadcast(T* prototype, int const& capacity = 1);
+        ~Broadcast();
+
+        // Methods to be used by producer:
+
+        // Copy object into the next slot and wake consumers waiting for it.
+        void Publish(T const& obj);
+        // Force all consumers' waits to continue without new object.
         void Flush();
+        // Check if every consumer came back for an object after the last one published
+        // (so it is done with all objects published so far).
+        bool WasConsumed();
+        // Wait until WasConsumed or deadline passes. Returns false on timeout.
+        bool WaitUntilConsumed(std::chrono::steady_clock::time_point const& deadline);
+
+        // Methods to be used by consumers (safe while objects are being published):
 
-        class ServeLock
+        // Get new serve. It starts at the next published object.
+        Serve<T> & GetServe();
+        // Stop serving. Serve gets destroyed.
+        void StopServe(Serve<T> & serve);
+
+        private:
+        friend class Serve<T>;
+
+        struct Slot
         {
-            public:
-            ServeLock() = delete;
-            ServeLock(std::mutex & _mutex,std::condition_variable & _cv, bool & _served);
-            ServeLock(ServeLock&& other);
-            ~ServeLock();
-
-            private:
-            std::condition_variable & cv;
-            std::unique_lock<std::mutex> lock;
-            bool & served;
-            bool moved;
+            // 2*(position+1) when slot holds object at position, odd when being written.
+            std::atomic<uint64_t> sequence;
+            std::unique_ptr<T> object;
         };
 
-        ServeLock GetServeLock();
+        // Copy elements (and timestamp) of the object.
+        static void Copy(T & dst, T const& src);
 
-        private:
+        // Copy object at position to obj.
+        // Returns false if slot does not hold that position (anymore).
+        bool Read(T & obj, uint64_t const& position);
+        // Park until head differs from serve's cursor, serve is flushed
+        // or deadline passes. Returns false on timeout.
+        bool Wait(Serve<T> const& serve, std::chrono::steady_clock::time_point const* deadline);
+        // Wake all parked consumers.
+        void WakeAll();
+
+        int capacity;
+        std::unique_ptr<Slot[]> slots;
+        // Number of objects published so far.
+        std::atomic<uint64_t> head;
+        // Incremented on every publish or flush. Futex word for parked consumers.
+        std::atomic<uint32_t> signal;
+        std::atomic<uint32_t> parked;
+        // Incremented when a consumer catches up while producer waits for it. Futex word for producer.
+        std::atomic<uint32_t> consumed;
+        std::atomic<uint32_t> producerParked;
 
-        std::unique_ptr<T> const* object;
-        std::mutex serveMutex;
-        std::condition_variable serveConditionVariable;
-        bool served;
+        std::mutex servesMutex;
+        std::vector<std::unique_ptr<Serve<T>>> serves;
     };
 }
 
 #include "serve.hpp"
 
-#endif
\ No newline at end of file
+#endif
@@ -1,120 +1,301 @@
 #include "serve.h"
+#include "futex.h"
+#include "trace/trace.h"
+
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
 
 namespace kmicki::pipeline
 {
-    // Definition of ConsumeLock
+    // Definition of Serve
 
     template<class T>
-    Serve<T>::ConsumeLock::ConsumeLock(std::mutex & _mutex,std::condition_variable & _cv, bool & _served)
-    : lock(_mutex), moved(false), served(_served)
-    { 
-        _cv.wait(lock, [&] { return _served; });
-        _served = false;
+    Serve<T>::Serve(Broadcast<T> & _source)
+    : source(_source), object(new T(_source.slots[0].object->size())),
+      cursor(_source.head.load()), overruns(0), caughtUp(cursor), flushed(false)
+    { }
+
+    template<class T>
+    Serve<T>::~Serve()
+    { }
+
+    template<class T>
+    std::unique_ptr<T> const& Serve<T>::GetPointer()
+    {
+        return object;
     }
 
     template<class T>
-    Serve<T>::ConsumeLock::ConsumeLock(ConsumeLock&& other)
-    : lock(std::move(other.lock)), served(other.served)
-    { 
-        other.moved = true;
+    void Serve<T>::WaitForData()
+    {
+        WaitFor([this] { return TryData(); },nullptr);
     }
 
     template<class T>
-    Serve<T>::ConsumeLock::~ConsumeLock()
+    template<class R, class P>
+    bool Serve<T>::WaitForData(std::chrono::duration<R,P> timeout)
     {
-        if(moved)
-            return;
-        
-        served = false;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        return WaitFor([this] { return TryData(); },&deadline);
     }
 
-    // Definition of ServeLock
+    template<class T>
+    bool Serve<T>::TryData()
+    {
+        while(true)
+        {
+            auto head = source.head.load();
+            if(head == cursor)
+            {
+                MarkCaughtUp();
+                return false;
+            }
+            if(source.Read(*object,head-1))
+            {
+                cursor = head;
+                return true;
+            }
+            // Producer went around the whole ring during copying. Try again.
+        }
+    }
 
     template<class T>
-    Serve<T>::ServeLock::ServeLock(std::mutex & _mutex,std::condition_variable & _cv, bool & _served)
-    : lock(_mutex),cv(_cv),moved(false), served(_served)
-    { }
+    bool Serve<T>::WaitForNext()
+    {
+        return WaitFor([this] { return TryNext(); },nullptr);
+    }
 
     template<class T>
-    Serve<T>::ServeLock::ServeLock(ServeLock&& other)
-    : served(other.served),cv(other.cv),lock(std::move(other.lock)),moved(false)
+    template<class R, class P>
+    bool Serve<T>::WaitForNext(std::chrono::duration<R,P> timeout)
     {
-        other.moved = true;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        return WaitFor([this] { return TryNext(); },&deadline);
     }
 
     template<class T>
-    Serve<T>::ServeLock::~ServeLock()
+    bool Serve<T>::TryNext()
     {
-        if(moved)
+        uint64_t const capacity = source.capacity;
+        auto head = source.head.load();
+        while(cursor < head)
+        {
+            if(head - cursor > capacity)
+            {
+                trace::Instant("Serve::Overrun");
+                overruns += head - cursor - capacity;
+                cursor = head - capacity;
+            }
+            if(source.Read(*object,cursor))
+            {
+                ++cursor;
+                return true;
+            }
+            // Slot got overwritten during copying.
+            head = source.head.load();
+        }
+        MarkCaughtUp();
+        return false;
+    }
+
+    template<class T>
+    void Serve<T>::MarkCaughtUp()
+    {
+        if(caughtUp.load(std::memory_order_relaxed) == cursor)
             return;
+        caughtUp.store(cursor);
+        if(source.producerParked.load() != 0)
+        {
+            source.consumed.fetch_add(1);
+            FutexWakeAll(source.consumed);
+        }
+    }
 
-        served = true;
-        lock.unlock();
-        cv.notify_all();
+    template<class T>
+    uint64_t Serve<T>::GetOverrunCount()
+    {
+        return overruns;
     }
 
-    // Definition of Serve
+    template<class T>
+    bool Serve<T>::WasConsumed()
+    {
+        return source.head.load() == cursor;
+    }
 
     template<class T>
-    Serve<T>::Serve()
-    : Serve(nullptr)
-    { }
+    void Serve<T>::Flush()
+    {
+        flushed.store(true);
+        source.WakeAll();
+    }
 
     template<class T>
-    Serve<T>::Serve(std::unique_ptr<T> const& _object)
-    : object(&_object),serveMutex(),serveConditionVariable(),served(false)
-    { }
+    template<class F>
+    bool Serve<T>::WaitFor(F tryData, std::chrono::steady_clock::time_point const* deadline)
+    {
+        while(!tryData())
+        {
+            if(flushed.exchange(false))
+                return false;
+            if(!source.Wait(*this,deadline))
+                return tryData();
+        }
+        return true;
+    }
+
+    // Definition of Broadcast
 
     template<class T>
-    Serve<T>::~Serve()
+    Broadcast<T>::Broadcast(T* prototype, int const& _capacity)
+    : capacity(std::max(_capacity,1)), slots(new Slot[std::max(_capacity,1)]),
+      head(0), signal(0), parked(0), consumed(0), producerParked(0),
+      servesMutex(), serves()
+    { 
+        static_assert(std::is_trivially_copyable_v<typename T::value_type>, 
+                      "Broadcast copies objects byte by byte.");
+
+        slots[0].object.reset(prototype);
+        slots[0].sequence = 0;
+        for(int i = 1; i < capacity; ++i)
+        {
+            slots[i].object.reset(new T(*prototype));
+            slots[i].sequence = 0;
+        }
+    }
+
+    template<class T>
+    Broadcast<T>::~Broadcast()
     { }
 
     template<class T>
-    void Serve<T>::SetObject(std::unique_ptr<T> const& _object)
+    void Broadcast<T>::Publish(T const& obj)
     {
-        object = &_object;
+        trace::Instant("Broadcast::Publish",trace::GetFrameId(obj));
+        auto position = head.load(std::memory_order_relaxed);
+        auto & slot = slots[position % capacity];
+
+        slot.sequence.store(2*position+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Copy(*slot.object,obj);
+        slot.sequence.store(2*position+2,std::memory_order_release);
+
+        head.store(position+1);
+        signal.fetch_add(1);
+        if(parked.load() != 0)
+            FutexWakeAll(signal);
     }
 
     template<class T>
-    bool Serve<T>::IsObjectSet()
+    void Broadcast<T>::Flush()
     {
-        return object != nullptr;
+        {
+            std::lock_guard lock(servesMutex);
+            for(auto & serve : serves)
+                serve->flushed.store(true);
+        }
+        WakeAll();
     }
 
     template<class T>
-    std::unique_ptr<T> const& Serve<T>::GetPointer()
+    bool Broadcast<T>::WasConsumed()
     {
-        return *object;
+        auto position = head.load();
+        std::lock_guard lock(servesMutex);
+        for(auto & serve : serves)
+            if(serve->caughtUp.load() != position)
+                return false;
+        return true;
     }
 
     template<class T>
-    Serve<T>::ConsumeLock Serve<T>::GetConsumeLock()
+    bool Broadcast<T>::WaitUntilConsumed(std::chrono::steady_clock::time_point const& deadline)
     {
-        return std::move(ConsumeLock(serveMutex,serveConditionVariable,served));
+        while(!WasConsumed())
+        {
+            // Announce parking before the last check,
+            // so that consumer either sees it or its progress is seen here.
+            producerParked.store(1);
+            auto sig = consumed.load();
+            bool inTime = true;
+            if(!WasConsumed())
+            {
+                trace::Scope scope("Broadcast::WaitConsumed");
+                inTime = FutexWaitUntil(consumed,sig,deadline);
+            }
+            producerParked.store(0);
+            if(!inTime)
+                return WasConsumed();
+        }
+        return true;
     }
 
     template<class T>
-    void Serve<T>::Flush()
+    void Broadcast<T>::WakeAll()
     {
-        ServeLock lock;
+        signal.fetch_add(1);
+        FutexWakeAll(signal);
     }
 
     template<class T>
-    Serve<T>::ServeLock Serve<T>::GetServeLock()
+    void Broadcast<T>::Copy(T & dst, T const& src)
     {
-        return std::move(ServeLock(serveMutex,serveConditionVariable,served));
+        std::memcpy(dst.data(),src.data(),std::min(dst.size(),src.size())*sizeof(typename T::value_type));
+        if constexpr (requires { dst.Timestamp = src.Timestamp; })
+            dst.Timestamp = src.Timestamp;
     }
 
     template<class T>
-    bool Serve<T>::WasConsumed()
+    bool Broadcast<T>::Read(T & obj, uint64_t const& position)
+    {
+        auto & slot = slots[position % capacity];
+        auto expected = 2*position+2;
+
+        if(slot.sequence.load(std::memory_order_acquire) != expected)
+            return false;
+        Copy(obj,*slot.object);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == expected;
+    }
+
+    template<class T>
+    bool Broadcast<T>::Wait(Serve<T> const& serve, std::chrono::steady_clock::time_point const* deadline)
+    {
+        bool inTime = true;
+        // Announce parking before the last check,
+        // so that producer either sees it or its object is seen here.
+        parked.fetch_add(1);
+        auto sig = signal.load();
+        if(head.load() == serve.cursor && !serve.flushed.load())
+        {
+            trace::Scope scope("Serve::Wait");
+            if(deadline == nullptr)
+                FutexWait(signal,sig);
+            else
+                inTime = FutexWaitUntil(signal,sig,*deadline);
+        }
+        parked.fetch_sub(1);
+        return inTime;
+    }
+
+    template<class T>
+    Serve<T> & Broadcast<T>::GetServe()
     {
-        std::lock_guard lock(serveMutex);
-        return WasConsumedNoLock();
+        std::lock_guard lock(servesMutex);
+        auto& ptr = serves.emplace_back(new Serve<T>(*this));
+        return *ptr;
     }
 
     template<class T>
-    bool Serve<T>::WasConsumedNoLock()
+    void Broadcast<T>::StopServe(Serve<T> & serve)
     {
-        return !served;
+        std::lock_guard lock(servesMutex);
+        for(auto x = serves.begin();x != serves.end();++x)
+            if(x->get() == &serve)
+            {
+                serves.erase(x);
+                return;
+            }
     }
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <condition_variable>
+#include "eventfd.h"
 
 namespace kmicki::pipeline
 {
@@ -30,10 +31,15 @@ namespace kmicki::pipeline
         // Force the wait to continue.
         void Flush();
 
+        // Also signal eventFd on each SendSignal,
+        // for receivers waiting in poll/epoll instead of WaitForSignal.
+        void SetEventFd(EventFd * eventFd);
+
         private:
         std::mutex signalMutex;
         std::condition_variable signalConditionVariable;
         bool signal;
+        EventFd * signalEventFd;
     };
 
 }
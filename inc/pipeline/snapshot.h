@@ -0,0 +1,71 @@
+#ifndef _KMICKI_PIPELINE_SNAPSHOT_H_
+#define _KMICKI_PIPELINE_SNAPSHOT_H_
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace kmicki::pipeline
+{
+    // Immutable value of type T published by a single writer (read-copy-update).
+    // Readers get a reference to the current value and keep using it
+    // while the writer publishes new ones. Every reader marks the value it uses
+    // in its own hazard slot; the writer frees replaced values no slot marks,
+    // so readers never free memory and never take a lock.
+    // Load is lock-free: it retries only if a value was published while it ran.
+    template<class T>
+    class Snapshot
+    {
+        public:
+        Snapshot();
+        Snapshot(Snapshot const&) = delete;
+        Snapshot& operator=(Snapshot const&) = delete;
+
+        // Methods to be used by the writer:
+
+        // Replace the value.
+        void Publish(std::unique_ptr<T const> value);
+
+        // Free replaced values no reader uses anymore.
+        void Reclaim();
+
+        // Current value (the writer doesn't need a reader).
+        T const& Get() const;
+
+        // Reader thread's access to values. Has to be destroyed before the snapshot.
+        class Reader
+        {
+            public:
+            // Throws std::runtime_error if there are cMaxReaders readers already.
+            Reader(Snapshot & _snapshot);
+            ~Reader();
+            Reader(Reader const&) = delete;
+            Reader& operator=(Reader const&) = delete;
+
+            // Current value. Stays valid until the next Load by this reader or its destruction.
+            T const& Load();
+
+            private:
+            Snapshot & snapshot;
+            size_t slot;
+        };
+
+        static const size_t cMaxReaders = 8;
+
+        private:
+        // Readers need atomic pointers without a lock (std::atomic<std::shared_ptr> isn't lock-free in libstdc++)
+        static_assert(std::atomic<T const*>::is_always_lock_free, "Snapshot needs lock-free atomic pointers.");
+
+        std::atomic<T const*> current;
+        std::array<std::atomic<T const*>, cMaxReaders> hazards;     // Value used by reader of the slot
+        std::array<std::atomic<bool>, cMaxReaders> slotsTaken;
+
+        // Used only by the writer:
+        std::vector<std::unique_ptr<T const>> values;   // Current and replaced ones not freed yet
+    };
+}
+
+#include "snapshot.hpp"
+
+#endif
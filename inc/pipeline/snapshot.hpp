@@ -0,0 +1,91 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace kmicki::pipeline
+{
+    // Definition of Snapshot
+
+    template<class T>
+    Snapshot<T>::Snapshot()
+    : current(nullptr), hazards(), slotsTaken(), values()
+    {
+        for(size_t i = 0; i < cMaxReaders; ++i)
+        {
+            hazards[i].store(nullptr);
+            slotsTaken[i].store(false);
+        }
+        values.emplace_back(new T());
+        current.store(values.back().get());
+    }
+
+    template<class T>
+    void Snapshot<T>::Publish(std::unique_ptr<T const> value)
+    {
+        values.push_back(std::move(value));
+        // seq_cst: readers checking current after marking their hazard see either
+        // this value or a hazard Reclaim sees (so a value in use is never freed)
+        current.store(values.back().get(), std::memory_order_seq_cst);
+        Reclaim();
+    }
+
+    template<class T>
+    void Snapshot<T>::Reclaim()
+    {
+        auto latest = current.load(std::memory_order_relaxed);
+        values.erase(std::remove_if(values.begin(), values.end(), [&](std::unique_ptr<T const> const& value)
+            {
+                if(value.get() == latest)
+                    return false;
+                for(auto const& hazard : hazards)
+                    if(hazard.load(std::memory_order_seq_cst) == value.get())
+                        return false;
+                return true;
+            }), values.end());
+    }
+
+    template<class T>
+    T const& Snapshot<T>::Get() const
+    {
+        return *current.load(std::memory_order_relaxed);
+    }
+
+    // Definition of Snapshot::Reader
+
+    template<class T>
+    Snapshot<T>::Reader::Reader(Snapshot & _snapshot)
+    : snapshot(_snapshot), slot(0)
+    {
+        for(; slot < cMaxReaders; ++slot)
+        {
+            bool taken = false;
+            if(snapshot.slotsTaken[slot].compare_exchange_strong(taken, true))
+                return;
+        }
+        throw std::runtime_error("Snapshot: Too many readers.");
+    }
+
+    template<class T>
+    Snapshot<T>::Reader::~Reader()
+    {
+        snapshot.hazards[slot].store(nullptr, std::memory_order_release);
+        snapshot.slotsTaken[slot].store(false, std::memory_order_release);
+    }
+
+    template<class T>
+    T const& Snapshot<T>::Reader::Load()
+    {
+        auto & hazard = snapshot.hazards[slot];
+        auto value = snapshot.current.load(std::memory_order_acquire);
+        while(true)
+        {
+            hazard.store(value, std::memory_order_seq_cst);
+            // Still current after marking: the writer can't have missed the mark
+            auto latest = snapshot.current.load(std::memory_order_seq_cst);
+            if(latest == value)
+                return *value;
+            value = latest;
+        }
+    }
+}
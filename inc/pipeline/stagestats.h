@@ -0,0 +1,38 @@
+#ifndef _KMICKI_PIPELINE_STAGESTATS_H_
+#define _KMICKI_PIPELINE_STAGESTATS_H_
+
+#include "histogram.h"
+#include <string>
+
+namespace kmicki::pipeline
+{
+    // Timing of frames passing a boundary of a pipeline stage.
+    // Latency: time since the frame was read from the device (its age at the boundary).
+    // Interval: time since the previous frame passed the boundary.
+    // Both in nanoseconds. Recorded by the single thread running the stage,
+    // readable from any thread at any time.
+    class StageStats
+    {
+        public:
+        StageStats();
+
+        StageStats(StageStats const&) = delete;
+        StageStats& operator=(StageStats const&) = delete;
+
+        // Record frame read at readTimestampUs (CLOCK_MONOTONIC in microseconds, see HidFrame::Timestamp).
+        void Record(uint64_t readTimestampUs);
+
+        Histogram const& GetLatency() const;
+        Histogram const& GetInterval() const;
+
+        // One line summary: count, p50/p99/p99.9/max of latency and interval in microseconds.
+        std::string Describe() const;
+
+        private:
+        Histogram latency;
+        Histogram interval;
+        uint64_t lastNs;
+    };
+}
+
+#endif
@@ -1,39 +1,40 @@
 #ifndef _KMICKI_PIPELINE_THREAD_H_
 #define _KMICKI_PIPELINE_THREAD_H_
 
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 
+#include "threadconfig.h"
+#include "eventfd.h"
+#include "clock.h"
+
 namespace kmicki::pipeline
 {
-    // Represents single thread in the pipeline
+    // Represents single thread in the pipeline.
+    // Stopping is cooperative: Execute() has to check ShouldContinue()
+    // and every blocking wait inside it has to be interruptible,
+    // either by FlushPipes() or by waiting on GetStopFd() as well.
     class Thread
     {
         public:
         Thread();
-        ~Thread();
+        virtual ~Thread();
         // Start the thread.
         void Start();
         // Stop the thread.
         void Stop();
-        // Kill the thread.
-        void Kill();
         // Restart the thread.
         void Restart();
-        // Kill and restart.
-        void ForceRestart();
-        // Kill if stopping fails.
-        template<class R, class P>
-        void TryStopThenKill(std::chrono::duration<R,P> timeout);
-        void TryStopThenKill();
-        // Force restart if normal restart fails.
-        template<class R, class P>
-        void TryRestartThenForceRestart(std::chrono::duration<R,P> timeout);
-        void TryRestartThenForceRestart();
         // Check if the thread is running.
         bool IsStarted();
         // Check if the thread is trying to stop
         bool IsStopping();
+        // Check if Execute has returned since the last start (ended on its own or stopped).
+        bool IsFinished();
+        // Set scheduling of the thread. Applied on next start.
+        void SetConfig(ThreadConfig const& _config);
 
         protected:
         // Method that executes on the thread.
@@ -43,17 +44,27 @@ namespace kmicki::pipeline
         bool ShouldContinue();
         // Force thread to continue through all waits on other pipeline threads
         virtual void FlushPipes() = 0;
+        // Descriptor that becomes readable when the thread is requested to stop.
+        // Add it to poll/epoll sets of blocking waits.
+        int GetStopFd() const;
+        // Sleep until given time (of the pipeline's clock) unless the thread is requested to stop.
+        // Returns false if the thread should stop.
+        bool SleepUntil(std::chrono::steady_clock::time_point const& time);
+        bool SleepFor(std::chrono::microseconds const& duration);
+        // Same as SleepUntil, for threads producing frames at given times:
+        // moves virtual clock forward instead of waiting.
+        bool AdvanceTo(std::chrono::steady_clock::time_point const& time);
 
         private:
-        std::unique_ptr<std::thread> executeThread;
-        std::thread::native_handle_type threadHandle;
-        std::mutex stopMutex;
-        bool stop;
+        // Apply configuration and execute.
+        void Run();
 
-        static const std::chrono::milliseconds cTimeout;
+        ThreadConfig config;
+        std::unique_ptr<std::thread> executeThread;
+        std::atomic<bool> stop;
+        std::atomic<bool> finished;
+        EventFd stopEvent;
     };
 }
 
-#include "thread.hpp"
-
-#endif
\ No newline at end of file
+#endif
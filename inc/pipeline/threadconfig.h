@@ -0,0 +1,42 @@
+#ifndef _KMICKI_PIPELINE_THREADCONFIG_H_
+#define _KMICKI_PIPELINE_THREADCONFIG_H_
+
+#include <string>
+#include <vector>
+#include <sched.h>
+
+namespace kmicki::pipeline
+{
+    // Scheduling of a single pipeline thread.
+    struct ThreadConfig
+    {
+        std::string name;               // Thread name (up to 15 characters are used)
+        int policy = SCHED_OTHER;       // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int priority = 0;               // Real-time priority (1-99) for SCHED_FIFO/SCHED_RR
+        std::vector<int> cpus;          // CPUs the thread may run on (empty - any)
+        unsigned long timerSlackNs = 0; // Timer slack (0 - leave default)
+
+        // Configuration of the stage from environment variables:
+        //   SDMOTION_<STAGE>_SCHED         - other, fifo or rr
+        //   SDMOTION_<STAGE>_PRIORITY      - real-time priority
+        //   SDMOTION_<STAGE>_CPUS          - CPU list, e.g. 2,3 or 2-3
+        //   SDMOTION_<STAGE>_TIMERSLACK_NS - timer slack in nanoseconds
+        // stage: upper-case name of the stage, e.g. READ
+        static ThreadConfig FromEnv(std::string const& stage);
+    };
+
+    // Apply configuration to the calling thread.
+    // Settings that can't be applied (e.g. real-time scheduling without privileges)
+    // are logged and skipped. Prefaults the stack if memory is locked.
+    void ApplyThreadConfig(ThreadConfig const& config);
+
+    // Lock all current and future memory of the process (mlockall) and prefault the stack
+    // so that page faults don't delay time-critical threads.
+    // Returns false (and logs why) if memory could not be locked.
+    bool LockMemory();
+
+    // Lock memory if SDMOTION_MLOCK environment variable is set to 1.
+    bool LockMemoryFromEnv();
+}
+
+#endif
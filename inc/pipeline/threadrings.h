@@ -0,0 +1,63 @@
+#ifndef _KMICKI_PIPELINE_THREADRINGS_H_
+#define _KMICKI_PIPELINE_THREADRINGS_H_
+
+#include <sys/types.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kmicki::pipeline
+{
+    // Time of records in thread rings: CLOCK_MONOTONIC in nanoseconds.
+    uint64_t GetRingTimestamp();
+
+    // Thread owning a ring. Base of ring types held by ThreadRings.
+    struct ThreadRingBase
+    {
+        // Captures ID and name of the calling thread.
+        ThreadRingBase();
+
+        std::atomic<bool> orphaned;     // Thread has exited
+        pid_t tid;
+        char name[16];
+    };
+
+    // Rings of type Ring (derived from ThreadRingBase), one per thread that uses them.
+    // Ring is written by its thread only, so threads don't contend with each other,
+    // and is read by other threads through the list of all rings.
+    // Ring of a thread is created on its first use and marked orphaned when the thread exits.
+    // Ring of a thread is bound to the Ring type: only one ThreadRings per Ring type.
+    template<class Ring>
+    class ThreadRings
+    {
+        public:
+        // maxOrphaned: keep at most that many rings of exited threads
+        //              (the oldest are forgotten when a ring is added)
+        ThreadRings(size_t const& _maxOrphaned = SIZE_MAX);
+
+        // Ring of the calling thread.
+        Ring & Get();
+
+        // Copy of the list of all rings.
+        void GetAll(std::vector<std::shared_ptr<Ring>> & all);
+
+        // Forget rings of exited threads that predicate (taking Ring const&) returns true for.
+        template<class Predicate>
+        void ForgetOrphaned(Predicate done);
+
+        private:
+        struct Holder;
+
+        size_t maxOrphaned;
+        std::mutex ringsMutex;
+        std::vector<std::shared_ptr<Ring>> rings;
+
+        std::shared_ptr<Ring> Add();
+    };
+}
+
+#include "threadrings.hpp"
+
+#endif
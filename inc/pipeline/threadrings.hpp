@@ -0,0 +1,76 @@
+#include "threadrings.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace kmicki::pipeline
+{
+    // Definition of ThreadRings
+
+    // Ring of the calling thread, marked orphaned when thread exits.
+    template<class Ring>
+    struct ThreadRings<Ring>::Holder
+    {
+        std::shared_ptr<Ring> ring;
+
+        ~Holder()
+        {
+            if(ring)
+                ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+
+    template<class Ring>
+    ThreadRings<Ring>::ThreadRings(size_t const& _maxOrphaned)
+    : maxOrphaned(_maxOrphaned), ringsMutex(), rings()
+    {
+        static_assert(std::is_base_of_v<ThreadRingBase,Ring>, "Ring has to be derived from ThreadRingBase.");
+    }
+
+    template<class Ring>
+    Ring & ThreadRings<Ring>::Get()
+    {
+        static thread_local Holder holder;
+        if(!holder.ring)
+            holder.ring = Add();
+        return *holder.ring;
+    }
+
+    template<class Ring>
+    std::shared_ptr<Ring> ThreadRings<Ring>::Add()
+    {
+        auto ring = std::make_shared<Ring>();
+
+        std::lock_guard lock(ringsMutex);
+        // Forget the oldest rings of exited threads
+        size_t orphaned = std::count_if(rings.begin(), rings.end(), [](std::shared_ptr<Ring> const& x) { return x->orphaned.load(); });
+        for(auto x = rings.begin(); x != rings.end() && orphaned >= maxOrphaned;)
+            if((*x)->orphaned)
+            {
+                x = rings.erase(x);
+                --orphaned;
+            }
+            else
+                ++x;
+        rings.push_back(ring);
+        return ring;
+    }
+
+    template<class Ring>
+    void ThreadRings<Ring>::GetAll(std::vector<std::shared_ptr<Ring>> & all)
+    {
+        std::lock_guard lock(ringsMutex);
+        all = rings;
+    }
+
+    template<class Ring>
+    template<class Predicate>
+    void ThreadRings<Ring>::ForgetOrphaned(Predicate done)
+    {
+        std::lock_guard lock(ringsMutex);
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [&](std::shared_ptr<Ring> const& ring)
+            {
+                return ring->orphaned.load(std::memory_order_acquire) && done(*ring);
+            }), rings.end());
+    }
+}
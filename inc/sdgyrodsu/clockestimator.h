@@ -0,0 +1,71 @@
+#ifndef _KMICKI_SDGYRODSU_CLOCKESTIMATOR_H_
+#define _KMICKI_SDGYRODSU_CLOCKESTIMATOR_H_
+
+#include <cstdint>
+
+namespace kmicki::sdgyrodsu
+{
+    // Maps device tick counter (frame Increment) to host monotonic time.
+    // Fits host = offset + period * ticks online with exponentially weighted
+    // linear regression. Samples delayed by host scheduling (outliers) are
+    // rejected based on running mean absolute deviation of residuals.
+    // Offset and period (drift) are tracked continuously.
+    class ClockEstimator
+    {
+        public:
+        ClockEstimator();
+
+        // Forget everything learned so far.
+        void Reset();
+
+        // Feed device tick and host time (µs) it was observed at.
+        // Returns drift-corrected host time (µs) of the sample.
+        uint64_t Update(uint32_t const& ticks, uint64_t const& hostUs);
+
+        // Estimated real sample period in microseconds.
+        double GetPeriodUs() const;
+
+        // Drift of device clock against host clock in ppm (relative to nominal period).
+        double GetDriftPpm() const;
+
+        // RMS of residuals of accepted samples in microseconds.
+        double GetJitterUs() const;
+
+        // Number of samples rejected as outliers.
+        uint64_t GetOutlierCount() const;
+
+        // Number of times fit was restarted because device clock jumped.
+        uint64_t GetResyncCount() const;
+
+        // Whether enough samples were collected for the fit to be used.
+        bool IsLocked() const;
+
+        static const double cNominalPeriodUs;
+
+        private:
+        // Restart fit at given sample.
+        void Restart(uint64_t const& hostUs);
+
+        // Predict host time for unwrapped tick.
+        double Predict(double const& x) const;
+
+        bool started;
+        uint32_t lastTicks;
+        int64_t unwrapped;      // Ticks since fit origin
+        uint64_t originHostUs;  // Host time at fit origin
+
+        uint64_t samples;       // Accepted samples since restart
+        int rejectedInRow;
+
+        // Exponentially weighted moments (x: ticks, y: host µs, both from origin)
+        double meanX, meanY, covXX, covXY;
+
+        double absDev;          // Mean absolute deviation of residuals
+        double sqDev;           // Mean square of residuals
+
+        uint64_t outliers;
+        uint64_t resyncs;
+    };
+}
+
+#endif
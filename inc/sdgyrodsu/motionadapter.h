@@ -4,58 +4,64 @@
 #include <cstdint>
 #include <string>
 #include "sdhidframe.h"
+#include "motionconverter.h"
 #include "motion/simplemotion.h"
 #include "hiddev/hiddevreader.h"
+#include "pipeline/thread.h"
 #include "pipeline/serve.h"
 #include "pipeline/signalout.h"
+#include "pipeline/seqlock.h"
+#include "pipeline/stagestats.h"
+#include "metrics/metrics.h"
 
 namespace kmicki::sdgyrodsu
 {
-    class MotionAdapter
+    // Pipeline stage converting every HID frame to motion data as it arrives.
+    // Most recent motion data and running state can be read by any sink without blocking.
+    class MotionAdapter : public pipeline::Thread
     {
         public:
         MotionAdapter() = delete;
-        MotionAdapter(hiddev::HidDevReader & _reader, bool persistent = true);
+        // deviceId: ID the motion data is tagged with
+        MotionAdapter(hiddev::HidDevReader & _reader, uint32_t const& _deviceId = 0);
+        ~MotionAdapter();
 
+        // Start reading frames and converting them.
         void StartFrameGrab();
         
-        // Get new motion data frame
-        // Returns true if new data is available
+        // Get the most recent motion data.
+        // Returns true if any data was converted since frame grab started.
+        // Use frame_id to find out if data is newer than the one obtained before.
         bool GetMotionData(kmicki::motion::SimpleMotionData &motionData);
+
+        // Get running state of motion processing.
+        MotionState GetState();
+
+        // Timing of frames converted to motion data. Can be read at any time.
+        pipeline::StageStats const& GetConvertStats();
         
         void StopFrameGrab();
         bool IsControllerConnected();
 
-        // Static helper function for motion data conversion
-        static void ConvertMotionData(const SdHidFrame& frame, kmicki::motion::SimpleMotionData &data, 
-                                    float &lastAccelRtL, float &lastAccelFtB, float &lastAccelTtB,
-                                    uint32_t frameId);
-
         pipeline::SignalOut NoGyro;
 
-        private:
-        bool ignoreFirst;
-        bool isPersistent;
+        protected:
+        void Execute() override;
+        void FlushPipes() override;
 
-        kmicki::motion::SimpleMotionData data;
+        private:
         hiddev::HidDevReader & reader;
 
-        uint32_t lastInc;
-        uint64_t lastTimestamp;
-        uint32_t frameCounter;
-        
-        float lastAccelRtL;
-        float lastAccelFtB;
-        float lastAccelTtB;
+        MotionConverter converter;
 
-        int toReplicate;
-        int noGyroCooldown;
+        pipeline::SeqLock<kmicki::motion::SimpleMotionData> motion;
+        pipeline::SeqLock<MotionState> publishedState;
+        pipeline::StageStats convertStats;
+        metrics::StageSummary convertSummary;
+        metrics::Counter overrunMetric;
 
         pipeline::Serve<hiddev::HidDevReader::frame_t> * frameServe;
-        
-        // Helper function
-        void ProcessFrame(const SdHidFrame& frame, kmicki::motion::SimpleMotionData &motionData);
     };
 }
 
-#endif
\ No newline at end of file
+#endif
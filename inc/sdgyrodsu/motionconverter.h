@@ -0,0 +1,83 @@
+#ifndef _KMICKI_SDGYRODSU_MOTIONCONVERTER_H_
+#define _KMICKI_SDGYRODSU_MOTIONCONVERTER_H_
+
+#include <cstdint>
+#include "sdhidframe.h"
+#include "clockestimator.h"
+#include "motion/simplemotion.h"
+#include "pipeline/signalout.h"
+#include "metrics/metrics.h"
+
+namespace kmicki::sdgyrodsu
+{
+    // Running state of motion processing
+    struct MotionState
+    {
+        uint64_t framesProcessed;   // Frames converted to motion data
+        uint64_t framesRepeated;    // Frames ignored because device repeated them
+        uint64_t framesMissed;      // Frames not delivered by device (gaps in increment)
+        uint64_t framesOverrun;     // Frames lost because processing fell behind the frame ring
+        uint32_t lastIncrement;     // Device's increment of the last processed frame
+        double samplePeriodUs;      // Real sample period estimated against host clock
+        double sampleJitterUs;      // RMS deviation of frame read times from fitted device clock
+        double clockDriftPpm;       // Drift of device clock against host clock
+        uint64_t clockOutliers;     // Frame read times rejected by the device clock fit
+        uint64_t clockResyncs;      // Restarts of the device clock fit
+    };
+
+    // Converts consecutive HID frames of a single device to motion data.
+    // Keeps track of repeated and missed frames and of the device clock.
+    // Not thread-safe: used by exactly one thread (pipeline stage or reactor).
+    class MotionConverter
+    {
+        public:
+        MotionConverter() = delete;
+        // deviceId: ID the motion data is tagged with
+        // noGyro: signalled when device stops reporting gyro data
+        MotionConverter(uint32_t const& _deviceId, pipeline::SignalOut & _noGyro);
+
+        // Forget previous frames.
+        void Reset();
+
+        // Convert frame to motion data.
+        // Returns false if the frame was repeated by the device (motionData is not updated).
+        bool Convert(frame_t const& frame, kmicki::motion::SimpleMotionData &motionData);
+
+        // Running state of motion processing
+        MotionState & GetState();
+
+        // Static helper function for motion data conversion
+        static void ConvertMotionData(const SdHidFrame& frame, kmicki::motion::SimpleMotionData &data, 
+                                    float &lastAccelRtL, float &lastAccelFtB, float &lastAccelTtB,
+                                    uint32_t frameId);
+
+        private:
+        uint32_t deviceId;
+        pipeline::SignalOut & noGyro;
+
+        uint32_t lastInc;
+        uint32_t frameCounter;
+        
+        float lastAccelRtL;
+        float lastAccelFtB;
+        float lastAccelTtB;
+
+        int noGyroCooldown;
+        int repeatedInRow;
+
+        MotionState state;
+        ClockEstimator clock;
+
+        metrics::Counter processedMetric;
+        metrics::Counter repeatedMetric;
+        metrics::Counter missedMetric;
+        metrics::Gauge periodMetric;
+        metrics::Gauge jitterMetric;
+        metrics::Gauge driftMetric;
+
+        // Check frame and process it. Returns false if frame was repeated.
+        bool HandleFrame(const SdHidFrame& frame, kmicki::motion::SimpleMotionData &motionData);
+    };
+}
+
+#endif
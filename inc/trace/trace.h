@@ -0,0 +1,112 @@
+#ifndef _KMICKI_TRACE_TRACE_H_
+#define _KMICKI_TRACE_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+namespace kmicki::trace
+{
+    // Low-overhead recorder of individual pipeline events (begin/end of a span or an instant).
+    // Every thread writes into its own ring holding its last cEventsPerThread events,
+    // without locks and without allocation after the first event of the thread.
+    // Recording costs a single relaxed load while tracing is disabled.
+    // Rings can be dumped in Chrome trace JSON format (chrome://tracing, ui.perfetto.dev).
+
+    enum class EventType : uint8_t
+    {
+        Begin,
+        End,
+        Instant
+    };
+
+    struct Event
+    {
+        uint64_t timestamp;     // CLOCK_MONOTONIC in nanoseconds
+        char const* name;       // Has to be a string literal
+        uint64_t frameId;       // Read timestamp of the frame (0 - not related to a frame)
+        EventType type;
+    };
+
+    static const int cEventsPerThread = 16384;
+
+    extern std::atomic<bool> enabled;
+
+    void SetEnabled(bool _enabled);
+
+    inline bool IsEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Record event of the calling thread.
+    void Record(EventType type, char const* name, uint64_t frameId);
+
+    inline void Begin(char const* name, uint64_t frameId = 0)
+    {
+        if(IsEnabled())
+            Record(EventType::Begin, name, frameId);
+    }
+
+    inline void End(char const* name, uint64_t frameId = 0)
+    {
+        if(IsEnabled())
+            Record(EventType::End, name, frameId);
+    }
+
+    inline void Instant(char const* name, uint64_t frameId = 0)
+    {
+        if(IsEnabled())
+            Record(EventType::Instant, name, frameId);
+    }
+
+    // Span from construction to destruction.
+    // End is recorded even if tracing was disabled meanwhile, so that spans stay paired.
+    class Scope
+    {
+        public:
+        Scope(char const* _name, uint64_t _frameId = 0)
+        : name(_name), frameId(_frameId), active(IsEnabled())
+        {
+            if(active)
+                Record(EventType::Begin, name, frameId);
+        }
+
+        ~Scope()
+        {
+            if(active)
+                Record(EventType::End, name, frameId);
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+        private:
+        char const* name;
+        uint64_t frameId;
+        bool active;
+    };
+
+    // Frame ID of a pipeline object: read timestamp of a frame or 0 if it has none.
+    template<class T>
+    uint64_t GetFrameId(T const& obj)
+    {
+        if constexpr (requires { obj.Timestamp; })
+            return obj.Timestamp;
+        else
+            return 0;
+    }
+
+    // Write events of all threads from the last seconds in Chrome trace JSON format.
+    // Returns number of events written.
+    size_t Dump(std::ostream & out, double seconds);
+
+    // Ask running TraceDumper to dump the trace now. Async-signal-safe.
+    void RequestDump();
+
+    // Report frames missed by the device or the pipeline.
+    // Asks running TraceDumper to dump the trace if it dumps on missed frames.
+    void ReportMissedFrames(uint64_t frameId);
+}
+
+#endif
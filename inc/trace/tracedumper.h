@@ -0,0 +1,58 @@
+#ifndef _KMICKI_TRACE_TRACEDUMPER_H_
+#define _KMICKI_TRACE_TRACEDUMPER_H_
+
+#include "pipeline/thread.h"
+#include "pipeline/eventfd.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace kmicki::trace
+{
+    // Writes the trace of the last seconds into a file in directory
+    // (sdmotion-<pid>-<n>.json) when requested by RequestDump()
+    // or, if onMiss is set, on missed frames (at most once per cMinMissDumpPeriod).
+    // Writing happens on its own thread, threads reporting events are never blocked.
+    // Only one TraceDumper can be running at a time.
+    class TraceDumper : public pipeline::Thread
+    {
+        public:
+        TraceDumper() = delete;
+        TraceDumper(std::string const& _directory, double _seconds, bool _onMiss);
+        ~TraceDumper();
+
+        // Configured by environment variables:
+        //   SDMOTION_TRACE         - 1: record from the start, 0: only when switched on at runtime
+        //                            (not set - no TraceDumper)
+        //   SDMOTION_TRACE_DIR     - directory of dumps (default: /tmp)
+        //   SDMOTION_TRACE_SECONDS - length of dumped trace (default: 5)
+        //   SDMOTION_TRACE_ON_MISS - 1: dump on missed frames
+        // Returns nullptr if SDMOTION_TRACE is not set.
+        static TraceDumper * FromEnv();
+
+        // Used by RequestDump() and ReportMissedFrames().
+        void Request(bool missed);
+
+        protected:
+        void Execute() override;
+        void FlushPipes() override;
+
+        private:
+        static const std::chrono::seconds cMinMissDumpPeriod;
+        static const std::chrono::milliseconds cMissDumpDelay;
+
+        std::string directory;
+        double seconds;
+        bool onMiss;
+        int dumpCount;
+        pipeline::EventFd requestEvent;
+        std::atomic<bool> requested;
+        std::atomic<bool> missRequested;
+        std::chrono::steady_clock::time_point lastMissDump;
+
+        void Write(char const* reason);
+    };
+}
+
+#endif
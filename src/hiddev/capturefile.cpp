@@ -0,0 +1,96 @@
+#include "hiddev/capturefile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace kmicki::hiddev
+{
+    const char cCaptureMagic[8] = { 'S','D','M','C','A','P','\0','\0' };
+    const uint32_t cCaptureVersion = 2;
+
+    // Header of version 1 captures (without deviceId)
+    static const size_t cHeaderLenV1 = offsetof(CaptureHeader, deviceId);
+
+    CaptureFile::CaptureFile(std::string const& path)
+    : map(nullptr), mapLen(0), headerLen(0), frameLen(0), deviceId(0), recordLen(0), frameCount(0)
+    {
+        int fd = open(path.c_str(),O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            throw std::runtime_error("CaptureFile: Can't open " + path + ": " + strerror(errno));
+
+        struct stat st;
+        if(fstat(fd,&st) < 0 || st.st_size < (off_t)cHeaderLenV1)
+        {
+            close(fd);
+            throw std::runtime_error("CaptureFile: " + path + " is too short to be a capture.");
+        }
+
+        mapLen = st.st_size;
+        void* addr = mmap(nullptr,mapLen,PROT_READ,MAP_PRIVATE,fd,0);
+        close(fd);
+        if(addr == MAP_FAILED)
+            throw std::runtime_error("CaptureFile: Can't map " + path + ": " + strerror(errno));
+        map = static_cast<char const*>(addr);
+        madvise(addr,mapLen,MADV_SEQUENTIAL | MADV_WILLNEED);
+
+        CaptureHeader header {};
+        std::memcpy(&header,map,cHeaderLenV1);
+        headerLen = (header.version == 1) ? cHeaderLenV1 : sizeof(CaptureHeader);
+        if(std::memcmp(header.magic,cCaptureMagic,sizeof(cCaptureMagic)) != 0
+            || header.version < 1 || header.version > cCaptureVersion || header.frameLen == 0
+            || mapLen < headerLen)
+        {
+            munmap(addr,mapLen);
+            throw std::runtime_error("CaptureFile: " + path + " is not a supported capture.");
+        }
+        std::memcpy(&header,map,headerLen);
+
+        frameLen = header.frameLen;
+        deviceId = header.deviceId;
+        recordLen = sizeof(uint64_t) + frameLen;
+        frameCount = (mapLen - headerLen) / recordLen;
+    }
+
+    CaptureFile::~CaptureFile()
+    {
+        if(map != nullptr)
+            munmap(const_cast<char*>(map),mapLen);
+    }
+
+    int CaptureFile::GetFrameLen() const
+    {
+        return frameLen;
+    }
+
+    uint32_t CaptureFile::GetDeviceId() const
+    {
+        return deviceId;
+    }
+
+    size_t CaptureFile::GetFrameCount() const
+    {
+        return frameCount;
+    }
+
+    char const* CaptureFile::GetRecord(size_t const& index) const
+    {
+        return map + headerLen + index*recordLen;
+    }
+
+    uint64_t CaptureFile::GetTimestamp(size_t const& index) const
+    {
+        uint64_t timestamp;
+        std::memcpy(&timestamp,GetRecord(index),sizeof(timestamp));
+        return timestamp;
+    }
+
+    char const* CaptureFile::GetFrame(size_t const& index) const
+    {
+        return GetRecord(index) + sizeof(uint64_t);
+    }
+}
@@ -0,0 +1,104 @@
+#include "hiddev/capturewriter.h"
+#include "log/log.h"
+
+#include <stdexcept>
+#include <cstring>
+
+using namespace kmicki::log;
+
+namespace kmicki::hiddev
+{
+    static const size_t cWriteBufferLen = 1 << 16;
+
+    CaptureWriter::CaptureWriter(HidDevReader & _reader, std::string const& _path)
+    : reader(_reader), path(_path), file(nullptr), frameServe(nullptr)
+    { 
+        SetConfig(pipeline::ThreadConfig::FromEnv("CAPTURE"));
+    }
+
+    CaptureWriter::~CaptureWriter()
+    {
+        StopCapture();
+    }
+
+    void CaptureWriter::StartCapture()
+    {
+        if(IsStarted())
+            return;
+
+        file = fopen(path.c_str(),"wbe");
+        if(file == nullptr)
+            throw std::runtime_error("CaptureWriter: Can't create " + path + ": " + strerror(errno));
+        setvbuf(file,nullptr,_IOFBF,cWriteBufferLen);
+
+        frameServe = &reader.GetServe();
+
+        CaptureHeader header;
+        std::memcpy(header.magic,cCaptureMagic,sizeof(header.magic));
+        header.version = cCaptureVersion;
+        header.frameLen = frameServe->GetPointer()->size();
+        header.deviceId = reader.GetDeviceId();
+        fwrite(&header,sizeof(header),1,file);
+
+        { LogF() << "CaptureWriter: Recording frames to " << path << "."; }
+        reader.Start();
+        Start();
+    }
+
+    void CaptureWriter::StopCapture()
+    {
+        if(!IsStarted() && frameServe == nullptr)
+            return;
+        Stop();
+        if(frameServe != nullptr)
+        {
+            reader.StopServe(*frameServe);
+            frameServe = nullptr;
+        }
+        if(file != nullptr)
+        {
+            fclose(file);
+            file = nullptr;
+        }
+        Log("CaptureWriter: Recording stopped.");
+    }
+
+    void CaptureWriter::Execute()
+    {
+        auto const& frame = frameServe->GetPointer();
+        uint64_t written = 0;
+        uint64_t lost = 0;
+
+        Log("CaptureWriter: Started.",LogLevelDebug);
+
+        while(ShouldContinue())
+        {
+            if(!frameServe->WaitForNext())
+                continue;
+
+            uint64_t timestamp = frame->Timestamp;
+            if(fwrite(&timestamp,sizeof(timestamp),1,file) != 1
+                || fwrite(frame->data(),frame->size(),1,file) != 1)
+            {
+                { LogF() << "CaptureWriter: Writing to " << path << " failed: " << strerror(errno) << ". Recording stopped."; }
+                break;
+            }
+            ++written;
+
+            if(frameServe->GetOverrunCount() != lost)
+            {
+                { LogF() << "CaptureWriter: Fell behind the frame ring. Lost " << (frameServe->GetOverrunCount() - lost) << " frames."; }
+                lost = frameServe->GetOverrunCount();
+            }
+        }
+
+        fflush(file);
+        { KMICKI_LOGF(LogLevelDebug) << "CaptureWriter: Stopped after " << written << " frames."; }
+    }
+
+    void CaptureWriter::FlushPipes()
+    {
+        if(frameServe != nullptr)
+            frameServe->Flush();
+    }
+}
@@ -13,7 +13,7 @@ namespace kmicki::hiddev
     static const int cUsToTimeout = 1000;
 
     HidDevFile::HidDevFile(std::string const& _filePath, int readTimeoutUs, bool const& open)
-        : filePath(_filePath), fileDescriptors{{-1,POLLIN,0}}, 
+        : filePath(_filePath), fileDescriptors{{-1,POLLIN,0},{-1,POLLIN,0}}, 
         timeout{0,readTimeoutUs*cUsToTimeout}, file(fileDescriptors[0].fd)
     {
         if(open)
@@ -38,12 +38,17 @@ namespace kmicki::hiddev
         return file >= 0 && (fcntl(file, F_GETFD) != -1 || errno != EBADF);
     }
 
+    void HidDevFile::SetWakeFd(int fd)
+    {
+        fileDescriptors[1].fd = fd;
+    }
+
     int HidDevFile::Read(std::vector<char> & data)
     {
         if(file < 0)
             return 0;
         
-        auto retval = ppoll(fileDescriptors,1,&timeout,nullptr);
+        auto retval = ppoll(fileDescriptors,2,&timeout,nullptr);
         
         if(retval == 0)
             return 0;
@@ -51,6 +56,9 @@ namespace kmicki::hiddev
         if(retval < 0)
             return retval;
 
+        if((fileDescriptors[0].revents & POLLIN) == 0)
+            return (fileDescriptors[0].revents == 0) ? 0 : -1; // woken or file error
+
         int readCnt = 0;
             
         do {
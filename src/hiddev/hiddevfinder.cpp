@@ -1,9 +1,13 @@
 #include "hiddev/hiddevfinder.h"
+#include "hiddev/hotplug.h"
 #include "shell/shell.h"
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
+#include <cstdlib>
+#include <stdexcept>
 #include <systemd/sd-device.h>
+#include <systemd/sd-event.h>
     
 using namespace kmicki::shell;
 
@@ -14,6 +18,10 @@ namespace kmicki::hiddev
     const std::string cSubsystem = "usb";
     const std::string cDevType = "usb_device";
     const std::string cProductPropertyName = "PRODUCT";
+    const std::string cHidRawSubsystem = "hidraw";
+    const std::string cInterfaceDevType = "usb_interface";
+    const std::string cInterfaceNumberAttr = "bInterfaceNumber";
+    const std::string cSerialAttr = "serial";
 
     inline std::string GetHexStringId(uint16_t id)
     {
@@ -26,6 +34,65 @@ namespace kmicki::hiddev
                                       << id).str());
     }
 
+    // Check if usb_device that is a parent of the device matches vendor ID and product ID
+    bool IsUsbProduct(sd_device *device, std::string const& vidStr, std::string const& pidStr)
+    {
+        sd_device *usbDevice = NULL;
+        if(sd_device_get_parent_with_subsystem_devtype(device,cSubsystem.c_str(),cDevType.c_str(),&usbDevice) != 0)
+            return false;
+
+        const char *product = NULL;
+        if(sd_device_get_property_value(usbDevice,cProductPropertyName.c_str(),&product) != 0)
+            return false;
+
+        return vidStr == std::string(product).substr(0,4) && pidStr == std::string(product).substr(5,4);
+    }
+
+    // Check if hidraw device belongs to USB interface of provided number of matching product
+    bool IsHidRawInterface(sd_device *hidRaw, std::string const& vidStr, std::string const& pidStr, int interfaceNumber)
+    {
+        if(!IsUsbProduct(hidRaw,vidStr,pidStr))
+            return false;
+
+        // Go up to usb_interface and check its number
+        sd_device *usbInterface = NULL;
+        if(sd_device_get_parent_with_subsystem_devtype(hidRaw,cSubsystem.c_str(),cInterfaceDevType.c_str(),&usbInterface) != 0)
+            return false;
+        const char *interfaceStr = NULL;
+        if(sd_device_get_sysattr_value(usbInterface,cInterfaceNumberAttr.c_str(),&interfaceStr) != 0)
+            return false;
+        return std::strtol(interfaceStr,nullptr,16) == interfaceNumber;
+    }
+
+    // Serial number of USB device that is a parent of the device.
+    // Falls back to name of the USB device (its port path) if there is no serial number.
+    std::string GetUsbSerial(sd_device *device)
+    {
+        sd_device *usbDevice = NULL;
+        if(sd_device_get_parent_with_subsystem_devtype(device,cSubsystem.c_str(),cDevType.c_str(),&usbDevice) != 0)
+            return std::string();
+
+        const char *serial = NULL;
+        if(sd_device_get_sysattr_value(usbDevice,cSerialAttr.c_str(),&serial) == 0 && serial != NULL && *serial != 0)
+            return serial;
+
+        const char *sysName = NULL;
+        if(sd_device_get_sysname(usbDevice,&sysName) == 0)
+            return sysName;
+        return std::string();
+    }
+
+    uint32_t GetDeviceId(std::string const& serial)
+    {
+        uint32_t hash = 2166136261u;
+        for(unsigned char c : serial)
+        {
+            hash ^= c;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
     // Find N of the HID device matching provided vendor ID and product ID.
     // N being the number in path: /dev/usb/hiddevN
     int FindHidDevNo(uint16_t vid, uint16_t pid)
@@ -41,16 +108,10 @@ namespace kmicki::hiddev
             if(sd_device_new_from_devname(&hidDevice, hiddevFile.path().c_str()) != 0)
                 continue;
 
-            // Go up to usb_device
-            sd_device *usbDevice = NULL;
-            if(sd_device_get_parent_with_subsystem_devtype(hidDevice,cSubsystem.c_str(),cDevType.c_str(),&usbDevice) != 0)
-                continue;
-
-            // Check vid,pid
-            const char *product = NULL;
-            if(sd_device_get_property_value(usbDevice,cProductPropertyName.c_str(),&product) != 0)
-                continue;
-            if(vidStr == std::string(product).substr(0,4) && pidStr == std::string(product).substr(5,4))
+            // Go up to usb_device and check vid,pid
+            bool matches = IsUsbProduct(hidDevice,vidStr,pidStr);
+            sd_device_unref(hidDevice);
+            if(matches)
             {
                 std::string fName = hiddevFile.path().filename();
                 if(fName.length() > cHiddevPrefix.length())
@@ -66,4 +127,112 @@ namespace kmicki::hiddev
 
         return -1;
     }
-}
\ No newline at end of file
+
+    // Find all hidraw devices matching provided vendor ID, product ID and interface number.
+    std::vector<HidRawDeviceInfo> FindHidRawDevices(uint16_t vid, uint16_t pid, int interfaceNumber)
+    {
+        auto vidStr = GetHexStringId(vid);
+        auto pidStr = GetHexStringId(pid);
+        std::vector<HidRawDeviceInfo> result;
+
+        sd_device_enumerator *enumerator = NULL;
+        if(sd_device_enumerator_new(&enumerator) < 0)
+            return result;
+
+        if(sd_device_enumerator_add_match_subsystem(enumerator,cHidRawSubsystem.c_str(),1) >= 0)
+        {
+            // Loop through all hidraw devices
+            for(auto hidRaw = sd_device_enumerator_get_device_first(enumerator); 
+                hidRaw != NULL; 
+                hidRaw = sd_device_enumerator_get_device_next(enumerator))
+            {
+                if(!IsHidRawInterface(hidRaw,vidStr,pidStr,interfaceNumber))
+                    continue;
+
+                const char *devName = NULL;
+                if(sd_device_get_devname(hidRaw,&devName) != 0)
+                    continue;
+
+                auto serial = GetUsbSerial(hidRaw);
+                result.push_back({ devName, serial, GetDeviceId(serial) });
+            }
+        }
+
+        sd_device_enumerator_unref(enumerator);
+        return result;
+    }
+
+    // Find path of the hidraw device matching provided vendor ID, product ID, interface number and serial.
+    // Path being: /dev/hidrawN
+    std::string FindHidRawPath(uint16_t vid, uint16_t pid, int interfaceNumber, std::string const& serial)
+    {
+        for(auto const& device : FindHidRawDevices(vid,pid,interfaceNumber))
+            if(serial.empty() || device.serial == serial)
+                return device.path;
+        return std::string();
+    }
+
+    // Definition - UdevHotplugSource
+
+    UdevHotplugSource::UdevHotplugSource(uint16_t const& _vId, uint16_t const& _pId, int const& _interfaceNumber)
+    : vId(_vId), pId(_pId), interfaceNumber(_interfaceNumber),
+      monitor(NULL), event(NULL), pending()
+    {
+        if(sd_event_new(&event) < 0)
+            throw std::runtime_error("UdevHotplugSource: Event loop could not be created.");
+
+        if(sd_device_monitor_new(&monitor) < 0
+            || sd_device_monitor_filter_add_match_subsystem_devtype(monitor,cHidRawSubsystem.c_str(),NULL) < 0
+            || sd_device_monitor_attach_event(monitor,event) < 0
+            || sd_device_monitor_start(monitor,&UdevHotplugSource::HandleDevice,this) < 0)
+        {
+            if(monitor != NULL)
+                sd_device_monitor_unref(monitor);
+            sd_event_unref(event);
+            throw std::runtime_error("UdevHotplugSource: Device monitor could not be started.");
+        }
+    }
+
+    UdevHotplugSource::~UdevHotplugSource()
+    {
+        sd_device_monitor_stop(monitor);
+        sd_device_monitor_detach_event(monitor);
+        sd_device_monitor_unref(monitor);
+        sd_event_unref(event);
+    }
+
+    int UdevHotplugSource::GetFd()
+    {
+        return sd_event_get_fd(event);
+    }
+
+    bool UdevHotplugSource::TryEvent(HotplugEvent & hotplugEvent)
+    {
+        // Dispatch everything monitor received so far
+        while(pending.empty() && sd_event_run(event,0) > 0);
+
+        if(pending.empty())
+            return false;
+        hotplugEvent = pending.front();
+        pending.pop_front();
+        return true;
+    }
+
+    int UdevHotplugSource::HandleDevice(sd_device_monitor* monitor, sd_device* device, void* userdata)
+    {
+        auto & self = *static_cast<UdevHotplugSource*>(userdata);
+
+        sd_device_action_t action;
+        const char *devName = NULL;
+        if(sd_device_get_action(device,&action) < 0 || sd_device_get_devname(device,&devName) < 0)
+            return 0;
+
+        if(action == SD_DEVICE_REMOVE)
+            self.pending.push_back({ HotplugAction::Remove, devName });
+        else if(action == SD_DEVICE_ADD 
+                && IsHidRawInterface(device,GetHexStringId(self.vId),GetHexStringId(self.pId),self.interfaceNumber))
+            self.pending.push_back({ HotplugAction::Add, devName });
+
+        return 0;
+    }
+}
@@ -11,6 +11,7 @@ namespace kmicki::hiddev
     const int HidDevReader::cInputRecordLen = 8;    // Number of bytes that are read from hiddev file per 1 byte of HID data.
     const int HidDevReader::cByteposInput = 4;      // Position in the raw hiddev record (of INPUT_RECORD_LEN length) where 
                                                     // HID data byte is.
+    const int HidDevReader::cFrameRingLen = 256;    // Number of most recent frames kept for consumers (~1s of Steam Deck's frames).
 
     void HandleMissedTicks(std::string name, std::string tickName, bool received, int & ticks, int period, int & nonMissed)
     {
@@ -19,24 +20,24 @@ namespace kmicki::hiddev
         if(!received)
         {
             if(ticks == 1)
-                { LogF(LogLevelDebug) << name << ": Start missing " << tickName << "."; }
+                { KMICKI_LOGF(LogLevelDebug) << name << ": Start missing " << tickName << "."; }
             ++ticks;
             if(ticks % period == 0)
             {
-                { LogF(LogLevelDebug) << name << ": Missed " << period << " " << tickName << " after " << nonMissed << " " << tickName << ". Still being missed."; }
+                { KMICKI_LOGF(LogLevelDebug) << name << ": Missed " << period << " " << tickName << " after " << nonMissed << " " << tickName << ". Still being missed."; }
                 if(ticks > period)
                     ticks -= period;
             }
         }
         else if(ticks > period)
         {
-            { LogF(LogLevelDebug) << name << ": Missed " << ((ticks+1) % period - 1) << " " << tickName << ". Not being missed anymore."; }
+            { KMICKI_LOGF(LogLevelDebug) << name << ": Missed " << ((ticks+1) % period - 1) << " " << tickName << ". Not being missed anymore."; }
             ticks = 0;
             nonMissed = 0;
         }
         else if(ticks > 0)
         {
-            { LogF(LogLevelDebug) << name << ": Missed " << ticks << " " << tickName << " after " << nonMissed << " " << tickName << "."; }
+            { KMICKI_LOGF(LogLevelDebug) << name << ": Missed " << ticks << " " << tickName << " after " << nonMissed << " " << tickName << "."; }
             ticks = 0;
             nonMissed = 0;
         }
@@ -54,29 +55,38 @@ namespace kmicki::hiddev
     void HidDevReader::ConstructPipeline(ReadData *_readData, int const& _frameLen, int const& scanTimeUs, bool useProcessData)
     {
         auto* readDataOp = _readData;
-        ProcessData* processData;
-        ServeFrame* serveFrame;
+        processData = nullptr;
+        serve.reset(new Broadcast<frame_t>(new frame_t(_frameLen),cFrameRingLen));
         if(useProcessData)
         {
-            processData = new ProcessData(_frameLen, *readDataOp, scanTimeUs);
-            serveFrame = new ServeFrame(processData->Frame);
+            processData = new ProcessData(_frameLen, *readDataOp, *serve, scanTimeUs);
+            processData->SetConfig(ThreadConfig::FromEnv("PROCESS"));
         }
         else
-            serveFrame = new ServeFrame(readDataOp->Data);
+            readDataOp->ServeFrames(*serve);
+        readDataOp->SetConfig(ThreadConfig::FromEnv("READ"));
 
         AddOperation(readDataOp);
         if(useProcessData)
             AddOperation(processData);
-        AddOperation(serveFrame);
 
-        serve = serveFrame;
         readData = readDataOp;
 
+        auto labels = metrics::DeviceLabels(readDataOp->GetDeviceId());
+        stageSummaries.emplace_back(new metrics::StageSummary("read", readDataOp->ReadStats, labels));
+        if(useProcessData)
+        {
+            stageSummaries.emplace_back(new metrics::StageSummary("process", processData->ProcessStats, labels));
+            stageSummaries.emplace_back(new metrics::StageSummary("publish", processData->PublishStats, labels));
+        }
+        else
+            stageSummaries.emplace_back(new metrics::StageSummary("publish", readDataOp->PublishStats, labels));
+
         Log("HidDevReader: Pipeline initialized. Waiting for start...",LogLevelDebug);
     }
 
     HidDevReader::HidDevReader(int const& hidNo, int const& _frameLen, int const& scanTimeUs) 
-    : frameLen(_frameLen), startStopMutex(), readDataApi(nullptr)
+    : frameLen(_frameLen), startStopMutex()
     {
         if(hidNo < 0) throw std::invalid_argument("hidNo");
 
@@ -89,12 +99,38 @@ namespace kmicki::hiddev
     }
 
 
-    HidDevReader::HidDevReader(uint16_t const& vId, uint16_t const& pId, int const& interfaceNumber ,int const& _frameLen, int const& scanTimeUs) 
+    HidDevReader::HidDevReader(uint16_t const& vId, uint16_t const& pId, int const& interfaceNumber ,int const& _frameLen, int const& scanTimeUs, bool useHidRaw, std::string const& serial) 
     : frameLen(_frameLen), startStopMutex()
     {
-        readDataApi = new ReadDataApi(vId, pId, interfaceNumber, _frameLen, scanTimeUs);
+        ReadData* readDataOp;
+        if(useHidRaw)
+        {
+            readDataOp = new ReadDataRaw(vId, pId, interfaceNumber, _frameLen, scanTimeUs, serial);
+            try
+            {
+                hotplug.reset(new UdevHotplugSource(vId, pId, interfaceNumber));
+                readDataOp->SetHotplugSource(hotplug.get());
+            }
+            catch(std::runtime_error const& e)
+            {
+                Log(e.what());
+                Log("HidDevReader: Hotplug events unavailable. Lost device will be reopened periodically.");
+            }
+        }
+        else
+            readDataOp = new ReadDataApi(vId, pId, interfaceNumber, _frameLen, scanTimeUs);
 
-        ConstructPipeline(readDataApi, _frameLen, scanTimeUs,false);
+        ConstructPipeline(readDataOp, _frameLen, scanTimeUs,false);
+    }
+
+
+    HidDevReader::HidDevReader(std::string const& capturePath, int const& _frameLen, double const& speed, bool const& loop) 
+    : frameLen(_frameLen), startStopMutex()
+    {
+        if(speed < 0.0) throw std::invalid_argument("speed");
+
+        auto* readDataOp = new ReadDataReplay(capturePath, _frameLen, speed, loop);
+        ConstructPipeline(readDataOp, _frameLen, 0, false);
     }
 
 
@@ -138,8 +174,20 @@ namespace kmicki::hiddev
 
         Log("HidDevReader: Attempting to stop the pipeline...",LogLevelDebug);
 
+        bool wasStarted = IsStarted();
         for (auto thread = pipeline.rbegin(); thread != pipeline.rend(); ++thread)
-            (*thread)->TryStopThenKill(std::chrono::seconds(10));
+            (*thread)->Stop();
+
+        // Release consumers still waiting for a frame
+        serve->Flush();
+
+        if(wasStarted)
+        {
+            { KMICKI_LOGF(LogLevelDebug) << "HidDevReader: Read " << GetReadStats().Describe(); }
+            if(processData != nullptr)
+                { KMICKI_LOGF(LogLevelDebug) << "HidDevReader: Process " << processData->ProcessStats.Describe(); }
+            { KMICKI_LOGF(LogLevelDebug) << "HidDevReader: Publish " << GetPublishStats().Describe(); }
+        }
 
         Log("HidDevReader: Stopped the pipeline.");
     }
@@ -165,9 +213,60 @@ namespace kmicki::hiddev
         return false;
     }
 
+    void HidDevReader::SetHotplugSource(HotplugSource* source)
+    {
+        hotplug.reset(source);
+        if(readData != nullptr)
+            readData->SetHotplugSource(source);
+    }
+
+    void HidDevReader::SetDevicePath(std::string const& path)
+    {
+        if(readData != nullptr)
+            readData->SetDevicePath(path);
+    }
+
+    StageStats const& HidDevReader::GetReadStats()
+    {
+        return readData->ReadStats;
+    }
+
+    StageStats const* HidDevReader::GetProcessStats()
+    {
+        if(processData == nullptr)
+            return nullptr;
+        return &processData->ProcessStats;
+    }
+
+    StageStats const& HidDevReader::GetPublishStats()
+    {
+        if(processData != nullptr)
+            return processData->PublishStats;
+        return readData->PublishStats;
+    }
+
+    ReconnectStats HidDevReader::GetReconnectStats()
+    {
+        if(readData == nullptr)
+            return ReconnectStats();
+        return readData->GetReconnectStats();
+    }
+
+    uint32_t HidDevReader::GetDeviceId()
+    {
+        if(readData == nullptr)
+            return 0;
+        return readData->GetDeviceId();
+    }
+
+    bool HidDevReader::IsFinished()
+    {
+        return readData != nullptr && readData->IsFinished();
+    }
+
     void HidDevReader::SetNoGyro(SignalOut &_noGyro)
     {
-        if(readDataApi)
-            readDataApi->SetNoGyro(_noGyro);
+        if(readData != nullptr)
+            readData->SetNoGyro(_noGyro);
     }
 }
\ No newline at end of file
@@ -7,52 +7,46 @@ namespace kmicki::hiddev
 {
     static const int cApiScanTimeToTimeout = 3;
 
-    HidDevReader::ProcessData::ProcessData(int const& _frameLen, ReadData & _data, int const& scanTimeUs)
-    : readData(_data), data(_data.Data), ReadStuck(), timeout(cApiScanTimeToTimeout*scanTimeUs),
-      Frame(new frame_t(_frameLen),new frame_t(_frameLen),new frame_t(_frameLen))
+    HidDevReader::ProcessData::ProcessData(int const& _frameLen, ReadData & _data, Broadcast<frame_t> & _frame, int const& scanTimeUs)
+    : readData(_data), data(_data.Data), frame(_frame), frameBuffer(_frameLen),
+      ReadStuck(), ProcessStats(), PublishStats(), timeout(cApiScanTimeToTimeout*scanTimeUs),
+      readStuckMetric("sdmotion_read_stuck_total", "Restarts of reading after it got stuck", metrics::DeviceLabels(_data.GetDeviceId()))
     { }
 
     HidDevReader::ProcessData::~ProcessData()
     {
-        TryStopThenKill();
+        Stop();
     }
 
     void HidDevReader::ProcessData::Execute()
     {
-        static const std::chrono::microseconds cReadDataRestartTimeout(500);
-        static const int cReportMissedTicksPeriod = 250;
-        int missedTicks = 0;
-        int nonMissedTicks = 0;
-        
-        auto const& frame = Frame.GetPointerToFill();
         auto const& hidData = data.GetPointer();
 
-        int missedLossTicks = 0;
-        int nonMissedLossTicks = 0;
-
         Log("HidDevReader::ProcessData: Started.",LogLevelDebug);
 
         while(ShouldContinue())
         {
             if(!data.WaitForData(timeout))
             {
-                Log("HidDevReader::ProcessData: Reading from hiddev file stuck. Force-restarting reading task.",LogLevelDebug);
+                Log("HidDevReader::ProcessData: Reading from hiddev file stuck. Restarting reading task.",LogLevelDebug);
                 ReadStuck.SendSignal();
-                readData.TryRestartThenForceRestart(cReadDataRestartTimeout);
+                readStuckMetric.Increment();
+                readData.Restart();
                 continue;
             }
             if(!ShouldContinue())
                 break;
 
             // Each byte is encapsulated in a record
-            for (int i = 0, j = cByteposInput; i < frame->size(); ++i,j+=cInputRecordLen) 
+            for (int i = 0, j = cByteposInput; i < frameBuffer.size(); ++i,j+=cInputRecordLen) 
             {
-                (*frame)[i] = (*hidData)[j];
+                frameBuffer[i] = (*hidData)[j];
             }
-            
-            HandleMissedTicks("HidDevReader::ProcessData","frames",Frame.WasReceived(),missedTicks,cReportMissedTicksPeriod,nonMissedLossTicks);
+            frameBuffer.Timestamp = hidData->Timestamp;
+            ProcessStats.Record(frameBuffer.Timestamp);
 
-            Frame.SendData();
+            frame.Publish(frameBuffer);
+            PublishStats.Record(frameBuffer.Timestamp);
         }
         
         Log("HidDevReader::ProcessData: Stopped.",LogLevelDebug);
@@ -60,6 +54,6 @@ namespace kmicki::hiddev
 
     void HidDevReader::ProcessData::FlushPipes()
     {
-        data.SendData();
+        data.Flush();
     }
 }
\ No newline at end of file
@@ -2,23 +2,38 @@
 #include "log/log.h"
 #include <fcntl.h>
 #include <sys/select.h>
+#include <poll.h>
 
 using namespace kmicki::log;
 
 namespace kmicki::hiddev
 {
+    // Period of checking stop request while waiting for the frame to be consumed.
+    static const std::chrono::milliseconds cStopCheckPeriod(10);
+    // Period of checking if the next operation received the frame (it doesn't signal it).
+    static const timespec cReceivedCheckPeriod = { 0, 50000 };
+
     // Definition - ReadData
-    HidDevReader::ReadData::ReadData(int const& _frameLen)
+    HidDevReader::ReadData::ReadData(int const& _frameLen, uint32_t const& _deviceId)
     : startMarker(0),
-      Data(new std::vector<char>(_frameLen),
-           new std::vector<char>(_frameLen), 
-           new std::vector<char>(_frameLen)),
-      Unsynced()
+      Data(new frame_t(_frameLen),
+           new frame_t(_frameLen), 
+           new frame_t(_frameLen)),
+      Unsynced(), ReadStats(), PublishStats(), frameServe(nullptr),
+      reconnectStats(), disconnectedAt(0), publishedReconnectStats(),
+      deviceId(_deviceId),
+      connectedMetric("sdmotion_device_connected", "Input device is open and being read", metrics::DeviceLabels(_deviceId)),
+      disconnectsMetric("sdmotion_device_disconnects_total", "Times the input device was lost", metrics::DeviceLabels(_deviceId)),
+      reconnectsMetric("sdmotion_device_reconnects_total", "Times the input device was reopened after being lost", metrics::DeviceLabels(_deviceId)),
+      reconnectLatencyMetric("sdmotion_device_reconnect_latency_seconds", "Time from losing the input device to reopening it (last reconnect)", metrics::DeviceLabels(_deviceId)),
+      maxReconnectLatencyMetric("sdmotion_device_reconnect_latency_max_seconds", "Longest time from losing the input device to reopening it", metrics::DeviceLabels(_deviceId)),
+      gyroReenablesMetric("sdmotion_gyro_reenables_total", "Times the gyro was reenabled after it stopped reporting", metrics::DeviceLabels(_deviceId)),
+      unsyncedMetric("sdmotion_unsynced_total", "Restarts of reading after frames got out of sync", metrics::DeviceLabels(_deviceId))
     { }
 
     HidDevReader::ReadData::~ReadData()
     {
-        TryStopThenKill();
+        Stop();
     }
 
     void HidDevReader::ReadData::FlushPipes()
@@ -28,4 +43,99 @@ namespace kmicki::hiddev
     {
         startMarker = marker;
     }
-}
\ No newline at end of file
+
+    void HidDevReader::ReadData::SetNoGyro(SignalOut&)
+    { }
+
+    void HidDevReader::ReadData::SetHotplugSource(HotplugSource*)
+    { }
+
+    void HidDevReader::ReadData::SetDevicePath(std::string const&)
+    { }
+
+    ReconnectStats HidDevReader::ReadData::GetReconnectStats()
+    {
+        return publishedReconnectStats.Load();
+    }
+
+    uint32_t HidDevReader::ReadData::GetDeviceId()
+    {
+        return deviceId;
+    }
+
+    void HidDevReader::ReadData::ReportGyroReenabled()
+    {
+        gyroReenablesMetric.Increment();
+    }
+
+    void HidDevReader::ReadData::ReportUnsynced()
+    {
+        unsyncedMetric.Increment();
+        Unsynced.SendSignal();
+    }
+
+    void HidDevReader::ReadData::ReportConnected()
+    {
+        if(disconnectedAt != 0)
+        {
+            auto latency = GetMonotonicTimestamp() - disconnectedAt;
+            { LogF() << "HidDevReader::ReadData: Device reconnected after " << latency/1000 << " ms."; }
+            ++reconnectStats.reconnects;
+            reconnectStats.lastLatencyUs = latency;
+            if(latency > reconnectStats.maxLatencyUs)
+                reconnectStats.maxLatencyUs = latency;
+            disconnectedAt = 0;
+            reconnectsMetric.Increment();
+            reconnectLatencyMetric.Set(reconnectStats.lastLatencyUs / 1e6);
+            maxReconnectLatencyMetric.Set(reconnectStats.maxLatencyUs / 1e6);
+        }
+        reconnectStats.connected = true;
+        connectedMetric.Set(1);
+        publishedReconnectStats.Store(reconnectStats);
+    }
+
+    void HidDevReader::ReadData::ReportDisconnected()
+    {
+        ++reconnectStats.disconnects;
+        reconnectStats.connected = false;
+        disconnectedAt = GetMonotonicTimestamp();
+        disconnectsMetric.Increment();
+        connectedMetric.Set(0);
+        publishedReconnectStats.Store(reconnectStats);
+    }
+
+    void HidDevReader::ReadData::ServeFrames(Broadcast<frame_t> & _frameServe)
+    {
+        frameServe = &_frameServe;
+    }
+
+    void HidDevReader::ReadData::SendFrame()
+    {
+        auto const& data = Data.GetPointerToFill();
+        ReadStats.Record(data->Timestamp);
+        if(frameServe != nullptr)
+        {
+            frameServe->Publish(*data);
+            PublishStats.Record(data->Timestamp);
+        }
+        else
+            Data.SendData();
+    }
+
+    bool HidDevReader::ReadData::WaitUntilConsumed()
+    {
+        if(frameServe != nullptr)
+        {
+            while(ShouldContinue())
+                if(frameServe->WaitUntilConsumed(std::chrono::steady_clock::now() + cStopCheckPeriod))
+                    return true;
+            return false;
+        }
+
+        pollfd stopFd = { GetStopFd(), POLLIN, 0 };
+        while(!Data.WasReceived())
+            if(ppoll(&stopFd, 1, &cReceivedCheckPeriod, nullptr) > 0)
+                return false;
+        return ShouldContinue();
+    }
+}
@@ -14,6 +14,11 @@ namespace kmicki::hiddev
     : vId(_vId), pId(_pId), ReadData(_frameLen), timeout(cApiScanTimeToTimeout*_scanTimeUs/1000),interfaceNumber(_interfaceNumber),noGyro(nullptr)
     { }
 
+    HidDevReader::ReadDataApi::~ReadDataApi()
+    {
+        Stop();
+    }
+
     void HidDevReader::ReadDataApi::SetNoGyro(SignalOut &_noGyro)
     {
         noGyro = &_noGyro;
@@ -40,17 +45,21 @@ namespace kmicki::hiddev
             {
                 Log("HidDevReader::ReadDataApi: Try reenabling gyro.",LogLevelTrace);
                 if(dev.EnableGyro())
+                {
                     Log("HidDevReader::ReadDataApi: Gyro reenabled.",LogLevelDebug);
+                    ReportGyroReenabled();
+                }
                 else
                     Log("HidDevReader::ReadDataApi: Gyro reenaling failed.");
                 continue;
             }
 
             auto readCnt = dev.Read(*data);
+            data->Timestamp = GetMonotonicTimestamp();
 
             if(readCnt < data->size())
             {
-                { LogF(LogLevelTrace) << "HidDevReader::ReadDataApi: Not enough bytes read: " << readCnt << "."; }
+                { KMICKI_LOGF(LogLevelTrace) << "HidDevReader::ReadDataApi: Not enough bytes read: " << readCnt << "."; }
                 continue;
             }
 
@@ -60,7 +69,7 @@ namespace kmicki::hiddev
                 continue;
             }
 
-            Data.SendData();
+            SendFrame();
         }
     
         Log("HidDevReader::ReadDataApi: Closing HID device.",LogLevelDebug);
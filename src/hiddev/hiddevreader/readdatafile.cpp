@@ -14,6 +14,11 @@ namespace kmicki::hiddev
     : inputFile(_inputFilePath,cFileScanTimeToTimeout*_scanTimeUs,false), ReadData(_frameLen*HidDevReader::cInputRecordLen)
     { }
 
+    HidDevReader::ReadDataFile::~ReadDataFile()
+    {
+        Stop();
+    }
+
     void HidDevReader::ReadDataFile::ReconnectInput()
     {
         DisconnectInput();
@@ -41,6 +46,7 @@ namespace kmicki::hiddev
         int missedTicks = 0;
         int nonMissedTicks = 0;
 
+        inputFile.SetWakeFd(GetStopFd());
         ReconnectInput();
         if(!inputFile.IsOpen())
         {
@@ -59,6 +65,7 @@ namespace kmicki::hiddev
                 break;
 
             auto readCnt = inputFile.Read(*data);
+            data->Timestamp = GetMonotonicTimestamp();
 
             if(readCnt == 0)
             {
@@ -71,14 +78,14 @@ namespace kmicki::hiddev
 
             HandleMissedTicks("HidDevReader::ReadData","HID frames",Data.WasReceived(),missedTicks,cReportMissedTicksPeriod,nonMissedTicks);
 
-            Data.SendData();
+            SendFrame();
         }
 
         DisconnectInput();
         Log("HidDevReader::ReadDataFile: Stopped.",LogLevelDebug);
     }
 
-    bool HidDevReader::ReadDataFile::CheckData(std::unique_ptr<std::vector<char>> const& data, ssize_t readCnt)
+    bool HidDevReader::ReadDataFile::CheckData(std::unique_ptr<frame_t> const& data, ssize_t readCnt)
     {
         static const uint32_t cFirst4Bytes = 0xFFFF0002;
         static const uint32_t cFirst4BytesAlternative = 0xFFFF0001;
@@ -111,7 +118,7 @@ namespace kmicki::hiddev
             // Failed to read a frame
             // or start in the middle of the input frame
             ReconnectInput();
-            Unsynced.SendSignal();
+            ReportUnsynced();
             return false;
         }
         return true;
@@ -0,0 +1,158 @@
+#include "hiddev/hiddevreader.h"
+#include "hiddev/hidrawdev.h"
+#include "hiddev/hiddevfinder.h"
+#include "log/log.h"
+
+using namespace kmicki::log;
+
+namespace kmicki::hiddev
+{
+    static const int cRawScanTimeToTimeout = 2;
+    // Period of reopen attempts while device is gone (in case hotplug event is missed or unavailable)
+    static const int cReopenDelayMs = 500;
+
+    // Definition - ReadDataRaw
+    HidDevReader::ReadDataRaw::ReadDataRaw(uint16_t const& _vId, uint16_t const& _pId, const int& _interfaceNumber, int const& _frameLen, int const& _scanTimeUs, std::string const& _serial)
+    : ReadData(_frameLen, _serial.empty() ? 0 : hiddev::GetDeviceId(_serial)), vId(_vId), pId(_pId), interfaceNumber(_interfaceNumber), scanTimeUs(_scanTimeUs), serial(_serial),
+      devicePath(), wake(), noGyro(nullptr), hotplug(nullptr)
+    { }
+
+    HidDevReader::ReadDataRaw::~ReadDataRaw()
+    {
+        Stop();
+    }
+
+    void HidDevReader::ReadDataRaw::SetNoGyro(SignalOut &_noGyro)
+    {
+        noGyro = &_noGyro;
+        noGyro->SetEventFd(&wake);
+    }
+
+    void HidDevReader::ReadDataRaw::SetHotplugSource(HotplugSource* _hotplug)
+    {
+        hotplug = _hotplug;
+    }
+
+    void HidDevReader::ReadDataRaw::SetDevicePath(std::string const& _path)
+    {
+        devicePath = _path;
+    }
+
+    void HidDevReader::ReadDataRaw::HandleHotplug(HidRawDev & dev)
+    {
+        if(hotplug == nullptr)
+            return;
+
+        HotplugEvent event;
+        while(hotplug->TryEvent(event))
+        {
+            if(event.action == HotplugAction::Add)
+            {
+                { KMICKI_LOGF(LogLevelDebug) << "HidDevReader::ReadDataRaw: HID device " << event.devName << " connected."; }
+                continue;
+            }
+
+            if(dev.IsOpen() && event.devName == dev.GetPath())
+            {
+                { LogF() << "HidDevReader::ReadDataRaw: HID device " << event.devName << " removed. Waiting for it to come back..."; }
+                dev.Close();
+                ReportDisconnected();
+            }
+        }
+    }
+
+    void HidDevReader::ReadDataRaw::EnableGyro(HidRawDev & dev)
+    {
+        if(noGyro && noGyro->TrySignal())
+        {
+            Log("HidDevReader::ReadDataRaw: Try reenabling gyro.",LogLevelTrace);
+            if(dev.EnableGyro())
+            {
+                Log("HidDevReader::ReadDataRaw: Gyro reenabled.",LogLevelDebug);
+                ReportGyroReenabled();
+            }
+            else
+                Log("HidDevReader::ReadDataRaw: Gyro reenaling failed.");
+        }
+    }
+ 
+    void HidDevReader::ReadDataRaw::Execute()
+    {
+        HidRawDev dev(vId,pId,interfaceNumber,cRawScanTimeToTimeout*scanTimeUs,serial);
+        dev.SetPath(devicePath);
+        dev.AddWakeFd(wake.GetFd());
+        dev.AddWakeFd(GetStopFd());
+        if(hotplug != nullptr)
+            dev.AddWakeFd(hotplug->GetFd());
+        
+        Log("HidDevReader::ReadDataRaw: Opening HID device.",LogLevelDebug);
+        if(dev.Open())
+        {
+            { KMICKI_LOGF(LogLevelDebug) << "HidDevReader::ReadDataRaw: Opened " << dev.GetPath() << "."; }
+            ReportConnected();
+        }
+        else
+            Log("HidDevReader::ReadDataRaw: HID device not available. Waiting for it to be connected...");
+
+        // Reports are read straight into the buffer that is sent further
+        auto const& data = Data.GetPointerToFill();
+
+        Log("HidDevReader::ReadDataRaw: Started.",LogLevelDebug);
+
+        while(ShouldContinue())
+        {
+            if(!dev.IsOpen())
+            {
+                // Paused until device comes back (hotplug event) or next periodic attempt.
+                dev.Wait(cReopenDelayMs);
+                wake.Clear();
+                HandleHotplug(dev);
+                if(ShouldContinue() && dev.Open())
+                {
+                    { KMICKI_LOGF(LogLevelDebug) << "HidDevReader::ReadDataRaw: Opened " << dev.GetPath() << "."; }
+                    ReportConnected();
+                }
+                continue;
+            }
+
+            auto readCnt = dev.Read(*data);
+            data->Timestamp = GetMonotonicTimestamp();
+
+            if(readCnt == 0)
+            {
+                bool woken = wake.Clear();
+                HandleHotplug(dev);
+
+                if(!woken)
+                {
+                    Log("HidDevReader::ReadDataRaw: Waiting for data timed out.",LogLevelTrace);
+                    continue;
+                }
+
+                EnableGyro(dev);
+                continue;
+            }
+
+            if(readCnt < 0)
+            {
+                Log("HidDevReader::ReadDataRaw: Reading from HID device failed. Waiting for it to come back...");
+                dev.Close();
+                ReportDisconnected();
+                continue;
+            }
+
+            if(readCnt < (int)data->size())
+            {
+                { KMICKI_LOGF(LogLevelTrace) << "HidDevReader::ReadDataRaw: Not enough bytes read: " << readCnt << "."; }
+                continue;
+            }
+
+            SendFrame();
+        }
+    
+        Log("HidDevReader::ReadDataRaw: Closing HID device.",LogLevelDebug);
+        dev.Close();
+        
+        Log("HidDevReader::ReadDataRaw: Stopped.",LogLevelDebug);
+    }
+}
@@ -0,0 +1,81 @@
+#include "hiddev/hiddevreader.h"
+#include "log/log.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace kmicki::log;
+
+namespace kmicki::hiddev
+{
+    // Definition - ReadDataReplay
+    HidDevReader::ReadDataReplay::ReadDataReplay(std::string const& _capturePath, int const& _frameLen, double const& _speed, bool const& _loop)
+    : ReadData(_frameLen, CaptureFile(_capturePath).GetDeviceId()), capture(_capturePath), speed(_speed), loop(_loop)
+    {
+        if(capture.GetFrameLen() != _frameLen)
+            throw std::runtime_error("HidDevReader::ReadDataReplay: Capture frame length doesn't match the reader's.");
+        { KMICKI_LOGF(LogLevelDebug) << "HidDevReader::ReadDataReplay: Capture " << _capturePath << " has " << capture.GetFrameCount() << " frames."; }
+    }
+
+    HidDevReader::ReadDataReplay::~ReadDataReplay()
+    {
+        Stop();
+    }
+
+    void HidDevReader::ReadDataReplay::Execute()
+    {
+        auto frameCount = capture.GetFrameCount();
+        if(frameCount == 0)
+        {
+            Log("HidDevReader::ReadDataReplay: Capture is empty.");
+            return;
+        }
+
+        auto const& data = Data.GetPointerToFill();
+        auto const firstTimestamp = capture.GetTimestamp(0);
+        auto const captureLen = capture.GetTimestamp(frameCount-1) - firstTimestamp;
+        // Place first frame of the next loop one average period after the last one
+        auto const loopLen = captureLen + ((frameCount > 1) ? captureLen/(frameCount-1) : 0);
+
+        auto & clock = pipeline::GetClock();
+        auto start = clock.Now();
+        uint64_t loopOffset = 0;
+        size_t i = 0;
+
+        Log("HidDevReader::ReadDataReplay: Started.",LogLevelDebug);
+
+        while(ShouldContinue())
+        {
+            if(i == frameCount)
+            {
+                if(!loop)
+                {
+                    Log("HidDevReader::ReadDataReplay: End of capture.");
+                    break;
+                }
+                i = 0;
+                loopOffset += loopLen;
+            }
+
+            if(speed > 0.0)
+            {
+                auto offsetUs = (double)(capture.GetTimestamp(i) - firstTimestamp + loopOffset)/speed;
+                if(!AdvanceTo(start + std::chrono::microseconds((int64_t)offsetUs)))
+                    break;
+            }
+
+            std::memcpy(data->data(),capture.GetFrame(i),data->size());
+            data->Timestamp = GetMonotonicTimestamp();
+            SendFrame();
+            ++i;
+
+            // As fast as possible, but not faster than frames are consumed (none is overwritten).
+            // Virtual clock moves on only after consumers are done with the frame,
+            // so they see the same frames at the same times on every run.
+            if((speed == 0.0 || clock.IsVirtual()) && !WaitUntilConsumed())
+                break;
+        }
+
+        Log("HidDevReader::ReadDataReplay: Stopped.",LogLevelDebug);
+    }
+}
@@ -0,0 +1,11 @@
+#include "hiddev/hidframe.h"
+#include "pipeline/clock.h"
+
+namespace kmicki::hiddev
+{
+    uint64_t GetMonotonicTimestamp()
+    {
+        auto now = pipeline::GetClock().Now().time_since_epoch();
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+}
@@ -0,0 +1,178 @@
+#include "hiddev/hidrawdev.h"
+#include "hiddev/hiddevfinder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include <stdexcept>
+#include <cerrno>
+
+namespace kmicki::hiddev
+{
+    static const int cMaxEvents = 4;
+
+    HidRawDev::HidRawDev(const uint16_t& _vId, const uint16_t _pId, const int& _interfaceNumber, int readTimeoutUs, std::string const& _serial)
+        : vId(_vId), pId(_pId), interfaceNumber(_interfaceNumber), timeout(readTimeoutUs/1000), serial(_serial),
+          fixedPath(), path(), dev(-1), epoll(epoll_create1(EPOLL_CLOEXEC))
+    { 
+        if(epoll < 0)
+            throw std::runtime_error("Error: epoll initialization failed.");
+    }
+
+    HidRawDev::~HidRawDev()
+    {
+        Close();
+        close(epoll);
+    }
+
+    bool HidRawDev::Open()
+    {
+        if(dev >= 0)
+            Close();
+
+        path = fixedPath.empty() ? FindHidRawPath(vId,pId,interfaceNumber,serial) : fixedPath;
+        if(path.empty())
+            return false;
+
+        dev = open(path.c_str(),O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(dev < 0)
+            return false;
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = dev;
+        if(epoll_ctl(epoll,EPOLL_CTL_ADD,dev,&event) < 0)
+        {
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    void HidRawDev::SetPath(std::string const& _path)
+    {
+        fixedPath = _path;
+    }
+
+    bool HidRawDev::Close()
+    {
+        if(dev >= 0)
+        {
+            epoll_ctl(epoll,EPOLL_CTL_DEL,dev,nullptr);
+            close(dev);
+        }
+        dev = -1;
+        return true;
+    }
+
+    bool HidRawDev::IsOpen()
+    {
+        return dev >= 0;
+    }
+
+    std::string const& HidRawDev::GetPath()
+    {
+        return path;
+    }
+
+    int HidRawDev::GetFd()
+    {
+        return dev;
+    }
+
+    bool HidRawDev::AddWakeFd(int fd)
+    {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(epoll,EPOLL_CTL_ADD,fd,&event) == 0;
+    }
+
+    bool HidRawDev::Wait(int timeoutMs)
+    {
+        epoll_event events[cMaxEvents];
+        int eventCnt;
+        while((eventCnt = epoll_wait(epoll,events,cMaxEvents,timeoutMs)) < 0 && errno == EINTR);
+        
+        for(int i = 0; i < eventCnt; ++i)
+            if(events[i].data.fd != dev)
+                return true;
+        return false;
+    }
+
+    int HidRawDev::Read(std::vector<char> & data)
+    {
+        if(dev < 0)
+            return 0;
+
+        // Reports are already waiting - no need to wait.
+        auto readCnt = read(dev,data.data(),data.size());
+        if(readCnt > 0)
+            return readCnt;
+        if(readCnt < 0 && errno != EAGAIN)
+            return -1;
+
+        epoll_event events[cMaxEvents];
+        int eventCnt;
+        while((eventCnt = epoll_wait(epoll,events,cMaxEvents,timeout)) < 0 && errno == EINTR);
+
+        if(eventCnt < 0)
+            return -1;
+
+        bool devReady = false;
+        for(int i = 0; i < eventCnt; ++i)
+            if(events[i].data.fd == dev)
+            {
+                if(events[i].events & (EPOLLERR | EPOLLHUP))
+                    return -1;
+                devReady = true;
+            }
+
+        if(!devReady)
+            return 0; // timeout or woken
+
+        readCnt = read(dev,data.data(),data.size());
+        if(readCnt < 0)
+            return (errno == EAGAIN) ? 0 : -1;
+        return readCnt;
+    }
+
+    int HidRawDev::TryRead(std::vector<char> & data)
+    {
+        if(dev < 0)
+            return -1;
+
+        auto readCnt = read(dev,data.data(),data.size());
+        if(readCnt < 0)
+            return (errno == EAGAIN) ? 0 : -1;
+        return readCnt;
+    }
+
+    bool HidRawDev::Write(std::vector<unsigned char> & data)
+    {
+        if(dev < 0)
+            return false;
+
+        // Same as hidapi's hid_write on hidraw backend: output report, first byte is report ID.
+        auto writeCnt = write(dev,data.data(),data.size());
+        if(writeCnt == (ssize_t)data.size())
+            return true;
+
+        // Fall back to feature report
+        return ioctl(dev,HIDIOCSFEATURE(data.size()),data.data()) >= 0;
+    }
+
+    bool HidRawDev::EnableGyro()
+    {                              
+        std::vector<unsigned char> cmd = {   0x00
+                                    , 0x87, 0x0f, 0x30, 0x18, 0x00, 0x07, 0x07, 0x00, 0x08, 0x07, 0x00, 0x31, 0x02, 0x00, 0x18, 0x00
+                                    , 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+                                    , 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+                                    , 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+        return Write(cmd);
+    }
+}
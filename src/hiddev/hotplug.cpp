@@ -0,0 +1,42 @@
+#include "hiddev/hotplug.h"
+
+namespace kmicki::hiddev
+{
+    // Definition - HotplugSource
+
+    HotplugSource::~HotplugSource()
+    { }
+
+    // Definition - ManualHotplugSource
+
+    ManualHotplugSource::ManualHotplugSource()
+    : signal(), pendingMutex(), pending()
+    { }
+
+    void ManualHotplugSource::Push(HotplugEvent const& event)
+    {
+        {
+            std::lock_guard lock(pendingMutex);
+            pending.push_back(event);
+        }
+        signal.Signal();
+    }
+
+    int ManualHotplugSource::GetFd()
+    {
+        return signal.GetFd();
+    }
+
+    bool ManualHotplugSource::TryEvent(HotplugEvent & event)
+    {
+        std::lock_guard lock(pendingMutex);
+        if(pending.empty())
+        {
+            signal.Clear();
+            return false;
+        }
+        event = pending.front();
+        pending.pop_front();
+        return true;
+    }
+}
@@ -1,44 +1,411 @@
 #include "log/log.h"
-#include <iostream>
-#include <mutex>
+#include "pipeline/futex.h"
+#include "pipeline/threadrings.h"
+
+#define SD_JOURNAL_SUPPRESS_LOCATION
+#include <systemd/sd-journal.h>
+#include <syslog.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace kmicki::pipeline;
 
 namespace kmicki::log
 {
-    LogLevel currentLogType = LogLevelDefault;
+    std::atomic<LogLevel> currentLogType = LogLevelDefault;
+
+    static const int cRingLen = 64;                 // Messages queued per thread
+    static const int cWriterIdleTimeoutMs = 1000;   // Writer rechecks rings at least that often
+
+    struct LogRecord
+    {
+        uint64_t timestamp;     // CLOCK_MONOTONIC in microseconds
+        LogLevel level;
+        uint16_t len;
+        char text[cMaxMessageLen];
+    };
+
+    // Messages of a single thread.
+    // Single producer (the thread) and single consumer (the writer).
+    struct ThreadRing : ThreadRingBase
+    {
+        ThreadRing() : head(0), tail(0), dropped(0), droppedReported(0) { }
+
+        std::array<LogRecord,cRingLen> records;
+        std::atomic<uint32_t> head;     // Next record to be written by the thread
+        std::atomic<uint32_t> tail;     // Next record to be read by the writer
+        std::atomic<uint64_t> dropped;  // Messages lost because ring was full
+        uint64_t droppedReported;       // Used by the writer only
+    };
+
+    static char const* GetLevelName(LogLevel level)
+    {
+        switch(level)
+        {
+            case LogLevelDefault:
+                return "default";
+            case LogLevelDebug:
+                return "debug";
+            case LogLevelTrace:
+                return "trace";
+            default:
+                return "none";
+        }
+    }
+
+    static int GetPriority(LogLevel level)
+    {
+        return (level <= LogLevelDefault) ? LOG_INFO : LOG_DEBUG;
+    }
+
+    static LogOutput GetDefaultOutput()
+    {
+        if(const char* output = std::getenv("SDMOTION_LOG_OUTPUT"))
+        {
+            if(std::strcmp(output, "journal") == 0)
+                return LogOutput::Journal;
+            return (std::strcmp(output, "stderr") == 0) ? LogOutput::Stderr : LogOutput::Stdout;
+        }
+
+        // Stdout connected to journald: JOURNAL_STREAM=<device>:<inode>
+        if(const char* stream = std::getenv("JOURNAL_STREAM"))
+        {
+            unsigned long long device, inode;
+            struct stat status;
+            if(std::sscanf(stream, "%llu:%llu", &device, &inode) == 2 && fstat(STDOUT_FILENO, &status) == 0
+               && status.st_dev == device && status.st_ino == inode)
+                return LogOutput::Journal;
+        }
+        return LogOutput::Stdout;
+    }
+
+    static void WriteOut(LogOutput output, LogLevel level, uint64_t timestamp, pid_t tid, char const* threadName, 
+                         char const* text, int len)
+    {
+        if(output == LogOutput::Journal)
+            sd_journal_send("MESSAGE=%.*s", len, text,
+                            "PRIORITY=%i", GetPriority(level),
+                            "SYSLOG_IDENTIFIER=sdmotion",
+                            "TID=%i", (int)tid,
+                            "SDMOTION_THREAD=%s", threadName,
+                            "SDMOTION_LEVEL=%s", GetLevelName(level),
+                            "SDMOTION_MONOTONIC_USEC=%llu", (unsigned long long)timestamp,
+                            nullptr);
+        else
+        {
+            FILE * stream = (output == LogOutput::Stderr) ? stderr : stdout;
+            std::fwrite(text, 1, len, stream);
+            std::fputc('\n', stream);
+        }
+    }
+
+    // Writes queued messages of all threads from a background thread.
+    class LogWriter
+    {
+        public:
+        LogWriter();
+        ~LogWriter();
+
+        ThreadRing & GetRing();
+        void Notify();
+        void Flush();
+        void SetOutput(LogOutput _output);
+        LogOutput GetOutput();
+
+        private:
+        ThreadRings<ThreadRing> rings;
+
+        std::atomic<uint32_t> wakeSequence;
+        std::atomic<bool> sleeping;
+        std::atomic<bool> stop;
+        std::atomic<LogOutput> output;
+        std::thread thread;
+
+        struct Pending
+        {
+            ThreadRing * ring;
+            LogRecord const* record;
+        };
+
+        void Run();
+        // Write all queued messages. Returns false if there were none.
+        bool Drain(std::vector<std::shared_ptr<ThreadRing>> & current, std::vector<Pending> & pending);
+    };
+
+    // False before the writer is created and after it is destroyed (messages are written directly then).
+    static std::atomic<bool> writerAlive(false);
+
+    static LogWriter & GetWriter()
+    {
+        static LogWriter writer;
+        return writer;
+    }
+
+    LogWriter::LogWriter()
+    : rings(), wakeSequence(0), sleeping(false), stop(false), output(GetDefaultOutput())
+    {
+        thread = std::thread(&LogWriter::Run, this);
+        writerAlive = true;
+    }
+
+    LogWriter::~LogWriter()
+    {
+        writerAlive = false;
+        stop = true;
+        Notify();
+        FutexWakeAll(wakeSequence);
+        thread.join();
+    }
+
+    ThreadRing & LogWriter::GetRing()
+    {
+        return rings.Get();
+    }
+
+    void LogWriter::Notify()
+    {
+        wakeSequence.fetch_add(1);
+        if(sleeping.load())
+            FutexWake(wakeSequence);
+    }
+
+    void LogWriter::SetOutput(LogOutput _output)
+    {
+        output = _output;
+    }
+
+    LogOutput LogWriter::GetOutput()
+    {
+        return output;
+    }
+
+    void LogWriter::Flush()
+    {
+        std::vector<std::shared_ptr<ThreadRing>> current;
+        rings.GetAll(current);
+        std::vector<std::pair<std::shared_ptr<ThreadRing>,uint32_t>> targets;
+        for(auto const& ring : current)
+            targets.emplace_back(ring, ring->head.load(std::memory_order_acquire));
+        Notify();
+        for(auto const& target : targets)
+            while((int32_t)(target.second - target.first->tail.load(std::memory_order_acquire)) > 0 && writerAlive)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool LogWriter::Drain(std::vector<std::shared_ptr<ThreadRing>> & current, std::vector<Pending> & pending)
+    {
+        // Forget rings of exited threads once they are empty
+        rings.ForgetOrphaned([](ThreadRing const& ring)
+            {
+                return ring.tail.load(std::memory_order_relaxed) == ring.head.load(std::memory_order_acquire);
+            });
+        rings.GetAll(current);
+
+        pending.clear();
+        std::vector<uint32_t> heads;
+        heads.reserve(current.size());
+        for(auto const& ring : current)
+        {
+            auto head = ring->head.load(std::memory_order_acquire);
+            heads.push_back(head);
+            for(auto i = ring->tail.load(std::memory_order_relaxed); i != head; ++i)
+                pending.push_back({ ring.get(), &ring->records[i % cRingLen] });
+        }
+
+        bool dropped = false;
+        for(auto const& ring : current)
+            dropped |= ring->dropped.load(std::memory_order_relaxed) != ring->droppedReported;
+
+        if(pending.empty() && !dropped)
+            return false;
+
+        // Interleave threads in order of logging
+        std::stable_sort(pending.begin(), pending.end(), [](Pending const& a, Pending const& b)
+            {
+                return a.record->timestamp < b.record->timestamp;
+            });
+
+        auto out = output.load();
+        for(auto const& message : pending)
+            WriteOut(out, message.record->level, message.record->timestamp, message.ring->tid, message.ring->name,
+                     message.record->text, message.record->len);
+
+        for(auto const& ring : current)
+        {
+            auto droppedNow = ring->dropped.load(std::memory_order_relaxed);
+            if(droppedNow != ring->droppedReported)
+            {
+                char text[128];
+                int len = std::snprintf(text, sizeof(text), "Log: Dropped %llu messages of thread %s (%d).",
+                                        (unsigned long long)(droppedNow - ring->droppedReported), ring->name, (int)ring->tid);
+                WriteOut(out, LogLevelDefault, GetRingTimestamp() / 1000, ring->tid, ring->name, text, len);
+                ring->droppedReported = droppedNow;
+            }
+        }
+        std::fflush(stdout);
+
+        // Release records only after they were written
+        for(size_t i = 0; i < current.size(); ++i)
+            current[i]->tail.store(heads[i], std::memory_order_release);
+
+        return true;
+    }
+
+    void LogWriter::Run()
+    {
+        pthread_setname_np(pthread_self(), "sdm-log");
+
+        std::vector<std::shared_ptr<ThreadRing>> current;
+        std::vector<Pending> pending;
+        pending.reserve(cRingLen * 8);
+
+        while(true)
+        {
+            auto sequence = wakeSequence.load();
+            if(Drain(current, pending))
+                continue;
+            if(stop)
+                break;
+
+            sleeping = true;
+            if(wakeSequence.load() == sequence && !stop)
+                FutexWaitUntil(wakeSequence, sequence, 
+                               std::chrono::steady_clock::now() + std::chrono::milliseconds(cWriterIdleTimeoutMs));
+            sleeping = false;
+        }
+        current.clear();
+    }
+
+    void WriteLog(std::string_view message, LogLevel type)
+    {
+        auto len = (uint16_t)std::min(message.size(), (size_t)cMaxMessageLen);
+
+        auto & writer = GetWriter();
+        if(!writerAlive)
+        {
+            // Logging during shutdown of static objects
+            WriteOut(LogOutput::Stdout, type, GetRingTimestamp() / 1000, gettid(), "", message.data(), len);
+            std::fflush(stdout);
+            return;
+        }
+
+        auto & ring = writer.GetRing();
+
+        auto head = ring.head.load(std::memory_order_relaxed);
+        if(head - ring.tail.load(std::memory_order_acquire) >= cRingLen)
+        {
+            ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            writer.Notify();
+            return;
+        }
+
+        auto & record = ring.records[head % cRingLen];
+        record.timestamp = GetRingTimestamp() / 1000;
+        record.level = type;
+        record.len = len;
+        std::memcpy(record.text, message.data(), len);
+        ring.head.store(head + 1, std::memory_order_release);
+
+        writer.Notify();
+    }
+
+    void FlushLog()
+    {
+        if(writerAlive)
+            GetWriter().Flush();
+    }
 
     void SetLogLevel(LogLevel type)
     {
         currentLogType = type;
     }
+
+    void SetLogLevelFromEnv(LogLevel defaultType)
+    {
+        auto type = defaultType;
+        if(const char* level = std::getenv("SDMOTION_LOG_LEVEL"))
+        {
+            std::string name(level);
+            if(name == "none" || name == "0")
+                type = LogLevelNone;
+            else if(name == "default" || name == "1")
+                type = LogLevelDefault;
+            else if(name == "debug" || name == "2")
+                type = LogLevelDebug;
+            else if(name == "trace" || name == "3")
+                type = LogLevelTrace;
+        }
+        SetLogLevel(type);
+    }
     
-    LogLevel const& GetLogLevel()
+    LogLevel GetLogLevel()
     {
         return currentLogType;
     }
 
-    void Log(std::string message,LogLevel type)
+    void SetLogOutput(LogOutput output)
     {
-        if(type > currentLogType)
-            return;
+        GetWriter().SetOutput(output);
+    }
+
+    // Definition - FixedStreamBuf
+
+    FixedStreamBuf::FixedStreamBuf(char * buffer, size_t _size)
+    : begin(buffer), size(_size)
+    {
+        Reset();
+    }
 
-        static std::mutex logMutex;
-        std::lock_guard lock(logMutex);
-        std::cout << message << std::endl;
+    std::string_view FixedStreamBuf::View() const
+    {
+        return std::string_view(pbase(), pptr() - pbase());
     }
 
+    void FixedStreamBuf::Reset()
+    {
+        setp(begin, begin + size);
+    }
+
+    FixedStreamBuf::int_type FixedStreamBuf::overflow(int_type c)
+    {
+        // Buffer is full - drop the rest of the message
+        return traits_type::not_eof(c);
+    }
+
+    // Definition - LogF
+
+    LogF::Stream::Stream(char * buffer, size_t size)
+    : buf(buffer, size), out(&buf)
+    { }
+
     LogF::LogF(LogLevel type)
-    : std::ostringstream(), logType(type)
-    {};
+    : logType(type), stream()
+    {
+        if(IsLogEnabled(type))
+            stream.emplace(text, sizeof(text));
+    }
 
     LogF::~LogF()
     {
-        Log(str(),logType);
+        if(stream)
+            WriteLog(stream->buf.View(), logType);
     }
 
     void LogF::LogNow()
     {
-        Log(str(),logType);
-        std::ostringstream newStream;
-        swap(newStream);
+        if(!stream)
+            return;
+        WriteLog(stream->buf.View(), logType);
+        stream->buf.Reset();
     }
-}
\ No newline at end of file
+}
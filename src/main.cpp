@@ -1,33 +1,58 @@
 #include "hiddev/hiddevreader.h"
 #include "hiddev/hiddevfinder.h"
+#include "hiddev/capturewriter.h"
 #include "sdgyrodsu/sdhidframe.h"
 #include "sdgyrodsu/motionadapter.h"
 #include "motion/jsonserver.h"
+#include "motion/reactor.h"
+#include "motion/simulation.h"
+#include "pipeline/clock.h"
+#include "pipeline/eventfd.h"
+#include "metrics/metricsserver.h"
+#include "trace/trace.h"
+#include "trace/tracedumper.h"
 #include "log/log.h"
 #include <iostream>
+#include <fstream>
 #include <future>
 #include <thread>
 #include <csignal>
+#include <cstdlib>
+#include <algorithm>
+#include <poll.h>
 
 using namespace kmicki::sdgyrodsu;
 using namespace kmicki::hiddev;
 using namespace kmicki::log;
 using namespace kmicki::motion;
 
-const LogLevel cLogLevel = LogLevelDebug;
+const LogLevel cLogLevel = LogLevelDefault;  // Overridden by SDMOTION_LOG_LEVEL
 const bool cUseHiddevFile = false;
+const bool cUseHidRaw = true;   // Read /dev/hidrawX directly instead of through HIDAPI
 
 const int cFrameLen = 64;       // Steam Deck Controls' custom HID report length in bytes
 const int cScanTimeUs = 4000;   // Steam Deck Controls' period between received report data in microseconds
 const uint16_t cVID = 0x28de;   // Steam Deck Controls' USB Vendor-ID
 const uint16_t cPID = 0x1205;   // Steam Deck Controls' USB Product-ID
 const int cInterfaceNumber = 2; // Steam Deck Controls' USB Interface Number
+const int cRescanPeriodMs = 2000;   // Period of looking for new controllers when hotplug events are unavailable
 
 const std::string cVersion = "3.0-motion";   // Release version
 
 bool stop = false;
-std::mutex stopMutex = std::mutex();
-std::condition_variable stopCV = std::condition_variable();
+kmicki::pipeline::EventFd stopEvent;
+
+// Set while the service runs in single-threaded reactor mode.
+Reactor * reactor = nullptr;
+
+// SIGUSR1 - dump trace, SIGUSR2 - switch tracing on/off.
+void TraceSignalHandler(int signal)
+{
+    if(signal == SIGUSR1)
+        kmicki::trace::RequestDump();
+    else
+        kmicki::trace::SetEnabled(!kmicki::trace::IsEnabled());
+}
 
 void SignalHandler(int signal)
 {
@@ -56,27 +81,248 @@ void SignalHandler(int signal)
         msg << ". Stopping...";
     }
 
-    {
-        std::lock_guard lock(stopMutex);
-        stop = true;
-    }
-    stopCV.notify_all();
+    if(reactor != nullptr)
+        reactor->Stop();
+
+    stop = true;
+    stopEvent.Signal();
+}
+
+void PrintUsage(char const* name)
+{
+    std::cerr << "Usage: " << name << " [--replay <capture> [--speed <x>] [--loop] [--virtual-clock]] [--record <capture>] [--reactor]" << std::endl
+              << "       " << name << " --simulate <capture> [--output <file>]" << std::endl
+              << "  --replay <capture>  Play back frames from a capture file instead of reading the device." << std::endl
+              << "  --speed <x>         Playback speed relative to real time (default 1). 0 plays as fast as possible." << std::endl
+              << "  --loop              Start playback over at the end of the capture." << std::endl
+              << "  --virtual-clock     Run the pipeline on time of the capture instead of real time:" << std::endl
+              << "                      playback is as fast as frames are processed, timestamps are kept." << std::endl
+              << "                      Clients get the same packets on every run." << std::endl
+              << "  --simulate <capture> Convert and send whole capture on a virtual clock and exit." << std::endl
+              << "                      Motion data is written as JSON lines instead of sent over UDP." << std::endl
+              << "                      Output is the same on every run." << std::endl
+              << "  --output <file>     Output of --simulate (default: standard output)." << std::endl
+              << "  --record <capture>  Record all frames read to a capture file." << std::endl
+              << "  --reactor           Run whole service in a single thread (hidraw input only)." << std::endl
+              << "                      Also enabled by SDMOTION_REACTOR=1 environment variable." << std::endl;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    std::string replayPath;
+    std::string recordPath;
+    double replaySpeed = 1.0;
+    bool replayLoop = false;
+    bool useReactor = false;
+    bool useVirtualClock = false;
+    std::string simulatePath;
+    std::string outputPath;
+
+    if(const char* reactorEnv = std::getenv("SDMOTION_REACTOR"))
+        useReactor = std::string(reactorEnv) == "1";
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(arg == "--replay" && i+1 < argc)
+            replayPath = argv[++i];
+        else if(arg == "--speed" && i+1 < argc)
+            replaySpeed = std::atof(argv[++i]);
+        else if(arg == "--loop")
+            replayLoop = true;
+        else if(arg == "--record" && i+1 < argc)
+            recordPath = argv[++i];
+        else if(arg == "--reactor")
+            useReactor = true;
+        else if(arg == "--virtual-clock")
+            useVirtualClock = true;
+        else if(arg == "--simulate" && i+1 < argc)
+            simulatePath = argv[++i];
+        else if(arg == "--output" && i+1 < argc)
+            outputPath = argv[++i];
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(replaySpeed < 0.0 || (useReactor && (!replayPath.empty() || !recordPath.empty() || !cUseHidRaw))
+       || (useVirtualClock && replayPath.empty())
+       || (!simulatePath.empty() && (useReactor || !replayPath.empty() || !recordPath.empty()))
+       || (!outputPath.empty() && simulatePath.empty()))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
 
     stop = false;
-    SetLogLevel(cLogLevel);
+    SetLogLevelFromEnv(cLogLevel);
+    if(!simulatePath.empty() && outputPath.empty())
+        SetLogOutput(LogOutput::Stderr);    // Standard output carries motion data
 
     { LogF() << "SteamDeck Motion Service Version: " << cVersion; }
+
+    if(!simulatePath.empty())
+    {
+        { LogF() << "Simulating service on frames from " << simulatePath << "."; }
+        try
+        {
+            Simulation simulation(simulatePath, cFrameLen);
+            if(outputPath.empty())
+                simulation.Run(std::cout);
+            else
+            {
+                std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+                if(!output)
+                    throw std::runtime_error("Could not open " + outputPath + ".");
+                simulation.Run(output);
+            }
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            FlushLog();
+            return 1;
+        }
+        FlushLog();
+        return 0;
+    }
+
     { LogF() << "Serving JSON motion data over UDP"; }
 
-    std::unique_ptr<HidDevReader> readerPtr;
+    kmicki::pipeline::LockMemoryFromEnv();
+
+    // Time of replayed capture when requested (must outlive all threads using it)
+    std::unique_ptr<kmicki::pipeline::VirtualClock> virtualClock;
+    std::unique_ptr<kmicki::pipeline::ScopedClock> scopedClock;
+
+    std::unique_ptr<kmicki::trace::TraceDumper> traceDumper(kmicki::trace::TraceDumper::FromEnv());
+    if(traceDumper)
+    {
+        signal(SIGUSR1, TraceSignalHandler);
+        signal(SIGUSR2, TraceSignalHandler);
+    }
 
-    if(cUseHiddevFile)
+    std::unique_ptr<kmicki::metrics::MetricsServer> metricsServer;
+    auto metricsPath = kmicki::metrics::MetricsServer::GetPathFromEnv();
+    if(!metricsPath.empty())
+    {
+        try
+        {
+            metricsServer.reset(new kmicki::metrics::MetricsServer(metricsPath));
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            Log("Metrics will not be served.");
+        }
+    }
+
+    if(useReactor)
+    {
+        Log("Running in single-threaded reactor mode.");
+        try
+        {
+            Reactor service(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs);
+            auto devices = FindHidRawDevices(cVID, cPID, cInterfaceNumber);
+            for(auto const& device : devices)
+            {
+                { LogF() << "Found Steam Deck Controls at " << device.path << " (serial: " << device.serial 
+                         << ", device ID: " << device.id << ")."; }
+                service.AddDevice(device.id, device.serial);
+            }
+            if(devices.empty())
+                Log("Steam Deck Controls not found. Waiting for them to be connected...");
+
+            reactor = &service;
+            if(!stop)
+            {
+                Log("Motion service started. Press Ctrl+C to stop.");
+                service.Run();
+            }
+            reactor = nullptr;
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            return 1;
+        }
+
+        Log("SteamDeck Motion Service exiting.");
+        return 0;
+    }
+
+    if(useVirtualClock)
+    {
+        Log("Running on virtual clock.");
+        // Starts at time of the capture, so that timestamps are the same on every run
+        std::chrono::steady_clock::time_point start;
+        try
+        {
+            CaptureFile capture(replayPath);
+            if(capture.GetFrameCount() > 0)
+                start += std::chrono::microseconds(capture.GetTimestamp(0));
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            return 1;
+        }
+        virtualClock.reset(new kmicki::pipeline::VirtualClock(start));
+        scopedClock.reset(new kmicki::pipeline::ScopedClock(*virtualClock));
+    }
+
+    // One reader and adapter per controller
+    std::vector<std::unique_ptr<HidDevReader>> readers;
+    std::vector<std::unique_ptr<kmicki::sdgyrodsu::MotionAdapter>> adapters;
+    kmicki::motion::JsonServer server(std::vector<kmicki::sdgyrodsu::MotionAdapter*> {});
+
+    auto addController = [&](HidDevReader * reader, uint32_t const& deviceId)
+    {
+        readers.emplace_back(reader);
+        // Set frame start marker for Steam Deck HID frames
+        reader->SetStartMarker({ 0x01, 0x00, 0x09, 0x40 });
+        adapters.emplace_back(new kmicki::sdgyrodsu::MotionAdapter(*reader, deviceId));
+        reader->SetNoGyro(adapters.back()->NoGyro);
+        server.AddMotionSource(*adapters.back());
+    };
+
+    // Controllers of hidraw input are looked up by serial, also when they are connected later
+    bool findControllers = false;
+    std::vector<std::string> serials;
+    std::unique_ptr<HotplugSource> hotplug;
+    auto addNewControllers = [&]()
+    {
+        for(auto const& device : FindHidRawDevices(cVID, cPID, cInterfaceNumber))
+        {
+            if(std::find(serials.begin(), serials.end(), device.serial) != serials.end())
+                continue;
+            { LogF() << "Found Steam Deck Controls at " << device.path << " (serial: " << device.serial 
+                     << ", device ID: " << device.id << ")."; }
+            serials.push_back(device.serial);
+            addController(new HidDevReader(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs, true, device.serial), device.id);
+        }
+    };
+
+    if(!replayPath.empty())
+    {
+        { LogF() << "Replaying frames from " << replayPath << "."; }
+        try
+        {
+            auto* reader = new HidDevReader(replayPath, cFrameLen, replaySpeed, replayLoop);
+            addController(reader, reader->GetDeviceId());
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            return 1;
+        }
+    }
+    else if(cUseHiddevFile)
     {
         int hidno = FindHidDevNo(cVID, cPID);
         if(hidno < 0) 
@@ -87,34 +333,72 @@ int main()
 
         { LogF() << "Found Steam Deck Controls' HID device at /dev/usb/hiddev" << hidno; }
         
-        readerPtr.reset(new HidDevReader(hidno, cFrameLen, cScanTimeUs));
+        addController(new HidDevReader(hidno, cFrameLen, cScanTimeUs), 0);
+    }
+    else if(cUseHidRaw)
+    {
+        Log("Using hidraw for Steam Deck Controls access.");
+        findControllers = true;
+        try
+        {
+            hotplug.reset(new UdevHotplugSource(cVID, cPID, cInterfaceNumber));
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            { LogF() << "Hotplug events unavailable. Looking for new controllers every " << cRescanPeriodMs << " ms."; }
+        }
+
+        addNewControllers();
+        if(readers.empty())
+            Log("Steam Deck Controls not found. Waiting for them to be connected...");
     }
     else
     {
         Log("Using HIDAPI for Steam Deck Controls access.");
-        readerPtr.reset(new HidDevReader(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs));
+        addController(new HidDevReader(cVID, cPID, cInterfaceNumber, cFrameLen, cScanTimeUs, false), 0);
     }
 
-    HidDevReader &reader = *readerPtr;
-
-    // Set frame start marker for Steam Deck HID frames
-    reader.SetStartMarker({ 0x01, 0x00, 0x09, 0x40 });
-
-    // Create motion adapter and server
-    kmicki::sdgyrodsu::MotionAdapter adapter(reader);
-    reader.SetNoGyro(adapter.NoGyro);
-    
-    kmicki::motion::JsonServer server(adapter);
+    std::unique_ptr<CaptureWriter> recorder;
+    if(!recordPath.empty())
+    {
+        try
+        {
+            if(readers.empty())
+                throw std::runtime_error("Steam Deck Controls not found. Nothing to record.");
+            if(readers.size() > 1)
+                Log("Recording frames of the first controller only.");
+            recorder.reset(new CaptureWriter(*readers.front(), recordPath));
+            recorder->StartCapture();
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            return 1;
+        }
+    }
 
     Log("Motion service started. Press Ctrl+C to stop.");
 
-    // Wait for stop signal
+    // Wait for stop signal. Controllers connected in the meantime get their own pipelines.
+    while(!stop)
     {
-        std::unique_lock lock(stopMutex);
-        stopCV.wait(lock, []{ return stop; });
+        pollfd fds[2] = { { stopEvent.GetFd(), POLLIN, 0 }, { hotplug ? hotplug->GetFd() : -1, POLLIN, 0 } };
+        int eventCnt = poll(fds, 2, (findControllers && !hotplug) ? cRescanPeriodMs : -1);
+        if(eventCnt < 0 || (fds[0].revents & POLLIN) || !findControllers)
+            continue;
+
+        bool added = !hotplug;
+        HotplugEvent event;
+        while(hotplug && hotplug->TryEvent(event))
+            if(event.action == HotplugAction::Add)
+                added = true;
+        if(added)
+            addNewControllers();
     }
 
     Log("SteamDeck Motion Service exiting.");
+    FlushLog();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "metrics/metrics.h"
+#include "hiddev/hidframe.h"
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+namespace kmicki::metrics
+{
+    Labels DeviceLabels(uint32_t const& deviceId)
+    {
+        return Labels { { "device", std::to_string(deviceId) } };
+    }
+
+    // Definition - Metric
+
+    Metric::Metric(std::string const& _name, std::string const& _help, Labels const& _labels)
+    : name(_name), help(_help), labels(_labels)
+    { }
+
+    Metric::~Metric()
+    { }
+
+    void Metric::Register()
+    {
+        Registry::Get().Add(this);
+    }
+
+    void Metric::Unregister()
+    {
+        Registry::Get().Remove(this);
+    }
+
+    Sample Metric::MakeSample(MetricType type, double value) const
+    {
+        return Sample { name, name, help, type, labels, value };
+    }
+
+    // Definition - Counter
+
+    Counter::Counter(std::string const& _name, std::string const& _help, Labels const& _labels)
+    : Metric(_name, _help, _labels), value(0)
+    {
+        Register();
+    }
+
+    Counter::~Counter()
+    {
+        Unregister();
+    }
+
+    void Counter::Increment(uint64_t const& count)
+    {
+        // Single writer - plain load/store is enough and avoids locked instructions.
+        value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    uint64_t Counter::Get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    void Counter::Collect(std::vector<Sample> & samples) const
+    {
+        samples.push_back(MakeSample(MetricType::Counter, (double)Get()));
+    }
+
+    // Definition - Gauge
+
+    Gauge::Gauge(std::string const& _name, std::string const& _help, Labels const& _labels)
+    : Metric(_name, _help, _labels), value(0.0)
+    {
+        Register();
+    }
+
+    Gauge::~Gauge()
+    {
+        Unregister();
+    }
+
+    void Gauge::Set(double const& _value)
+    {
+        value.store(_value, std::memory_order_relaxed);
+    }
+
+    double Gauge::Get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    void Gauge::Collect(std::vector<Sample> & samples) const
+    {
+        samples.push_back(MakeSample(MetricType::Gauge, Get()));
+    }
+
+    // Definition - StageSummary
+
+    static Labels WithLabel(Labels labels, std::string const& key, std::string const& value)
+    {
+        labels.emplace_back(key, value);
+        return labels;
+    }
+
+    StageSummary::StageSummary(std::string const& stage, pipeline::StageStats const& _stats, Labels const& _labels)
+    : Metric("sdmotion_stage", "Timing of frames at a pipeline stage boundary", WithLabel(_labels, "stage", stage)),
+      stats(_stats)
+    {
+        Register();
+    }
+
+    StageSummary::~StageSummary()
+    {
+        Unregister();
+    }
+
+    static void CollectHistogram(std::vector<Sample> & samples, std::string const& family, std::string const& help,
+                                 Labels const& labels, pipeline::Histogram const& histogram)
+    {
+        static const std::pair<double,char const*> cQuantiles[] = { { 0.5, "0.5" }, { 0.99, "0.99" }, { 0.999, "0.999" } };
+        static const double cNsToS = 1e-9;
+
+        auto snapshot = histogram.Read();
+        for(auto const& quantile : cQuantiles)
+            samples.push_back(Sample { family, family, help, MetricType::Summary, WithLabel(labels, "quantile", quantile.second), 
+                                       snapshot.GetPercentile(quantile.first) * cNsToS });
+        samples.push_back(Sample { family, family + "_sum", help, MetricType::Summary, labels, snapshot.sum * cNsToS });
+        samples.push_back(Sample { family, family + "_count", help, MetricType::Summary, labels, (double)snapshot.count });
+    }
+
+    void StageSummary::Collect(std::vector<Sample> & samples) const
+    {
+        CollectHistogram(samples, name + "_latency_seconds", "Time since the frame was read from the device", labels, stats.GetLatency());
+        CollectHistogram(samples, name + "_interval_seconds", "Time between consecutive frames", labels, stats.GetInterval());
+    }
+
+    // Definition - Registry
+
+    Registry & Registry::Get()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    void Registry::Add(Metric * metric)
+    {
+        std::lock_guard lock(metricsMutex);
+        metrics.push_back(metric);
+    }
+
+    void Registry::Remove(Metric * metric)
+    {
+        std::lock_guard lock(metricsMutex);
+        metrics.erase(std::remove(metrics.begin(), metrics.end(), metric), metrics.end());
+    }
+
+    std::vector<Sample> Registry::Collect()
+    {
+        std::vector<Sample> samples;
+        {
+            std::lock_guard lock(metricsMutex);
+            for(auto metric : metrics)
+                metric->Collect(samples);
+        }
+        std::stable_sort(samples.begin(), samples.end(), 
+                         [](Sample const& a, Sample const& b) { return a.family < b.family; });
+        return samples;
+    }
+
+    // Definition - formats
+
+    static char const* GetTypeName(MetricType type)
+    {
+        switch(type)
+        {
+            case MetricType::Counter:
+                return "counter";
+            case MetricType::Gauge:
+                return "gauge";
+            default:
+                return "summary";
+        }
+    }
+
+    static void WriteLabelValue(std::ostream & out, std::string const& value)
+    {
+        for(auto c : value)
+        {
+            if(c == '\\' || c == '"')
+                out << '\\' << c;
+            else if(c == '\n')
+                out << "\\n";
+            else
+                out << c;
+        }
+    }
+
+    std::string FormatPrometheus(std::vector<Sample> const& samples)
+    {
+        std::ostringstream out;
+        out.precision(17);
+        std::string family;
+        for(auto const& sample : samples)
+        {
+            if(sample.family != family)
+            {
+                family = sample.family;
+                out << "# HELP " << family << " " << sample.help << "\n"
+                    << "# TYPE " << family << " " << GetTypeName(sample.type) << "\n";
+            }
+            out << sample.name;
+            if(!sample.labels.empty())
+            {
+                out << "{";
+                for(size_t i = 0; i < sample.labels.size(); ++i)
+                {
+                    if(i > 0)
+                        out << ",";
+                    out << sample.labels[i].first << "=\"";
+                    WriteLabelValue(out, sample.labels[i].second);
+                    out << "\"";
+                }
+                out << "}";
+            }
+            out << " " << sample.value << "\n";
+        }
+        return out.str();
+    }
+
+    template<class T>
+    static void Append(std::string & out, T const& value)
+    {
+        out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+    }
+
+    static void AppendString(std::string & out, std::string const& value)
+    {
+        Append(out, (uint16_t)value.size());
+        out.append(value);
+    }
+
+    std::string FormatBinary(std::vector<Sample> const& samples)
+    {
+        std::string out;
+        out.append(cBinaryMagic, sizeof(cBinaryMagic));
+        Append(out, cBinaryVersion);
+        Append(out, (uint32_t)samples.size());
+        Append(out, (uint64_t)hiddev::GetMonotonicTimestamp());
+        for(auto const& sample : samples)
+        {
+            Append(out, (uint8_t)sample.type);
+            AppendString(out, sample.name);
+            Append(out, (uint16_t)sample.labels.size());
+            for(auto const& label : sample.labels)
+            {
+                AppendString(out, label.first);
+                AppendString(out, label.second);
+            }
+            Append(out, sample.value);
+        }
+        return out;
+    }
+}
@@ -0,0 +1,147 @@
+#include "metrics/metricsserver.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+using namespace kmicki::log;
+
+namespace kmicki::metrics
+{
+    static const int cRequestTimeoutMs = 1000;
+    static const int cMaxRequestLen = 1024;
+
+    MetricsServer::MetricsServer(std::string const& _path)
+    : path(_path), listenFd(-1)
+    {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("MetricsServer: Socket path is too long.");
+        std::strcpy(address.sun_path, path.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd < 0)
+            throw std::runtime_error("MetricsServer: Socket could not be created.");
+
+        unlink(path.c_str());
+        if(bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, 4) < 0)
+        {
+            close(listenFd);
+            throw std::runtime_error("MetricsServer: Could not listen on " + path + ".");
+        }
+
+        SetConfig(pipeline::ThreadConfig::FromEnv("METRICS"));
+        { LogF() << "MetricsServer: Serving metrics at " << path << "."; }
+        Start();
+    }
+
+    MetricsServer::~MetricsServer()
+    {
+        Stop();
+        close(listenFd);
+        unlink(path.c_str());
+    }
+
+    std::string MetricsServer::GetPathFromEnv()
+    {
+        if(const char* socketPath = std::getenv("SDMOTION_METRICS_SOCKET"))
+            return socketPath;
+        return std::string();
+    }
+
+    void MetricsServer::FlushPipes()
+    { }
+
+    void MetricsServer::Execute()
+    {
+        while(ShouldContinue())
+        {
+            pollfd fds[2] = { { listenFd, POLLIN, 0 }, { GetStopFd(), POLLIN, 0 } };
+            if(poll(fds, 2, -1) <= 0 || !(fds[0].revents & POLLIN))
+                continue;
+
+            int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(clientFd < 0)
+                continue;
+            HandleClient(clientFd);
+            close(clientFd);
+        }
+    }
+
+    // Wait until fd is ready for events (or stop/timeout). Returns false if it isn't.
+    static bool WaitFor(int fd, short events, int stopFd)
+    {
+        pollfd fds[2] = { { fd, events, 0 }, { stopFd, POLLIN, 0 } };
+        return poll(fds, 2, cRequestTimeoutMs) > 0 && (fds[0].revents & (events | POLLHUP | POLLERR));
+    }
+
+    void MetricsServer::HandleClient(int clientFd)
+    {
+        // Read request line
+        std::string request;
+        char buf[256];
+        while(request.find('\n') == std::string::npos && request.size() < cMaxRequestLen)
+        {
+            // No complete request line in time - serve the default
+            if(!WaitFor(clientFd, POLLIN, GetStopFd()))
+                break;
+            auto readCnt = recv(clientFd, buf, sizeof(buf), 0);
+            if(readCnt < 0 && errno == EAGAIN)
+                continue;
+            if(readCnt <= 0)
+                break;
+            request.append(buf, readCnt);
+        }
+        request = request.substr(0, request.find_first_of("\r\n"));
+
+        bool http = request.rfind("GET ", 0) == 0;
+        bool binary = false;
+        std::string response;
+        if(http)
+        {
+            auto target = request.substr(4, request.find(' ', 4) - 4);
+            if(target == "/metrics" || target == "/")
+                binary = false;
+            else if(target == "/snapshot")
+                binary = true;
+            else
+                response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        }
+        else
+            binary = request == "binary";
+
+        if(response.empty())
+        {
+            auto samples = Registry::Get().Collect();
+            auto body = binary ? FormatBinary(samples) : FormatPrometheus(samples);
+            if(http)
+                response = std::string("HTTP/1.0 200 OK\r\nContent-Type: ")
+                         + (binary ? "application/octet-stream" : "text/plain; version=0.0.4")
+                         + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+            response += body;
+        }
+
+        size_t sent = 0;
+        while(sent < response.size())
+        {
+            auto sendCnt = send(clientFd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if(sendCnt < 0 && errno == EAGAIN)
+            {
+                if(!WaitFor(clientFd, POLLOUT, GetStopFd()))
+                    return;
+                continue;
+            }
+            if(sendCnt <= 0)
+                return;
+            sent += sendCnt;
+        }
+    }
+}
@@ -0,0 +1,201 @@
+#include "motion/clientregistry.h"
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace kmicki::motion
+{
+    // Definition - ClientAddress
+
+    ClientAddress::ClientAddress()
+    : storage(), length(0)
+    { }
+
+    ClientAddress::ClientAddress(sockaddr const* address, socklen_t const& addressLength)
+    : storage(), length(0)
+    {
+        if(address->sa_family == AF_INET && addressLength >= (socklen_t)sizeof(sockaddr_in))
+        {
+            auto const& in = *(sockaddr_in const*)address;
+            auto & out = *(sockaddr_in*)&storage;
+            out.sin_family = AF_INET;
+            out.sin_port = in.sin_port;
+            out.sin_addr = in.sin_addr;
+            length = sizeof(sockaddr_in);
+        }
+        else if(address->sa_family == AF_INET6 && addressLength >= (socklen_t)sizeof(sockaddr_in6))
+        {
+            auto const& in = *(sockaddr_in6 const*)address;
+            auto & out = *(sockaddr_in6*)&storage;
+            out.sin6_family = AF_INET6;
+            out.sin6_port = in.sin6_port;
+            out.sin6_addr = in.sin6_addr;
+            out.sin6_scope_id = in.sin6_scope_id;
+            length = sizeof(sockaddr_in6);
+        }
+    }
+
+    sockaddr const* ClientAddress::Get() const
+    {
+        return (sockaddr const*)&storage;
+    }
+
+    std::string ClientAddress::ToString() const
+    {
+        char ipStr[INET6_ADDRSTRLEN];
+        ipStr[0] = 0;
+        if(storage.ss_family == AF_INET)
+        {
+            auto const& in = *(sockaddr_in const*)&storage;
+            inet_ntop(AF_INET, &in.sin_addr, ipStr, sizeof(ipStr));
+            return std::string(ipStr) + ":" + std::to_string(ntohs(in.sin_port));
+        }
+        if(storage.ss_family == AF_INET6)
+        {
+            auto const& in = *(sockaddr_in6 const*)&storage;
+            if(IN6_IS_ADDR_V4MAPPED(&in.sin6_addr))
+            {
+                inet_ntop(AF_INET, &in.sin6_addr.s6_addr[12], ipStr, sizeof(ipStr));
+                return std::string(ipStr) + ":" + std::to_string(ntohs(in.sin6_port));
+            }
+            inet_ntop(AF_INET6, &in.sin6_addr, ipStr, sizeof(ipStr));
+            return "[" + std::string(ipStr) + "]:" + std::to_string(ntohs(in.sin6_port));
+        }
+        return "(unknown)";
+    }
+
+    bool ClientAddress::operator==(ClientAddress const& other) const
+    {
+        return length == other.length && std::memcmp(&storage, &other.storage, length) == 0;
+    }
+
+    size_t ClientAddressHash::operator()(ClientAddress const& address) const
+    {
+        return std::hash<std::string_view>()(std::string_view((char const*)&address.storage, address.length));
+    }
+
+    // Definition - ClientRegistry
+
+    ClientRegistry::ClientRegistry(std::chrono::seconds const& _timeout)
+    : timeout(_timeout), registrationsMutex(), registrations(), changed(false),
+      // One revolution is longer than timeout, so a client is scheduled in its own slot
+      wheel(_timeout.count() + 2), due(), wheelSecond(ToSecond(std::chrono::steady_clock::now())),
+      published(), generation(0), count(0)
+    { }
+
+    int64_t ClientRegistry::ToSecond(time_point const& time)
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+    }
+
+    void ClientRegistry::Schedule(Registrations::value_type & registration, time_point const& time)
+    {
+        // Never in a slot already passed
+        auto second = std::max(ToSecond(time), wheelSecond + 1);
+        wheel[second % wheel.size()].push_back(&registration);
+    }
+
+    ClientRegistry::Change ClientRegistry::Register(ClientAddress const& address, Subscription const& subscription, time_point const& now)
+    {
+        std::lock_guard lock(registrationsMutex);
+
+        auto registration = registrations.find(address);
+        if(registration != registrations.end())
+        {
+            registration->second.lastSeen = now;
+            if(registration->second.subscription == subscription)
+                return Change::None;
+            registration->second.subscription = subscription;
+            changed = true;
+            return Change::Subscription;
+        }
+
+        auto added = registrations.emplace(address, Registration { subscription, now }).first;
+        Schedule(*added, now + timeout);
+        changed = true;
+        return Change::Added;
+    }
+
+    size_t ClientRegistry::Expire(time_point const& now)
+    {
+        std::lock_guard lock(registrationsMutex);
+
+        auto nowSecond = ToSecond(now);
+        // Every slot once at most
+        auto second = std::max(wheelSecond, nowSecond - (int64_t)wheel.size());
+        size_t removed = 0;
+        while(second < nowSecond)
+        {
+            ++second;
+            // Swap keeps capacity of both vectors
+            due.clear();
+            due.swap(wheel[second % wheel.size()]);
+            wheelSecond = second;
+            for(auto registration : due)
+            {
+                auto deadline = registration->second.lastSeen + timeout;
+                if(deadline <= now)
+                {
+                    registrations.erase(registrations.find(registration->first));
+                    ++removed;
+                }
+                else
+                    Schedule(*registration, deadline);  // Seen since it was scheduled
+            }
+        }
+
+        if(removed > 0)
+            changed = true;
+        return removed;
+    }
+
+    void ClientRegistry::Publish()
+    {
+        std::lock_guard lock(registrationsMutex);
+
+        if(changed)
+        {
+            std::unique_ptr<Clients> clients(new Clients());
+            clients->generation = ++generation;
+            clients->clients.reserve(registrations.size());
+            for(auto const& registration : registrations)
+            {
+                auto const& subscription = registration.second.subscription;
+                auto encoding = std::find_if(clients->encodings.begin(), clients->encodings.end(), 
+                                             [&](Subscription const& other) { return other.SameEncoding(subscription); });
+                if(encoding == clients->encodings.end())
+                    encoding = clients->encodings.insert(encoding, subscription);
+                clients->clients.push_back({ registration.first, subscription, (size_t)(encoding - clients->encodings.begin()) });
+            }
+            published.Publish(std::move(clients));
+            count = registrations.size();
+            changed = false;
+        }
+        else
+            published.Reclaim();
+    }
+
+    ClientRegistry::Clients const& ClientRegistry::GetClients() const
+    {
+        return published.Get();
+    }
+
+    size_t ClientRegistry::GetCount() const
+    {
+        return count.load();
+    }
+
+    // Definition - ClientRegistry::Reader
+
+    ClientRegistry::Reader::Reader(ClientRegistry & registry)
+    : reader(registry.published)
+    { }
+
+    ClientRegistry::Clients const& ClientRegistry::Reader::Load()
+    {
+        return reader.Load();
+    }
+}
@@ -1,41 +1,27 @@
 #include "motion/jsonserver.h"
 #include "motion/simplemotion.h"
+#include "motion/sendtick.h"
 #include "sdgyrodsu/motionadapter.h"
 #include "log/log.h"
+#include "pipeline/threadconfig.h"
+#include "pipeline/clock.h"
 
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <arpa/inet.h>
+#include <poll.h>
 #include <stdexcept>
-#include <unistd.h>
-#include <iostream>
-#include <algorithm>
-#include <cstdlib>
-#include <shared_mutex>
 
 using namespace kmicki::sdgyrodsu;
 using namespace kmicki::log;
 
 namespace kmicki::motion
 {
-    const std::chrono::seconds JsonServer::cClientTimeout(30);
-
-    const char * GetIP(sockaddr_in const& addr, char *buf)
-    {
-        return inet_ntop(addr.sin_family, &(addr.sin_addr.s_addr), buf, INET6_ADDRSTRLEN);
-    }
-
     JsonServer::JsonServer(kmicki::sdgyrodsu::MotionAdapter & _motionSource)
-        : motionSource(_motionSource), stop(false), serverThread(), stopSending(false),
-          mainMutex(), stopSendMutex(), socketSendMutex(), socketFd(-1)
+        : JsonServer(std::vector<kmicki::sdgyrodsu::MotionAdapter*> { &_motionSource })
+    { }
+
+    JsonServer::JsonServer(std::vector<kmicki::sdgyrodsu::MotionAdapter*> const& _motionSources)
+        : motionSources(_motionSources), motionSourcesAdded(false), stop(false), serverThread(), stopSending(false),
+          mainMutex(), stopSendMutex()
     {
-        // Check for custom port
-        if (const char* customPort = std::getenv("SDMOTION_SERVER_PORT")) {
-            broadcastPort = std::atoi(customPort);
-        } else {
-            broadcastPort = cDefaultPort;
-        }
-        
         Start();
     }
     
@@ -47,10 +33,39 @@ namespace kmicki::motion
                 std::lock_guard lock(mainMutex);
                 stop = true;
             }
+            stopEvent.Signal();
             serverThread.get()->join();
         }
-        if(socketFd > -1)
-            close(socketFd);
+    }
+
+    void JsonServer::AddMotionSource(kmicki::sdgyrodsu::MotionAdapter & motionSource)
+    {
+        {
+            std::lock_guard lock(motionSourcesMutex);
+            motionSources.push_back(&motionSource);
+        }
+        motionSourcesAdded.store(true);
+    }
+
+    void JsonServer::takeMotionSources(std::vector<kmicki::sdgyrodsu::MotionAdapter*> & sources)
+    {
+        motionSourcesAdded.store(false);
+        std::lock_guard lock(motionSourcesMutex);
+        for(size_t i = sources.size(); i < motionSources.size(); ++i)
+        {
+            sources.push_back(motionSources[i]);
+            motionSources[i]->StartFrameGrab();
+        }
+    }
+
+    pipeline::StageStats const& JsonServer::GetSerializeStats()
+    {
+        return socket->GetSerializeStats();
+    }
+
+    pipeline::StageStats const& JsonServer::GetSendStats()
+    {
+        return socket->GetSendStats();
     }
 
     void JsonServer::Start() 
@@ -62,47 +77,23 @@ namespace kmicki::motion
                 std::lock_guard lock(mainMutex);
                 stop = true;
             }
+            stopEvent.Signal();
             serverThread.get()->join();
             serverThread.reset();
         }
 
-        socketFd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-
-        timeval read_timeout;
-        read_timeout.tv_sec = 2;
-        read_timeout.tv_usec = 0;
-        setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof(read_timeout));
-
-        if(socketFd == -1)
-            throw std::runtime_error("JsonServer: Socket could not be created.");
-        
-        sockaddr_in sockInServer;
-        sockInServer = sockaddr_in();
-        sockInServer.sin_family = AF_INET;
-        sockInServer.sin_port = htons(broadcastPort);
-        sockInServer.sin_addr.s_addr = INADDR_ANY;
-
-        if(bind(socketFd, (sockaddr*)&sockInServer, sizeof(sockInServer)) < 0)
-            throw std::runtime_error("JsonServer: Bind failed.");
-
-        char ipStr[INET6_ADDRSTRLEN];
-        ipStr[0] = 0;
-        { LogF() << "JsonServer: Socket created at IP: " << GetIP(sockInServer, ipStr) 
-                 << " Port: " << ntohs(sockInServer.sin_port) << "."; }
+        socket.reset();
+        socket.reset(new MotionSocket(cSendRateHz));
 
         stop = false;
+        stopEvent.Clear();
         serverThread.reset(new std::thread(&JsonServer::serverTask, this));
         Log("JsonServer: Initialized.", LogLevelDebug);
     }
 
     void JsonServer::serverTask()
     {
-        char buf[512];
-        sockaddr_in sockInClient;
-        socklen_t sockInLen = sizeof(sockInClient);
-
         std::unique_ptr<std::thread> sendThread;
-        char ipStr[INET6_ADDRSTRLEN];
 
         Log("JsonServer: Start listening for clients.");
         
@@ -111,140 +102,102 @@ namespace kmicki::motion
         {
             mainLock.unlock();
             
-            // Listen for any UDP packet to register clients
-            auto recvLen = recvfrom(socketFd, buf, sizeof(buf), 0, (sockaddr*)&sockInClient, &sockInLen);
-            
-            if(recvLen > 0)
+            // Listen for any UDP packet to register clients (or for stop)
+            pollfd fds[2] = { { socket->GetFd(), POLLIN, 0 }, { stopEvent.GetFd(), POLLIN, 0 } };
+            if(poll(fds, 2, cCleanupPeriodMs) > 0 && (fds[0].revents & POLLIN) 
+               && socket->ReceiveRegistrations() > 0)
             {
-                std::ostringstream addressTextStream;
-                addressTextStream << "IP: " << GetIP(sockInClient, ipStr) << " Port: " << ntohs(sockInClient.sin_port);
-                auto addressText = addressTextStream.str();
-                
-                { LogF(LogLevelTrace) << "JsonServer: Client registration from " << addressText; }
-                
-                AddClient(sockInClient);
-                
                 // Start sending thread if not already running
                 if(sendThread.get() == nullptr)
                 {
                     stopSending = false;
+                    stopSendEvent.Clear();
                     sendThread.reset(new std::thread(&JsonServer::sendTask, this));
                     Log("JsonServer: Started sending motion data.");
                 }
             }
             
-            // Periodic cleanup of stale clients
-            RemoveStaleClients();
+            // Periodic cleanup of stale clients.
+            // Pause sending (and frame grabbing) when the last client is gone, same as Reactor.
+            socket->RemoveStaleClients();
+            if(sendThread.get() != nullptr && socket->GetClientCount() == 0)
+            {
+                stopSendTask(sendThread);
+                Log("JsonServer: Stopped sending motion data.");
+            }
             
             mainLock.lock();
         }
 
-        if(sendThread.get() != nullptr)
+        stopSendTask(sendThread);
+        Log("JsonServer: Stopped.");
+    }
+
+    void JsonServer::stopSendTask(std::unique_ptr<std::thread> & sendThread)
+    {
+        if(sendThread.get() == nullptr)
+            return;
+
+        Log("JsonServer: Stopping send thread...", LogLevelDebug);
         {
-            Log("JsonServer: Stopping send thread...", LogLevelDebug);
-            {
-                std::lock_guard lock(stopSendMutex);
-                stopSending = true;
-            }
-            sendThread.get()->join();
+            std::lock_guard lock(stopSendMutex);
+            stopSending = true;
         }
-        Log("JsonServer: Stopped.");
+        stopSendEvent.Signal();
+        sendThread.get()->join();
+        sendThread.reset();
     }
 
     void JsonServer::sendTask()
     {
+        pipeline::ApplyThreadConfig(pipeline::ThreadConfig::FromEnv("SEND"));
         Log("JsonServer: Initiating motion data streaming.", LogLevelDebug);
-        motionSource.StartFrameGrab();
-
         const auto sendInterval = std::chrono::microseconds(1000000 / cSendRateHz); // 60Hz
-        auto nextSend = std::chrono::steady_clock::now();
+        auto & clock = pipeline::GetClock();
+        auto nextSend = clock.Now();
+        // Ticks are driven by the clock from before the first frame is read
+        clock.Expect(nextSend);
+
+        std::vector<kmicki::sdgyrodsu::MotionAdapter*> sources;
+        takeMotionSources(sources);
 
         Log("JsonServer: Start broadcasting motion data.", LogLevelDebug);
 
         std::unique_lock mainLock(stopSendMutex);
 
+        SendTick sendTick(*socket, "JsonServer::Send");
+
         while(!stopSending)
         {
             mainLock.unlock();
+
+            // Controllers connected since the last tick
+            if(motionSourcesAdded.load(std::memory_order_relaxed))
+                takeMotionSources(sources);
             
-            SimpleMotionData motionData;
-            if(motionSource.GetMotionData(motionData))
+            // Motion data is converted at full rate by every motion source.
+            // Send the most recent one of each unless it was already sent.
+            for(size_t i = 0; i < sources.size(); ++i)
             {
-                BroadcastMotionData(motionData);
+                SimpleMotionData motionData;
+                if(sources[i]->GetMotionData(motionData))
+                    sendTick.Offer(i, motionData);
             }
+            sendTick.Send();
             
             // Rate limiting to 60Hz
             nextSend += sendInterval;
-            std::this_thread::sleep_until(nextSend);
+            clock.WaitUntil(nextSend, stopSendEvent);
             
             mainLock.lock();
         }
 
         Log("JsonServer: Stopping motion data streaming.", LogLevelDebug);
-        motionSource.StopFrameGrab();
+        clock.Forget();
+        for(auto motionSource : sources)
+            motionSource->StopFrameGrab();
+        { KMICKI_LOGF(LogLevelDebug) << "JsonServer: Serialize " << socket->GetSerializeStats().Describe(); }
+        { KMICKI_LOGF(LogLevelDebug) << "JsonServer: Send " << socket->GetSendStats().Describe(); }
         Log("JsonServer: Stop broadcasting motion data.", LogLevelDebug);
     }
-
-    void JsonServer::AddClient(const sockaddr_in& clientAddr)
-    {
-        std::lock_guard lock(clientsMutex);
-        
-        // Check if client already exists
-        auto client = std::find(clients.begin(), clients.end(), clientAddr);
-        if(client != clients.end())
-        {
-            // Update last seen time
-            client->lastSeen = std::chrono::steady_clock::now();
-        }
-        else
-        {
-            // Add new client
-            Client newClient;
-            newClient.address = clientAddr;
-            newClient.lastSeen = std::chrono::steady_clock::now();
-            clients.push_back(newClient);
-            
-            char ipStr[INET6_ADDRSTRLEN];
-            { LogF() << "JsonServer: New client registered: " 
-                     << GetIP(clientAddr, ipStr) << ":" << ntohs(clientAddr.sin_port); }
-        }
-    }
-
-    void JsonServer::RemoveStaleClients()
-    {
-        std::lock_guard lock(clientsMutex);
-        auto now = std::chrono::steady_clock::now();
-        
-        clients.erase(
-            std::remove_if(clients.begin(), clients.end(),
-                [now](const Client& client) {
-                    return (now - client.lastSeen) > cClientTimeout;
-                }),
-            clients.end()
-        );
-    }
-
-    void JsonServer::BroadcastMotionData(const SimpleMotionData& data)
-    {
-        std::string jsonData = ToJson(data);
-        
-        std::shared_lock lock(clientsMutex);
-        for(const auto& client : clients)
-        {
-            std::lock_guard socketLock(socketSendMutex);
-            sendto(socketFd, jsonData.c_str(), jsonData.length(), 0, 
-                   (sockaddr*)&client.address, sizeof(client.address));
-        }
-    }
-
-    bool JsonServer::Client::operator==(sockaddr_in const& other) const
-    {
-        return address.sin_addr.s_addr == other.sin_addr.s_addr
-            && address.sin_port == other.sin_port;
-    }
-
-    bool JsonServer::Client::operator!=(sockaddr_in const& other) const
-    {
-        return !(*this == other);
-    }
 }
\ No newline at end of file
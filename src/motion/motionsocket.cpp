@@ -0,0 +1,342 @@
+#include "motion/motionsocket.h"
+#include "log/log.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <stdexcept>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+
+using namespace kmicki::log;
+
+namespace kmicki::motion
+{
+    const std::chrono::seconds MotionSocket::cClientTimeout(30);
+
+    PacketSink::~PacketSink()
+    { }
+
+    MotionSocket::MotionSocket(PacketSink & _sink, int const& _sendRateHz)
+        : MotionSocket(&_sink, _sendRateHz)
+    { }
+
+    MotionSocket::MotionSocket(PacketSink * _sink, int const& _sendRateHz)
+        : sendRateHz(_sendRateHz), socketFd(-1), sink(_sink), registry(cClientTimeout), clientsReader(registry),
+      started(false), startTime(0), tick(0), lastTick(0), preparedGeneration(~0ULL), preparedCount(0), encodingsDue(), packetBuffers(), packets(), clientsDue(), clientMessages(), messages(),
+      serializeStats(), sendStats(),
+      serializeSummary("serialize", serializeStats), sendSummary("send", sendStats),
+      clientsMetric("sdmotion_clients", "Registered clients"),
+      encodingsMetric("sdmotion_client_encodings", "Distinct packet encodings serialized for clients"),
+      datagramsMetric("sdmotion_datagrams_sent_total", "Datagrams sent to clients"),
+      bytesMetric("sdmotion_bytes_sent_total", "Bytes sent to clients"),
+      sendErrorsMetric("sdmotion_send_errors_total", "Datagrams that could not be sent"),
+      batchesMetric("sdmotion_send_batches_total", "sendmmsg calls sending datagrams of a tick"),
+      partialBatchesMetric("sdmotion_send_partial_batches_total", "sendmmsg calls that sent only part of the datagrams")
+    { }
+
+    MotionSocket::MotionSocket(int const& _sendRateHz)
+        : MotionSocket(nullptr, _sendRateHz)
+    {
+        int port = cDefaultPort;
+        // Check for custom port
+        if (const char* customPort = std::getenv("SDMOTION_SERVER_PORT"))
+            port = std::atoi(customPort);
+
+        // Dual-stack IPv6 socket serves IPv4 clients too (as IPv4-mapped addresses)
+        sockaddr_in6 sockInServer6 = sockaddr_in6();
+        sockInServer6.sin6_family = AF_INET6;
+        sockInServer6.sin6_port = htons(port);
+        sockInServer6.sin6_addr = in6addr_any;
+        int v6Only = 0;
+
+        socketFd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+        if(socketFd > -1
+           && (setsockopt(socketFd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only)) < 0
+               || bind(socketFd, (sockaddr*)&sockInServer6, sizeof(sockInServer6)) < 0))
+        {
+            close(socketFd);
+            socketFd = -1;
+        }
+        if(socketFd > -1)
+        {
+            { LogF() << "MotionSocket: Socket created at IP: " << ClientAddress((sockaddr*)&sockInServer6, sizeof(sockInServer6)).ToString() << " (IPv4 and IPv6)."; }
+            return;
+        }
+
+        { LogF() << "MotionSocket: IPv6 socket could not be created. Falling back to IPv4."; }
+        socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+        if(socketFd == -1)
+            throw std::runtime_error("MotionSocket: Socket could not be created.");
+        
+        sockaddr_in sockInServer;
+        sockInServer = sockaddr_in();
+        sockInServer.sin_family = AF_INET;
+        sockInServer.sin_port = htons(port);
+        sockInServer.sin_addr.s_addr = INADDR_ANY;
+
+        if(bind(socketFd, (sockaddr*)&sockInServer, sizeof(sockInServer)) < 0)
+        {
+            close(socketFd);
+            throw std::runtime_error("MotionSocket: Bind failed.");
+        }
+
+        { LogF() << "MotionSocket: Socket created at IP: " << ClientAddress((sockaddr*)&sockInServer, sizeof(sockInServer)).ToString() << "."; }
+    }
+
+    MotionSocket::~MotionSocket()
+    {
+        if(socketFd > -1)
+            close(socketFd);
+    }
+
+    int MotionSocket::GetFd() const
+    {
+        return socketFd;
+    }
+
+    int MotionSocket::ReceiveRegistrations()
+    {
+        char buf[512];
+        sockaddr_storage sockInClient;
+        socklen_t sockInLen;
+        int received = 0;
+        auto now = std::chrono::steady_clock::now();
+
+        while(true)
+        {
+            sockInLen = sizeof(sockInClient);
+            auto recvLen = recvfrom(socketFd, buf, sizeof(buf), MSG_DONTWAIT, (sockaddr*)&sockInClient, &sockInLen);
+            if(recvLen < 0)
+                break;
+            ++received;
+
+            ClientAddress address((sockaddr*)&sockInClient, sockInLen);
+            { KMICKI_LOGF(LogLevelTrace) << "MotionSocket: Client registration from " << address.ToString(); }
+            RegisterClient(address, Subscription::Parse(buf, recvLen, sendRateHz), now);
+        }
+
+        if(received > 0)
+            PublishClients();
+        return received;
+    }
+
+    void MotionSocket::Register(ClientAddress const& address, Subscription const& subscription)
+    {
+        RegisterClient(address, subscription, std::chrono::steady_clock::now());
+        PublishClients();
+    }
+
+    void MotionSocket::RegisterClient(ClientAddress const& address, Subscription const& subscription, std::chrono::steady_clock::time_point const& now)
+    {
+        switch(registry.Register(address, subscription, now))
+        {
+            case ClientRegistry::Change::Added:
+                { LogF() << "MotionSocket: New client registered: " << address.ToString()
+                         << " (" << subscription.Describe() << ")"; }
+                break;
+            case ClientRegistry::Change::Subscription:
+                { LogF() << "MotionSocket: Client " << address.ToString()
+                         << " changed subscription to: " << subscription.Describe(); }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void MotionSocket::RemoveStaleClients()
+    {
+        auto removed = registry.Expire(std::chrono::steady_clock::now());
+        if(removed > 0)
+            { KMICKI_LOGF(LogLevelDebug) << "MotionSocket: Removed " << removed << " stale clients."; }
+        PublishClients();
+    }
+
+    void MotionSocket::PublishClients()
+    {
+        registry.Publish();
+        auto const& clients = registry.GetClients();
+        clientsMetric.Set(clients.clients.size());
+        encodingsMetric.Set(clients.encodings.size());
+    }
+
+    size_t MotionSocket::GetClientCount()
+    {
+        return registry.GetCount();
+    }
+
+    uint64_t MotionSocket::GetSlot(int const& rateHz) const
+    {
+        return (tick*rateHz)/sendRateHz;
+    }
+
+    bool MotionSocket::IsDue(int const& rateHz) const
+    {
+        // Spread ticks of lower rates evenly: due when tick*rate/sendRate moved to the next integer
+        // since the previous call
+        return rateHz >= sendRateHz || GetSlot(rateHz) != (lastTick*rateHz)/sendRateHz;
+    }
+
+    void MotionSocket::Send(SimpleMotionData const& data)
+    {
+        Send(&data, 1);
+    }
+
+    void MotionSocket::PrepareMessages(ClientRegistry::Clients const& clients, size_t const& count)
+    {
+        preparedGeneration = clients.generation;
+        preparedCount = std::max(preparedCount, count);
+        auto encodingCount = clients.encodings.size();
+        auto clientCount = clients.clients.size();
+
+        if(packetBuffers.size() < preparedCount * encodingCount * cMaxPacketLen)
+            packetBuffers.resize(preparedCount * encodingCount * cMaxPacketLen);
+        if(packets.size() < preparedCount * encodingCount)
+            packets.resize(preparedCount * encodingCount);
+        for(size_t packet = 0; packet < preparedCount * encodingCount; ++packet)
+            packets[packet] = { &packetBuffers[packet*cMaxPacketLen], 0 };
+
+        if(clientMessages.size() < preparedCount * clientCount)
+        {
+            clientMessages.resize(preparedCount * clientCount);
+            messages.resize(preparedCount * clientCount);
+        }
+        for(size_t m = 0; m < preparedCount; ++m)
+            for(size_t i = 0; i < clientCount; ++i)
+            {
+                auto const& client = clients.clients[i];
+                auto & message = clientMessages[m*clientCount + i];
+                message = mmsghdr();
+                message.msg_hdr.msg_name = (void*)client.address.Get();
+                message.msg_hdr.msg_namelen = client.address.length;
+                message.msg_hdr.msg_iov = &packets[m*encodingCount + client.encoding];
+                message.msg_hdr.msg_iovlen = 1;
+            }
+
+        if(clientsDue.size() < clientCount)
+            clientsDue.resize(clientCount);
+        if(encodingsDue.size() < encodingCount)
+            encodingsDue.resize(encodingCount);
+    }
+
+    void MotionSocket::Send(SimpleMotionData const* data, size_t const& count)
+    {
+        if(count == 0)
+            return;
+
+        // Tick nearest to the time of motion data on the grid of send ticks (first one is 1)
+        if(!started)
+        {
+            started = true;
+            startTime = data[0].timestamp;
+        }
+        lastTick = tick;
+        uint64_t sinceStart = (data[0].timestamp > startTime) ? data[0].timestamp - startTime : 0;
+        tick = 1 + (sinceStart*sendRateHz + 500000) / 1000000;
+
+        // Snapshot stays valid while registrations go on (until the next Send)
+        auto const& snapshot = clientsReader.Load();
+        if(snapshot.generation != preparedGeneration || count > preparedCount)
+            PrepareMessages(snapshot, count);
+        auto const& clients = snapshot.clients;
+        auto const& encodings = snapshot.encodings;
+
+        std::fill(encodingsDue.begin(), encodingsDue.begin() + encodings.size(), 0);
+        bool allDue = true;
+        for(size_t i = 0; i < clients.size(); ++i)
+        {
+            clientsDue[i] = IsDue(clients[i].subscription.rateHz);
+            if(clientsDue[i])
+                encodingsDue[clients[i].encoding] = 1;
+            else
+                allDue = false;
+        }
+
+        // Serialize once per encoding used by any client due
+        for(size_t m = 0; m < count; ++m)
+        {
+            for(size_t e = 0; e < encodings.size(); ++e)
+                if(encodingsDue[e])
+                {
+                    auto const& subscription = encodings[e];
+                    // Sequence of packets at the rate of the subscription
+                    uint32_t sequence = (uint32_t)GetSlot(subscription.rateHz);
+                    auto & packet = packets[m*encodings.size() + e];
+                    packet.iov_len = Encode(data[m], subscription, sequence, (char*)packet.iov_base);
+                }
+            serializeStats.Record(data[m].sensor_timestamp);
+        }
+
+        // Datagrams of clients due: prepared ones as they are when every client is due,
+        // otherwise copies of the due ones
+        mmsghdr * batchMessages = clientMessages.data();
+        size_t batch = count * clients.size();
+        if(!allDue)
+        {
+            batchMessages = messages.data();
+            batch = 0;
+            for(size_t m = 0; m < count; ++m)
+                for(size_t i = 0; i < clients.size(); ++i)
+                    if(clientsDue[i])
+                        messages[batch++] = clientMessages[m*clients.size() + i];
+        }
+
+        if(sink != nullptr)
+        {
+            uint64_t bytes = 0;
+            for(size_t i = 0; i < batch; ++i)
+            {
+                auto const& header = batchMessages[i].msg_hdr;
+                sink->Write((sockaddr const*)header.msg_name, header.msg_namelen, (char const*)header.msg_iov->iov_base, header.msg_iov->iov_len);
+                bytes += header.msg_iov->iov_len;
+            }
+            datagramsMetric.Increment(batch);
+            bytesMetric.Increment(bytes);
+        }
+
+        // sendmmsg stops at the first datagram that fails: count it and go on with the rest
+        size_t next = 0;
+        while(next < batch && sink == nullptr)
+        {
+            int sent = sendmmsg(socketFd, &batchMessages[next], batch - next, 0);
+            batchesMetric.Increment();
+            if(sent < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                auto const& address = *(sockaddr const*)batchMessages[next].msg_hdr.msg_name;
+                { KMICKI_LOGF(LogLevelTrace) << "MotionSocket: Sending to " << ClientAddress(&address, batchMessages[next].msg_hdr.msg_namelen).ToString() 
+                                             << " failed (errno " << errno << ")."; }
+                sendErrorsMetric.Increment();
+                ++next;
+                continue;
+            }
+            if(sent == 0)
+                break;
+
+            if(next + sent < batch)
+                partialBatchesMetric.Increment();
+            uint64_t bytes = 0;
+            for(size_t i = next; i < next + sent; ++i)
+                bytes += batchMessages[i].msg_len;
+            datagramsMetric.Increment(sent);
+            bytesMetric.Increment(bytes);
+            next += sent;
+        }
+
+        for(size_t m = 0; m < count; ++m)
+            sendStats.Record(data[m].sensor_timestamp);
+    }
+
+    pipeline::StageStats const& MotionSocket::GetSerializeStats()
+    {
+        return serializeStats;
+    }
+
+    pipeline::StageStats const& MotionSocket::GetSendStats()
+    {
+        return sendStats;
+    }
+}
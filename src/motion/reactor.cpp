@@ -0,0 +1,403 @@
+#include "motion/reactor.h"
+#include "hiddev/hiddevfinder.h"
+#include "log/log.h"
+#include "pipeline/threadconfig.h"
+#include "trace/trace.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+
+using namespace kmicki::log;
+using namespace kmicki::hiddev;
+
+namespace kmicki::motion
+{
+    static const int cMaxEvents = 16;
+    static const int cRawScanTimeToTimeout = 2;
+
+    // Tokens of non-device descriptors in epoll set. Devices use their index.
+    static const uint64_t cTokenSocket = ~0ULL;
+    static const uint64_t cTokenTimer = ~0ULL - 1;
+    static const uint64_t cTokenStop = ~0ULL - 2;
+    static const uint64_t cTokenHotplug = ~0ULL - 3;
+
+    Reactor::Device::Device(uint32_t const& _id, HidRawDev* _dev, int const& frameLen)
+    : id(_id), serial(), dev(_dev), noGyro(), converter(_id, noGyro), frame(), motion(), disconnectedAt(0), maxReconnectLatency(0),
+      readStats(), convertStats(),
+      readSummary("read", readStats, metrics::DeviceLabels(_id)),
+      convertSummary("convert", convertStats, metrics::DeviceLabels(_id)),
+      connectedMetric("sdmotion_device_connected", "Input device is open and being read", metrics::DeviceLabels(_id)),
+      disconnectsMetric("sdmotion_device_disconnects_total", "Times the input device was lost", metrics::DeviceLabels(_id)),
+      reconnectsMetric("sdmotion_device_reconnects_total", "Times the input device was reopened after being lost", metrics::DeviceLabels(_id)),
+      reconnectLatencyMetric("sdmotion_device_reconnect_latency_seconds", "Time from losing the input device to reopening it (last reconnect)", metrics::DeviceLabels(_id)),
+      maxReconnectLatencyMetric("sdmotion_device_reconnect_latency_max_seconds", "Longest time from losing the input device to reopening it", metrics::DeviceLabels(_id)),
+      gyroReenablesMetric("sdmotion_gyro_reenables_total", "Times the gyro was reenabled after it stopped reporting", metrics::DeviceLabels(_id))
+    {
+        frame.resize(frameLen);
+    }
+
+    Reactor::Reactor(uint16_t const& _vId, uint16_t const& _pId, int const& _interfaceNumber, int const& _frameLen, int const& _scanTimeUs)
+    : vId(_vId), pId(_pId), interfaceNumber(_interfaceNumber), frameLen(_frameLen), scanTimeUs(_scanTimeUs),
+      epoll(-1), timer(-1), stopEvent(), stop(false), active(false), socket(cSendRateHz), sendTick(socket, "Reactor::Send"), hotplug(), devices()
+    {
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        if(epoll < 0)
+            throw std::runtime_error("Reactor: epoll initialization failed.");
+
+        timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timer < 0)
+        {
+            close(epoll);
+            throw std::runtime_error("Reactor: Send timer could not be created.");
+        }
+
+        try
+        {
+            hotplug.reset(new UdevHotplugSource(vId, pId, interfaceNumber));
+        }
+        catch(std::runtime_error const& e)
+        {
+            Log(e.what());
+            Log("Reactor: Hotplug events unavailable. Lost device will be reopened and new controllers looked for periodically.");
+        }
+
+        Watch(socket.GetFd(), cTokenSocket);
+        Watch(timer, cTokenTimer);
+        Watch(stopEvent.GetFd(), cTokenStop);
+        if(hotplug)
+            Watch(hotplug->GetFd(), cTokenHotplug);
+
+        Log("Reactor: Initialized.", LogLevelDebug);
+    }
+
+    Reactor::~Reactor()
+    {
+        for(size_t i = 0; i < devices.size(); ++i)
+            CloseDevice(i);
+        close(timer);
+        close(epoll);
+    }
+
+    void Reactor::AddDevice(uint32_t const& deviceId, std::string const& serial, std::string const& path)
+    {
+        auto* dev = new HidRawDev(vId, pId, interfaceNumber, cRawScanTimeToTimeout*scanTimeUs, serial);
+        dev->SetPath(path);
+        devices.emplace_back(new Device(deviceId, dev, frameLen));
+        devices.back()->serial = serial;
+    }
+
+    void Reactor::Stop()
+    {
+        stopEvent.Signal();
+    }
+
+    pipeline::StageStats const& Reactor::GetReadStats(size_t index)
+    {
+        return devices[index]->readStats;
+    }
+
+    pipeline::StageStats const& Reactor::GetConvertStats(size_t index)
+    {
+        return devices[index]->convertStats;
+    }
+
+    pipeline::StageStats const& Reactor::GetSerializeStats()
+    {
+        return socket.GetSerializeStats();
+    }
+
+    pipeline::StageStats const& Reactor::GetSendStats()
+    {
+        return socket.GetSendStats();
+    }
+
+    bool Reactor::Watch(int fd, uint64_t token)
+    {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u64 = token;
+        return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    void Reactor::Unwatch(int fd)
+    {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void Reactor::Run()
+    {
+        pipeline::ApplyThreadConfig(pipeline::ThreadConfig::FromEnv("REACTOR"));
+        Log("Reactor: Start listening for clients.");
+
+        epoll_event events[cMaxEvents];
+
+        while(!stop)
+        {
+            // Wake up periodically only to reopen lost devices while streaming
+            // and to look for new controllers without hotplug events.
+            int timeoutMs = hotplug ? -1 : cRescanPeriodMs;
+            if(active)
+                for(auto& device : devices)
+                    if(!device->dev->IsOpen())
+                    {
+                        timeoutMs = cReopenDelayMs;
+                        break;
+                    }
+
+            int eventCnt = epoll_wait(epoll, events, cMaxEvents, timeoutMs);
+            if(eventCnt < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                Log("Reactor: Waiting for events failed.");
+                break;
+            }
+
+            for(int i = 0; i < eventCnt && !stop; ++i)
+            {
+                auto token = events[i].data.u64;
+                if(token == cTokenStop)
+                    stop = true;
+                else if(token == cTokenSocket)
+                    HandleSocket();
+                else if(token == cTokenTimer)
+                    HandleTimer();
+                else if(token == cTokenHotplug)
+                    HandleHotplug();
+                else if(token < devices.size())
+                    HandleDevice(token, events[i].events);
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if(!hotplug && now >= nextRescan)
+                AddNewDevices();
+            if(active && now >= nextReopen)
+                OpenClosedDevices();
+        }
+
+        Deactivate();
+        stopEvent.Clear();
+        stop = false;
+        Log("Reactor: Stopped.");
+    }
+
+    void Reactor::Activate()
+    {
+        if(active)
+            return;
+
+        Log("Reactor: Started sending motion data.");
+        active = true;
+        for(auto& device : devices)
+        {
+            device->converter.Reset();
+            device->motion = SimpleMotionData();
+        }
+        sendTick.Reset();
+        OpenClosedDevices();
+
+        auto interval = 1000000000L / cSendRateHz;
+        itimerspec spec {};
+        spec.it_interval.tv_nsec = interval;
+        spec.it_value.tv_nsec = interval;
+        timerfd_settime(timer, 0, &spec, nullptr);
+
+        nextCleanup = std::chrono::steady_clock::now() + std::chrono::milliseconds(cCleanupPeriodMs);
+    }
+
+    void Reactor::Deactivate()
+    {
+        if(!active)
+            return;
+
+        itimerspec spec {};
+        timerfd_settime(timer, 0, &spec, nullptr);
+
+        for(size_t i = 0; i < devices.size(); ++i)
+            CloseDevice(i);
+        active = false;
+
+        for(auto& device : devices)
+        {
+            { KMICKI_LOGF(LogLevelDebug) << "Reactor: Device " << device->id << " read " << device->readStats.Describe(); }
+            { KMICKI_LOGF(LogLevelDebug) << "Reactor: Device " << device->id << " convert " << device->convertStats.Describe(); }
+        }
+        { KMICKI_LOGF(LogLevelDebug) << "Reactor: Serialize " << socket.GetSerializeStats().Describe(); }
+        { KMICKI_LOGF(LogLevelDebug) << "Reactor: Send " << socket.GetSendStats().Describe(); }
+        Log("Reactor: Stopped sending motion data.");
+    }
+
+    void Reactor::OpenDevice(size_t index)
+    {
+        auto& device = *devices[index];
+        if(device.dev->IsOpen())
+            return;
+
+        if(!device.dev->Open())
+            return;
+
+        if(!Watch(device.dev->GetFd(), index))
+        {
+            device.dev->Close();
+            return;
+        }
+
+        device.connectedMetric.Set(1);
+        { KMICKI_LOGF(LogLevelDebug) << "Reactor: Opened " << device.dev->GetPath() << " (device ID: " << device.id << ")."; }
+
+        if(device.disconnectedAt != 0)
+        {
+            auto latency = GetMonotonicTimestamp() - device.disconnectedAt;
+            { LogF() << "Reactor: Device " << device.id << " reconnected after " << latency/1000 << " ms."; }
+            device.disconnectedAt = 0;
+            if(latency > device.maxReconnectLatency)
+                device.maxReconnectLatency = latency;
+            device.reconnectsMetric.Increment();
+            device.reconnectLatencyMetric.Set(latency / 1e6);
+            device.maxReconnectLatencyMetric.Set(device.maxReconnectLatency / 1e6);
+        }
+    }
+
+    void Reactor::CloseDevice(size_t index, bool lost)
+    {
+        auto& device = *devices[index];
+        if(!device.dev->IsOpen())
+            return;
+
+        Unwatch(device.dev->GetFd());
+        device.dev->Close();
+        device.connectedMetric.Set(0);
+        if(lost)
+        {
+            device.disconnectedAt = GetMonotonicTimestamp();
+            device.disconnectsMetric.Increment();
+        }
+    }
+
+    void Reactor::OpenClosedDevices()
+    {
+        for(size_t i = 0; i < devices.size(); ++i)
+            OpenDevice(i);
+        nextReopen = std::chrono::steady_clock::now() + std::chrono::milliseconds(cReopenDelayMs);
+    }
+
+    void Reactor::AddNewDevices()
+    {
+        nextRescan = std::chrono::steady_clock::now() + std::chrono::milliseconds(cRescanPeriodMs);
+        for(auto const& found : FindHidRawDevices(vId, pId, interfaceNumber))
+        {
+            if(std::any_of(devices.begin(), devices.end(), [&](auto const& device) { return device->serial == found.serial; }))
+                continue;
+            { LogF() << "Reactor: Found Steam Deck Controls at " << found.path << " (serial: " << found.serial 
+                     << ", device ID: " << found.id << ")."; }
+            AddDevice(found.id, found.serial);
+            if(active)
+                OpenDevice(devices.size() - 1);
+        }
+    }
+
+    void Reactor::HandleDevice(size_t index, uint32_t events)
+    {
+        auto& device = *devices[index];
+
+        while(device.dev->IsOpen())
+        {
+            auto readCnt = device.dev->TryRead(device.frame);
+            if(readCnt == 0)
+                break;
+
+            if(readCnt < 0)
+            {
+                { LogF() << "Reactor: Reading from " << device.dev->GetPath() << " failed. Waiting for it to come back..."; }
+                CloseDevice(index, true);
+                return;
+            }
+
+            device.frame.Timestamp = GetMonotonicTimestamp();
+
+            if(readCnt < (int)device.frame.size())
+            {
+                { KMICKI_LOGF(LogLevelTrace) << "Reactor: Not enough bytes read: " << readCnt << "."; }
+                continue;
+            }
+
+            device.readStats.Record(device.frame.Timestamp);
+            trace::Scope scope("Reactor::Convert",device.frame.Timestamp);
+            if(device.converter.Convert(device.frame, device.motion))
+                device.convertStats.Record(device.frame.Timestamp);
+        }
+
+        if((events & (EPOLLERR | EPOLLHUP)) && device.dev->IsOpen())
+        {
+            { LogF() << "Reactor: HID device " << device.dev->GetPath() << " failed. Waiting for it to come back..."; }
+            CloseDevice(index, true);
+            return;
+        }
+
+        if(device.noGyro.TrySignal())
+        {
+            Log("Reactor: Try reenabling gyro.",LogLevelTrace);
+            if(device.dev->EnableGyro())
+            {
+                Log("Reactor: Gyro reenabled.",LogLevelDebug);
+                device.gyroReenablesMetric.Increment();
+            }
+            else
+                Log("Reactor: Gyro reenaling failed.");
+        }
+    }
+
+    void Reactor::HandleSocket()
+    {
+        if(socket.ReceiveRegistrations() > 0)
+            Activate();
+    }
+
+    void Reactor::HandleTimer()
+    {
+        uint64_t expirations;
+        if(read(timer, &expirations, sizeof(expirations)) < 0)
+            return;
+
+        // Send the most recent motion data of each controller unless it was already sent.
+        for(size_t i = 0; i < devices.size(); ++i)
+            sendTick.Offer(i, devices[i]->motion);
+        sendTick.Send();
+
+        auto now = std::chrono::steady_clock::now();
+        if(now >= nextCleanup)
+        {
+            nextCleanup = now + std::chrono::milliseconds(cCleanupPeriodMs);
+            socket.RemoveStaleClients();
+            if(socket.GetClientCount() == 0)
+                Deactivate();
+        }
+    }
+
+    void Reactor::HandleHotplug()
+    {
+        HotplugEvent event;
+        while(hotplug->TryEvent(event))
+        {
+            if(event.action == HotplugAction::Add)
+            {
+                { KMICKI_LOGF(LogLevelDebug) << "Reactor: HID device " << event.devName << " connected."; }
+                AddNewDevices();
+                if(active)
+                    OpenClosedDevices();
+                continue;
+            }
+
+            for(size_t i = 0; i < devices.size(); ++i)
+                if(devices[i]->dev->IsOpen() && event.devName == devices[i]->dev->GetPath())
+                {
+                    { LogF() << "Reactor: HID device " << event.devName << " removed. Waiting for it to come back..."; }
+                    CloseDevice(i, true);
+                }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#include "motion/sendtick.h"
+#include "hiddev/hidframe.h"
+#include "trace/trace.h"
+
+#include <algorithm>
+
+namespace kmicki::motion
+{
+    SendTick::SendTick(MotionSocket & _socket, char const* _traceName)
+    : socket(_socket), traceName(_traceName), lastFrameIds(), fresh()
+    { }
+
+    void SendTick::Reset()
+    {
+        std::fill(lastFrameIds.begin(), lastFrameIds.end(), 0);
+        fresh.clear();
+    }
+
+    void SendTick::Offer(size_t const& index, SimpleMotionData const& data)
+    {
+        if(index >= lastFrameIds.size())
+            lastFrameIds.resize(index + 1, 0);
+        if(data.frame_id == 0 || data.frame_id == lastFrameIds[index])
+            return;
+
+        lastFrameIds[index] = data.frame_id;
+        fresh.push_back(data);
+        fresh.back().timestamp = hiddev::GetMonotonicTimestamp();
+    }
+
+    size_t SendTick::Send()
+    {
+        auto count = fresh.size();
+        if(count > 0)
+        {
+            trace::Scope scope(traceName, fresh.front().sensor_timestamp);
+            socket.Send(fresh.data(), count);
+            fresh.clear();
+        }
+        return count;
+    }
+}
@@ -1,10 +1,15 @@
 #include "motion/simplemotion.h"
 #include <cmath>
-#include <sstream>
-#include <iomanip>
+#include <charconv>
+#include <cstring>
+#include <string_view>
 
 namespace kmicki::motion
 {
+    // Sign, 39 digits of FLT_MAX, point and 4 decimals
+    static const size_t cMaxFloatLen = 45;
+    static_assert(cMaxJsonLen >= 350 + 3*20 + 4*10 + 8*cMaxFloatLen + 10*6, "cMaxJsonLen is too small.");
+
     void CalculateMagnitudes(SimpleMotionData& data)
     {
         // Calculate acceleration magnitude
@@ -22,30 +27,83 @@ namespace kmicki::motion
         );
     }
 
+    static void Append(char *& pos, std::string_view const& text)
+    {
+        std::memcpy(pos, text.data(), text.size());
+        pos += text.size();
+    }
+
+    static void Append(char *& pos, uint64_t const& value)
+    {
+        pos = std::to_chars(pos, pos + 20, value).ptr;
+    }
+
+    static void Append(char *& pos, int16_t const& value)
+    {
+        pos = std::to_chars(pos, pos + 6, value).ptr;
+    }
+
+    // Same as ostream with std::fixed and std::setprecision(4) in the classic locale
+    static void Append(char *& pos, float const& value)
+    {
+        pos = std::to_chars(pos, pos + cMaxFloatLen, value, std::chars_format::fixed, 4).ptr;
+    }
+
+    static void AppendPair(char *& pos, std::string_view const& name, int16_t const& x, int16_t const& y)
+    {
+        Append(pos, name); Append(pos, x);
+        Append(pos, ",\"y\":"); Append(pos, y);
+        Append(pos, "}");
+    }
+
+    size_t ToJson(const SimpleMotionData& data, char * buffer, uint32_t const& fields)
+    {
+        char * pos = buffer;
+        Append(pos, "{\"timestamp\":"); Append(pos, data.timestamp);
+        Append(pos, ",\"sensorTimestamp\":"); Append(pos, data.sensor_timestamp);
+        Append(pos, ",\"sampleTimestamp\":"); Append(pos, data.sample_timestamp);
+        if(fields & FieldAccel)
+        {
+            Append(pos, ",\"accel\":{\"x\":"); Append(pos, data.accel_x);
+            Append(pos, ",\"y\":"); Append(pos, data.accel_y);
+            Append(pos, ",\"z\":"); Append(pos, data.accel_z);
+            Append(pos, "}");
+        }
+        if(fields & FieldGyro)
+        {
+            Append(pos, ",\"gyro\":{\"pitch\":"); Append(pos, data.gyro_pitch);
+            Append(pos, ",\"yaw\":"); Append(pos, data.gyro_yaw);
+            Append(pos, ",\"roll\":"); Append(pos, data.gyro_roll);
+            Append(pos, "}");
+        }
+        Append(pos, ",\"frameId\":"); Append(pos, (uint64_t)data.frame_id);
+        Append(pos, ",\"deviceId\":"); Append(pos, (uint64_t)data.device_id);
+        if(fields & FieldMagnitude)
+        {
+            Append(pos, ",\"magnitude\":{\"accel\":"); Append(pos, data.accel_magnitude);
+            Append(pos, ",\"gyro\":"); Append(pos, data.gyro_magnitude);
+            Append(pos, "}");
+        }
+        if(fields & FieldInputs)
+        {
+            Append(pos, ",\"inputs\":{\"buttons1\":"); Append(pos, (uint64_t)data.buttons1);
+            Append(pos, ",\"buttons2\":"); Append(pos, (uint64_t)data.buttons2);
+            AppendPair(pos, ",\"leftStick\":{\"x\":", data.left_stick_x, data.left_stick_y);
+            AppendPair(pos, ",\"rightStick\":{\"x\":", data.right_stick_x, data.right_stick_y);
+            Append(pos, ",\"triggers\":{\"left\":"); Append(pos, data.left_trigger);
+            Append(pos, ",\"right\":"); Append(pos, data.right_trigger);
+            Append(pos, "}");
+            AppendPair(pos, ",\"leftPad\":{\"x\":", data.left_pad_x, data.left_pad_y);
+            AppendPair(pos, ",\"rightPad\":{\"x\":", data.right_pad_x, data.right_pad_y);
+            Append(pos, "}");
+        }
+        Append(pos, "}");
+        return pos - buffer;
+    }
+
     std::string ToJson(const SimpleMotionData& data)
     {
-        std::ostringstream json;
-        json << std::fixed << std::setprecision(4);
-        
-        json << "{"
-             << "\"timestamp\":" << data.timestamp << ","
-             << "\"accel\":{"
-             << "\"x\":" << data.accel_x << ","
-             << "\"y\":" << data.accel_y << ","
-             << "\"z\":" << data.accel_z
-             << "},"
-             << "\"gyro\":{"
-             << "\"pitch\":" << data.gyro_pitch << ","
-             << "\"yaw\":" << data.gyro_yaw << ","
-             << "\"roll\":" << data.gyro_roll
-             << "},"
-             << "\"frameId\":" << data.frame_id << ","
-             << "\"magnitude\":{"
-             << "\"accel\":" << data.accel_magnitude << ","
-             << "\"gyro\":" << data.gyro_magnitude
-             << "}"
-             << "}";
-             
-        return json.str();
-    }
-}
\ No newline at end of file
+        char buffer[cMaxJsonLen];
+        return std::string(buffer, ToJson(data, buffer));
+    }
+}
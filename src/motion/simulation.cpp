@@ -0,0 +1,120 @@
+#include "motion/simulation.h"
+#include "motion/simplemotion.h"
+#include "motion/motionsocket.h"
+#include "motion/sendtick.h"
+#include "sdgyrodsu/motionadapter.h"
+#include "hiddev/hiddevreader.h"
+#include "pipeline/clock.h"
+#include "pipeline/eventfd.h"
+#include "log/log.h"
+
+#include <arpa/inet.h>
+#include <stdexcept>
+#include <thread>
+
+using namespace kmicki::log;
+
+namespace kmicki::motion
+{
+    // Writes every datagram as a line.
+    class StreamSink : public PacketSink
+    {
+        public:
+        StreamSink(std::ostream & _out)
+        : out(_out), packets(0)
+        { }
+
+        void Write(sockaddr const* address, socklen_t const& addressLength, char const* packet, size_t const& len) override
+        {
+            out.write(packet, len).put('\n');
+            ++packets;
+        }
+
+        uint64_t GetPacketCount() const
+        {
+            return packets;
+        }
+
+        private:
+        std::ostream & out;
+        uint64_t packets;
+    };
+
+    Simulation::Simulation(std::string const& _capturePath, int const& _frameLen)
+    : capturePath(_capturePath), frameLen(_frameLen), capture(_capturePath)
+    {
+        if(capture.GetFrameLen() != frameLen)
+            throw std::runtime_error("Simulation: Capture frame length doesn't match the device's.");
+    }
+
+    uint64_t Simulation::Run(std::ostream & out)
+    {
+        auto frameCount = capture.GetFrameCount();
+        if(frameCount == 0)
+        {
+            Log("Simulation: Capture is empty.");
+            return 0;
+        }
+
+        typedef std::chrono::steady_clock::time_point time_point;
+        auto frameTime = [&](size_t const& i) { return time_point(std::chrono::microseconds(capture.GetTimestamp(i))); };
+
+        // Pipeline runs on time of the capture.
+        pipeline::VirtualClock clock(frameTime(0));
+        pipeline::ScopedClock scopedClock(clock);
+
+        hiddev::HidDevReader reader(capturePath, frameLen);
+        sdgyrodsu::MotionAdapter adapter(reader, reader.GetDeviceId());
+        reader.SetNoGyro(adapter.NoGyro);
+
+        StreamSink sink(out);
+        MotionSocket socket(sink, cSendRateHz);
+        sockaddr_in client {};
+        client.sin_family = AF_INET;
+        client.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socket.Register(ClientAddress((sockaddr*)&client, sizeof(client)), Subscription(cSendRateHz));
+        SendTick sendTick(socket, "Simulation::Send");
+
+        auto tick = [&]()
+        {
+            SimpleMotionData motion;
+            if(adapter.GetMotionData(motion))
+                sendTick.Offer(0, motion);
+            sendTick.Send();
+        };
+
+        pipeline::EventFd stop;
+        const auto sendInterval = std::chrono::microseconds(1000000 / cSendRateHz);
+        auto nextSend = clock.Now();
+        auto const lastFrameTime = frameTime(frameCount-1);
+
+        // Replay steps the clock through the ticks up to the last frame.
+        // Ticks due before or at a frame's time see motion data of previous frames.
+        clock.Expect(nextSend);
+        adapter.StartFrameGrab();
+        while(true)
+        {
+            tick();
+            nextSend += sendInterval;
+            if(nextSend > lastFrameTime)
+                break;
+            clock.WaitUntil(nextSend, stop);
+        }
+
+        // Send motion data of the last frames once all of them are converted
+        clock.Forget();
+        while(!reader.IsFinished())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        clock.AdvanceTo(nextSend, stop);
+        tick();
+
+        auto const state = adapter.GetState();
+        adapter.StopFrameGrab();
+        out.flush();
+
+        auto packets = sink.GetPacketCount();
+        { LogF() << "Simulation: " << frameCount << " frames (" << state.framesMissed << " missed, "
+                 << state.framesRepeated << " repeated), " << packets << " packets."; }
+        return packets;
+    }
+}
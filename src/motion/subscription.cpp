@@ -0,0 +1,139 @@
+#include "motion/subscription.h"
+#include <cstdlib>
+#include <string_view>
+
+namespace kmicki::motion
+{
+    struct FieldName
+    {
+        std::string_view name;
+        uint32_t field;
+    };
+
+    static const FieldName cFieldNames[] = {
+        { "accel", FieldAccel },
+        { "gyro", FieldGyro },
+        { "magnitude", FieldMagnitude },
+        { "inputs", FieldInputs }
+    };
+
+    static uint32_t ParseFields(std::string_view value)
+    {
+        if(value == "all")
+            return cAllFields;
+
+        uint32_t fields = 0;
+        while(!value.empty())
+        {
+            auto end = value.find(',');
+            auto name = value.substr(0, end);
+            for(auto const& field : cFieldNames)
+                if(name == field.name)
+                    fields |= field.field;
+            if(end == std::string_view::npos)
+                break;
+            value.remove_prefix(end + 1);
+        }
+        return (fields == 0) ? cDefaultFields : fields;
+    }
+
+    Subscription::Subscription(int const& _rateHz)
+    : format(WireFormat::Json), fields(cDefaultFields), coordinates(Coordinates::Default), rateHz(_rateHz)
+    { }
+
+    Subscription Subscription::Parse(char const* datagram, size_t const& len, int const& maxRateHz)
+    {
+        Subscription subscription(maxRateHz);
+        std::string_view text(datagram, len);
+
+        size_t pos = 0;
+        while(pos < text.size())
+        {
+            auto end = text.find_first_of(" \t\r\n", pos);
+            if(end == std::string_view::npos)
+                end = text.size();
+            auto token = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            auto separator = token.find('=');
+            if(separator == std::string_view::npos)
+                continue;
+            auto key = token.substr(0, separator);
+            auto value = token.substr(separator + 1);
+
+            if(key == "format")
+            {
+                if(value == "binary")
+                    subscription.format = WireFormat::Binary;
+                else if(value == "binary16")
+                    subscription.format = WireFormat::BinaryInt16;
+                else
+                    subscription.format = WireFormat::Json;
+            }
+            else if(key == "rate")
+            {
+                int rate = std::atoi(std::string(value).c_str());
+                if(rate > 0)
+                    subscription.rateHz = std::min(rate, maxRateHz);
+            }
+            else if(key == "fields")
+                subscription.fields = ParseFields(value);
+            else if(key == "coords")
+                subscription.coordinates = (value == "device") ? Coordinates::Device : Coordinates::Default;
+        }
+        return subscription;
+    }
+
+    bool Subscription::SameEncoding(Subscription const& other) const
+    {
+        return format == other.format && fields == other.fields && coordinates == other.coordinates
+            // Sequence number of binary packets depends on rate
+            && (format == WireFormat::Json || rateHz == other.rateHz);
+    }
+
+    bool Subscription::operator==(Subscription const& other) const
+    {
+        return SameEncoding(other) && rateHz == other.rateHz;
+    }
+
+    bool Subscription::operator!=(Subscription const& other) const
+    {
+        return !(*this == other);
+    }
+
+    std::string Subscription::Describe() const
+    {
+        std::string description = GetWireFormatName(format);
+        description += " " + std::to_string(rateHz) + "Hz ";
+        bool first = true;
+        for(auto const& field : cFieldNames)
+            if(fields & field.field)
+            {
+                if(!first)
+                    description += ",";
+                description += field.name;
+                first = false;
+            }
+        description += (coordinates == Coordinates::Device) ? " device" : " default";
+        return description;
+    }
+
+    size_t Encode(SimpleMotionData const& data, Subscription const& subscription, uint32_t const& sequence, char * buffer)
+    {
+        SimpleMotionData const* motion = &data;
+        SimpleMotionData converted;
+        if(subscription.coordinates == Coordinates::Device)
+        {
+            // Undo sign changes of MotionConverter::ConvertMotionData
+            converted = data;
+            converted.accel_x = -data.accel_x;
+            converted.accel_y = -data.accel_y;
+            converted.gyro_yaw = -data.gyro_yaw;
+            motion = &converted;
+        }
+
+        if(subscription.format == WireFormat::Json)
+            return ToJson(*motion, buffer, subscription.fields);
+        return ToBinary(*motion, sequence, subscription.format == WireFormat::BinaryInt16, subscription.fields, buffer);
+    }
+}
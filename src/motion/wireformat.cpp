@@ -0,0 +1,102 @@
+#include "motion/wireformat.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace kmicki::motion
+{
+    char const* GetWireFormatName(WireFormat const& format)
+    {
+        switch(format)
+        {
+            case WireFormat::Binary:
+                return "binary";
+            case WireFormat::BinaryInt16:
+                return "binary16";
+            default:
+                return "json";
+        }
+    }
+
+    template<class T>
+    static void Put(char *& pos, T const& value)
+    {
+        std::memcpy(pos, &value, sizeof(value));
+        pos += sizeof(value);
+    }
+
+    template<class T>
+    static T ToFixed(float const& value, int const& scale)
+    {
+        float scaled = std::nearbyint(value * scale);
+        // Casting NaN (or out of range value) is undefined
+        if(std::isnan(scaled))
+            return 0;
+        if(scaled > std::numeric_limits<T>::max())
+            return std::numeric_limits<T>::max();
+        if(scaled < std::numeric_limits<T>::min())
+            return std::numeric_limits<T>::min();
+        return (T)scaled;
+    }
+
+    static void PutSamples(char *& pos, float const& x, float const& y, float const& z, int const& scale, bool const& int16)
+    {
+        if(int16)
+        {
+            Put(pos, ToFixed<int16_t>(x, scale));
+            Put(pos, ToFixed<int16_t>(y, scale));
+            Put(pos, ToFixed<int16_t>(z, scale));
+        }
+        else
+        {
+            Put(pos, x);
+            Put(pos, y);
+            Put(pos, z);
+        }
+    }
+
+    size_t ToBinary(SimpleMotionData const& data, uint32_t const& sequence, bool const& int16, 
+                    uint32_t const& fields, char * buffer)
+    {
+        BinaryHeader header;
+        std::memcpy(header.magic, cBinaryWireMagic, sizeof(header.magic));
+        header.version = cBinaryWireVersion;
+        header.flags = (int16 ? cBinaryFlagInt16 : 0) | (uint8_t)((fields & cAllFields) << cBinaryFieldsShift);
+        header.sequence = sequence;
+        header.deviceId = data.device_id;
+        header.frameId = data.frame_id;
+        header.timestamp = data.timestamp;
+        header.sensorTimestamp = data.sensor_timestamp;
+        header.sampleTimestamp = data.sample_timestamp;
+
+        char * pos = buffer;
+        Put(pos, header);
+
+        if(fields & FieldAccel)
+            PutSamples(pos, data.accel_x, data.accel_y, data.accel_z, cBinaryAccelPerG, int16);
+        if(fields & FieldGyro)
+            PutSamples(pos, data.gyro_pitch, data.gyro_yaw, data.gyro_roll, cBinaryGyroPerDps, int16);
+        if(fields & FieldMagnitude)
+        {
+            if(int16)
+            {
+                Put(pos, ToFixed<uint16_t>(data.accel_magnitude, cBinaryAccelPerG));
+                Put(pos, ToFixed<uint16_t>(data.gyro_magnitude, cBinaryGyroPerDps));
+            }
+            else
+            {
+                Put(pos, data.accel_magnitude);
+                Put(pos, data.gyro_magnitude);
+            }
+        }
+        if(fields & FieldInputs)
+        {
+            BinaryInputs inputs { data.buttons1, data.buttons2,
+                                  { data.left_stick_x, data.left_stick_y }, { data.right_stick_x, data.right_stick_y },
+                                  { data.left_trigger, data.right_trigger },
+                                  { data.left_pad_x, data.left_pad_y }, { data.right_pad_x, data.right_pad_y } };
+            Put(pos, inputs);
+        }
+        return pos - buffer;
+    }
+}
@@ -0,0 +1,180 @@
+#include "pipeline/clock.h"
+
+namespace kmicki::pipeline
+{
+    // Period of checking stop event while waiting for virtual time.
+    static const std::chrono::milliseconds cStopCheckPeriod(10);
+    // Real time a thread driven by virtual clock can take to be done with its time,
+    // before the clock moves on without it.
+    static const std::chrono::seconds cStallTimeout(1);
+
+    static SystemClock systemClock;
+    static std::atomic<Clock*> currentClock(&systemClock);
+
+    Clock & GetClock()
+    {
+        return *currentClock.load(std::memory_order_acquire);
+    }
+
+    void SetClock(Clock * clock)
+    {
+        currentClock.store((clock == nullptr) ? &systemClock : clock, std::memory_order_release);
+    }
+
+    // Definition - ScopedClock
+
+    ScopedClock::ScopedClock(Clock & clock)
+    {
+        SetClock(&clock);
+    }
+
+    ScopedClock::~ScopedClock()
+    {
+        SetClock(nullptr);
+    }
+
+    // Definition - Clock
+
+    Clock::~Clock()
+    { }
+
+    bool Clock::IsVirtual()
+    {
+        return false;
+    }
+
+    void Clock::Expect(time_point const& time)
+    { }
+
+    void Clock::Forget()
+    { }
+
+    // Definition - SystemClock
+
+    Clock::time_point SystemClock::Now()
+    {
+        return std::chrono::steady_clock::now();
+    }
+
+    bool SystemClock::WaitUntil(time_point const& time, EventFd & stop)
+    {
+        return !stop.WaitUntil(time);
+    }
+
+    bool SystemClock::AdvanceTo(time_point const& time, EventFd & stop)
+    {
+        return !stop.WaitUntil(time);
+    }
+
+    // Definition - VirtualClock
+
+    VirtualClock::VirtualClock(time_point const& start)
+    : now(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count()),
+      waitersMutex(), advanced(), done(), waiters()
+    { }
+
+    Clock::time_point VirtualClock::Now()
+    {
+        return time_point(std::chrono::nanoseconds(now.load(std::memory_order_acquire)));
+    }
+
+    bool VirtualClock::IsVirtual()
+    {
+        return true;
+    }
+
+    void VirtualClock::Expect(time_point const& time)
+    {
+        std::lock_guard lock(waitersMutex);
+        waiters[std::this_thread::get_id()] = { true, false, time, {} };
+        done.notify_all();
+    }
+
+    void VirtualClock::Forget()
+    {
+        std::lock_guard lock(waitersMutex);
+        waiters.erase(std::this_thread::get_id());
+        done.notify_all();
+    }
+
+    bool VirtualClock::WaitUntil(time_point const& time, EventFd & stop)
+    {
+        std::unique_lock lock(waitersMutex);
+        auto waiter = waiters.find(std::this_thread::get_id());
+        if(waiter != waiters.end())
+        {
+            waiter->second = { true, false, time, {} };
+            done.notify_all();
+        }
+
+        while(Now() < time)
+        {
+            if(stop.Wait(std::chrono::milliseconds(0)))
+            {
+                if(waiter != waiters.end())
+                    waiter->second.waiting = false;
+                done.notify_all();
+                return false;
+            }
+            advanced.wait_for(lock, cStopCheckPeriod);
+        }
+
+        // Woken by AdvanceTo (already busy) or time has already come
+        if(waiter != waiters.end() && !waiter->second.busy)
+            waiter->second = { false, true, time, std::chrono::steady_clock::now() };
+        return true;
+    }
+
+    bool VirtualClock::AdvanceTo(time_point const& time, EventFd & stop)
+    {
+        std::unique_lock lock(waitersMutex);
+        while(true)
+        {
+            if(stop.Wait(std::chrono::milliseconds(0)))
+                return false;
+
+            // Threads woken at the previous step are done with it first
+            bool busy = false;
+            auto realNow = std::chrono::steady_clock::now();
+            for(auto & waiter : waiters)
+                if(waiter.second.busy)
+                {
+                    if(realNow - waiter.second.wokenAt < cStallTimeout)
+                        busy = true;
+                    else
+                        waiter.second.busy = false;     // Stalled: don't wait for it anymore
+                }
+            if(busy)
+            {
+                done.wait_for(lock, cStopCheckPeriod);
+                continue;
+            }
+
+            // Next step: the earliest time a thread waits for, up to given time
+            auto next = time;
+            for(auto const& waiter : waiters)
+                if(waiter.second.waiting && waiter.second.deadline < next)
+                    next = waiter.second.deadline;
+
+            Set(next);
+            bool woken = false;
+            for(auto & waiter : waiters)
+                if(waiter.second.waiting && waiter.second.deadline <= next)
+                {
+                    waiter.second = { false, true, waiter.second.deadline, realNow };
+                    woken = true;
+                }
+            advanced.notify_all();
+
+            if(!woken && next >= time)
+                return true;
+        }
+    }
+
+    void VirtualClock::Set(time_point const& time)
+    {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        if(ns > now.load(std::memory_order_relaxed))
+            now.store(ns, std::memory_order_release);
+    }
+}
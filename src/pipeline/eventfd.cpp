@@ -0,0 +1,66 @@
+#include "pipeline/eventfd.h"
+
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+namespace kmicki::pipeline
+{
+    // Definition - EventFd
+
+    EventFd::EventFd()
+    : fd(eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC))
+    { 
+        if(fd < 0)
+            throw std::runtime_error("EventFd: eventfd could not be created.");
+    }
+
+    EventFd::~EventFd()
+    {
+        close(fd);
+    }
+
+    int EventFd::GetFd() const
+    {
+        return fd;
+    }
+
+    void EventFd::Signal()
+    {
+        uint64_t one = 1;
+        while(write(fd,&one,sizeof(one)) < 0 && errno == EINTR);
+    }
+
+    bool EventFd::Clear()
+    {
+        uint64_t value;
+        return read(fd,&value,sizeof(value)) == sizeof(value);
+    }
+
+    bool EventFd::WaitUntil(std::chrono::steady_clock::time_point const& time)
+    {
+        pollfd pfd { fd, POLLIN, 0 };
+        int result;
+        do
+        {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(time - std::chrono::steady_clock::now()).count();
+            if(left < 0)
+                left = 0;
+            timespec timeout { (time_t)(left / 1000000000), (long)(left % 1000000000) };
+            result = ppoll(&pfd,1,&timeout,nullptr);
+        }
+        while(result < 0 && errno == EINTR);
+        return result > 0;
+    }
+
+    bool EventFd::Wait(std::chrono::milliseconds timeout)
+    {
+        pollfd pfd { fd, POLLIN, 0 };
+        int result;
+        while((result = poll(&pfd,1,timeout.count())) < 0 && errno == EINTR);
+        return result > 0;
+    }
+}
@@ -0,0 +1,46 @@
+#include "pipeline/futex.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+
+namespace kmicki::pipeline
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex word has to be plain 32-bit integer.");
+
+    static long Futex(std::atomic<uint32_t> & word, int op, uint32_t val, timespec const* timeout, uint32_t val3)
+    {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, val, timeout, nullptr, val3);
+    }
+
+    void FutexWait(std::atomic<uint32_t> & word, uint32_t expected)
+    {
+        Futex(word, FUTEX_WAIT_PRIVATE, expected, nullptr, 0);
+    }
+
+    bool FutexWaitUntil(std::atomic<uint32_t> & word, uint32_t expected, std::chrono::steady_clock::time_point deadline)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        if(ns < 0)
+            ns = 0;
+        timespec absTimeout { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+
+        // steady_clock is CLOCK_MONOTONIC on Linux, which is what FUTEX_WAIT_BITSET uses by default
+        if(Futex(word, FUTEX_WAIT_BITSET_PRIVATE, expected, &absTimeout, FUTEX_BITSET_MATCH_ANY) < 0 && errno == ETIMEDOUT)
+            return false;
+        return true;
+    }
+
+    void FutexWake(std::atomic<uint32_t> & word, int count)
+    {
+        Futex(word, FUTEX_WAKE_PRIVATE, (uint32_t)count, nullptr, 0);
+    }
+
+    void FutexWakeAll(std::atomic<uint32_t> & word)
+    {
+        FutexWake(word, INT_MAX);
+    }
+}
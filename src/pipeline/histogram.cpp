@@ -0,0 +1,87 @@
+#include "pipeline/histogram.h"
+
+#include <algorithm>
+
+namespace kmicki::pipeline
+{
+    Histogram::Histogram()
+    : sum(0), max(0)
+    {
+        for(auto& bucket : counts)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+    int Histogram::GetBucket(uint64_t value)
+    {
+        if(value < cSubBuckets)
+            return (int)value;
+        // Values [2^n,2^(n+1)) are split into cSubBuckets buckets of width 2^(n-cSubBucketBits).
+        int shift = 63 - __builtin_clzll(value) - cSubBucketBits;
+        return shift * cSubBuckets + (int)(value >> shift);
+    }
+
+    uint64_t Histogram::GetBucketLowerBound(int bucket)
+    {
+        if(bucket < 2 * cSubBuckets)
+            return bucket;
+        int shift = bucket / cSubBuckets - 1;
+        return (uint64_t)(bucket % cSubBuckets + cSubBuckets) << shift;
+    }
+
+    uint64_t Histogram::GetBucketUpperBound(int bucket)
+    {
+        if(bucket >= cBucketCount - 1)
+            return UINT64_MAX;
+        return GetBucketLowerBound(bucket + 1) - 1;
+    }
+
+    void Histogram::Record(uint64_t value)
+    {
+        // Single writer - plain load/store is enough and avoids locked instructions.
+        auto & bucket = counts[GetBucket(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if(value > max.load(std::memory_order_relaxed))
+            max.store(value, std::memory_order_relaxed);
+    }
+
+    Histogram::Snapshot Histogram::Read() const
+    {
+        Snapshot snapshot;
+        snapshot.counts.resize(cBucketCount);
+        snapshot.max = max.load(std::memory_order_relaxed);
+        snapshot.sum = sum.load(std::memory_order_relaxed);
+        // Count is taken from the buckets so that percentiles are consistent.
+        snapshot.count = 0;
+        for(int i = 0; i < cBucketCount; ++i)
+        {
+            snapshot.counts[i] = counts[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.counts[i];
+        }
+        return snapshot;
+    }
+
+    uint64_t Histogram::Snapshot::GetPercentile(double fraction) const
+    {
+        if(count == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(fraction * count);
+        if(rank >= count)
+            rank = count - 1;
+        uint64_t seen = 0;
+        for(int i = 0; i < (int)counts.size(); ++i)
+        {
+            seen += counts[i];
+            if(seen > rank)
+                return std::min(GetBucketUpperBound(i), max);
+        }
+        return max;
+    }
+
+    double Histogram::Snapshot::GetMean() const
+    {
+        if(count == 0)
+            return 0.0;
+        return (double)sum / count;
+    }
+}
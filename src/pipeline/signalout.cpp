@@ -5,7 +5,7 @@ namespace kmicki::pipeline
     // Definition - SignalOut
 
     SignalOut::SignalOut()
-    : signalMutex(),signalConditionVariable(),signal(false)
+    : signalMutex(),signalConditionVariable(),signal(false),signalEventFd(nullptr)
     { }
 
     SignalOut::~SignalOut()
@@ -13,11 +13,15 @@ namespace kmicki::pipeline
 
     void SignalOut::SendSignal()
     {
+        EventFd * eventFd;
         {
             std::lock_guard lock(signalMutex);
             signal = true;
+            eventFd = signalEventFd;
         }
         signalConditionVariable.notify_all();
+        if(eventFd != nullptr)
+            eventFd->Signal();
     }
 
     bool SignalOut::WasReceived()
@@ -48,4 +52,10 @@ namespace kmicki::pipeline
     {
         SendSignal();
     }
+
+    void SignalOut::SetEventFd(EventFd * eventFd)
+    {
+        std::lock_guard lock(signalMutex);
+        signalEventFd = eventFd;
+    }
 }
\ No newline at end of file
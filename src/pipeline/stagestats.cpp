@@ -0,0 +1,53 @@
+#include "pipeline/stagestats.h"
+#include "pipeline/clock.h"
+
+#include <sstream>
+#include <iomanip>
+
+namespace kmicki::pipeline
+{
+    StageStats::StageStats()
+    : latency(), interval(), lastNs(0)
+    { }
+
+    void StageStats::Record(uint64_t readTimestampUs)
+    {
+        uint64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(GetClock().Now().time_since_epoch()).count();
+
+        uint64_t readNs = readTimestampUs * 1000;
+        latency.Record(nowNs > readNs ? nowNs - readNs : 0);
+        if(lastNs != 0)
+            interval.Record(nowNs - lastNs);
+        lastNs = nowNs;
+    }
+
+    Histogram const& StageStats::GetLatency() const
+    {
+        return latency;
+    }
+
+    Histogram const& StageStats::GetInterval() const
+    {
+        return interval;
+    }
+
+    static void DescribeHistogram(std::ostream & out, Histogram const& histogram)
+    {
+        auto snapshot = histogram.Read();
+        out << "p50: " << snapshot.GetPercentile(0.5)/1000.0
+            << " p99: " << snapshot.GetPercentile(0.99)/1000.0
+            << " p99.9: " << snapshot.GetPercentile(0.999)/1000.0
+            << " max: " << snapshot.max/1000.0;
+    }
+
+    std::string StageStats::Describe() const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1)
+            << "frames: " << latency.Read().count << " latency [us] ";
+        DescribeHistogram(out, latency);
+        out << " interval [us] ";
+        DescribeHistogram(out, interval);
+        return out.str();
+    }
+}
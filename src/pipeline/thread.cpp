@@ -1,19 +1,24 @@
 #include "pipeline/thread.h"
+#include "trace/trace.h"
 
 namespace kmicki::pipeline
 {
     // Definition - Thread
 
-    const std::chrono::milliseconds Thread::cTimeout(100);
-
     Thread::Thread()
-    : executeThread(),stopMutex(),stop(false)
+    : config(),executeThread(),stop(false),finished(false),stopEvent()
     {}
     
     Thread::~Thread()
     {
+        // Derived classes stop the thread in their destructors.
+        // FlushPipes is not available anymore at this point.
         if(executeThread != nullptr)
-            TryStopThenKill();
+        {
+            stop = true;
+            stopEvent.Signal();
+            executeThread->join();
+        }
     }
 
     void Thread::Start()
@@ -22,33 +27,38 @@ namespace kmicki::pipeline
             return;
         
         stop = false;
-        executeThread.reset(new std::thread(&Thread::Execute,this));
-        threadHandle = executeThread->native_handle();
+        finished = false;
+        stopEvent.Clear();
+        executeThread.reset(new std::thread(&Thread::Run,this));
     }
 
-    void Thread::Stop()
+    void Thread::Run()
     {
-        if(executeThread == nullptr)
-            return;
-
+        ApplyThreadConfig(config);
         {
-            std::lock_guard lock(stopMutex);
-            stop = true;
+            trace::Scope scope("Thread::Execute");
+            Execute();
         }
-        FlushPipes();
-        executeThread->join();
-        executeThread.reset();
-        stop = false;
+        finished.store(true, std::memory_order_release);
+    }
+
+    void Thread::SetConfig(ThreadConfig const& _config)
+    {
+        config = _config;
     }
 
-    void Thread::Kill()
+    void Thread::Stop()
     {
         if(executeThread == nullptr)
             return;
-        pthread_cancel(threadHandle);
+
+        stop = true;
+        stopEvent.Signal();
+        FlushPipes();
         executeThread->join();
         executeThread.reset();
         stop = false;
+        stopEvent.Clear();
     }
 
     void Thread::Restart()
@@ -57,38 +67,47 @@ namespace kmicki::pipeline
         Start();
     }
 
-    void Thread::ForceRestart()
+    bool Thread::IsStarted()
+    {
+        return executeThread != nullptr;
+    }
+
+    bool Thread::IsFinished()
     {
-        Kill();
-        Start();
+        return finished.load(std::memory_order_acquire);
+    }
+
+    bool Thread::IsStopping()
+    {
+        if(!IsStarted())
+            return false;
+        return stop;
     }
 
-    void Thread::TryStopThenKill()
+    bool Thread::ShouldContinue()
     {
-        TryStopThenKill(cTimeout);
+        return !stop.load(std::memory_order_acquire);
     }
 
-    void Thread::TryRestartThenForceRestart()
+    int Thread::GetStopFd() const
     {
-        TryRestartThenForceRestart(cTimeout);
+        return stopEvent.GetFd();
     }
 
-    bool Thread::IsStarted()
+    bool Thread::SleepUntil(std::chrono::steady_clock::time_point const& time)
     {
-        return executeThread != nullptr;
+        GetClock().WaitUntil(time, stopEvent);
+        return ShouldContinue();
     }
 
-    bool Thread::IsStopping()
+    bool Thread::SleepFor(std::chrono::microseconds const& duration)
     {
-        if(!IsStarted())
-            return false;
-        std::lock_guard lock(stopMutex);
-        return stop;
+        return SleepUntil(GetClock().Now() + duration);
     }
 
-    bool Thread::ShouldContinue()
+    bool Thread::AdvanceTo(std::chrono::steady_clock::time_point const& time)
     {
-        std::lock_guard lock(stopMutex);
-        return !stop;
+        GetClock().AdvanceTo(time, stopEvent);
+        return ShouldContinue();
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,144 @@
+#include "pipeline/threadconfig.h"
+#include "log/log.h"
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+
+using namespace kmicki::log;
+
+namespace kmicki::pipeline
+{
+    // Stack size touched up front when memory is locked
+    static const size_t cPrefaultStackLen = 256*1024;
+
+    static std::atomic<bool> memoryLocked(false);
+    static std::atomic<bool> rtWarningLogged(false);
+
+    static char const* GetStageEnv(std::string const& stage, char const* setting)
+    {
+        return std::getenv(("SDMOTION_" + stage + "_" + setting).c_str());
+    }
+
+    static std::vector<int> ParseCpuList(std::string const& list)
+    {
+        std::vector<int> cpus;
+        std::istringstream stream(list);
+        std::string range;
+        while(std::getline(stream,range,','))
+        {
+            auto dash = range.find('-');
+            int first = std::atoi(range.substr(0,dash).c_str());
+            int last = (dash == std::string::npos) ? first : std::atoi(range.substr(dash+1).c_str());
+            for(int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    ThreadConfig ThreadConfig::FromEnv(std::string const& stage)
+    {
+        ThreadConfig config;
+        config.name = "sdm-" + stage;
+        std::transform(config.name.begin(),config.name.end(),config.name.begin(),::tolower);
+
+        if(auto sched = GetStageEnv(stage,"SCHED"))
+        {
+            std::string policy(sched);
+            if(policy == "fifo")
+                config.policy = SCHED_FIFO;
+            else if(policy == "rr")
+                config.policy = SCHED_RR;
+            else if(policy != "other")
+                { LogF() << "ThreadConfig: Unknown scheduling policy '" << policy << "' for " << stage << ". Using default."; }
+        }
+        if(auto priority = GetStageEnv(stage,"PRIORITY"))
+            config.priority = std::atoi(priority);
+        if(config.policy != SCHED_OTHER && config.priority <= 0)
+            config.priority = 1;
+        if(auto cpus = GetStageEnv(stage,"CPUS"))
+            config.cpus = ParseCpuList(cpus);
+        if(auto slack = GetStageEnv(stage,"TIMERSLACK_NS"))
+            config.timerSlackNs = std::strtoul(slack,nullptr,10);
+
+        return config;
+    }
+
+    static void PrefaultStack()
+    {
+        volatile char stack[cPrefaultStackLen];
+        for(size_t i = 0; i < cPrefaultStackLen; i += 4096)
+            stack[i] = 0;
+        (void)stack[0];
+    }
+
+    void ApplyThreadConfig(ThreadConfig const& config)
+    {
+        auto self = pthread_self();
+
+        if(!config.name.empty())
+            pthread_setname_np(self,config.name.substr(0,15).c_str());
+
+        if(config.policy != SCHED_OTHER)
+        {
+            sched_param param {};
+            param.sched_priority = config.priority;
+            auto result = pthread_setschedparam(self,config.policy,&param);
+            if(result == EPERM)
+            {
+                if(!rtWarningLogged.exchange(true))
+                    { LogF() << "ThreadConfig: No privileges for real-time scheduling (CAP_SYS_NICE or RLIMIT_RTPRIO needed). "
+                             << "Using default scheduling."; }
+            }
+            else if(result != 0)
+                { LogF() << "ThreadConfig: Setting scheduling of " << config.name << " failed: " << strerror(result) << "."; }
+            else
+                { KMICKI_LOGF(LogLevelDebug) << "ThreadConfig: " << config.name << " runs with real-time priority " << config.priority << "."; }
+        }
+
+        if(!config.cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for(auto cpu : config.cpus)
+                if(cpu >= 0 && cpu < CPU_SETSIZE)
+                    CPU_SET(cpu,&set);
+            auto result = pthread_setaffinity_np(self,sizeof(set),&set);
+            if(result != 0)
+                { LogF() << "ThreadConfig: Pinning " << config.name << " to CPUs failed: " << strerror(result) << "."; }
+        }
+
+        if(config.timerSlackNs > 0)
+            prctl(PR_SET_TIMERSLACK,config.timerSlackNs,0,0,0);
+
+        if(memoryLocked)
+            PrefaultStack();
+    }
+
+    bool LockMemory()
+    {
+        if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            { LogF() << "ThreadConfig: Locking memory failed: " << strerror(errno) << ". Memory stays pageable."; }
+            return false;
+        }
+        memoryLocked = true;
+        PrefaultStack();
+        Log("ThreadConfig: Memory locked.",LogLevelDebug);
+        return true;
+    }
+
+    bool LockMemoryFromEnv()
+    {
+        auto mlock = std::getenv("SDMOTION_MLOCK");
+        if(mlock == nullptr || std::string(mlock) != "1")
+            return false;
+        return LockMemory();
+    }
+}
@@ -0,0 +1,22 @@
+#include "pipeline/threadrings.h"
+
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+namespace kmicki::pipeline
+{
+    uint64_t GetRingTimestamp()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+
+    ThreadRingBase::ThreadRingBase()
+    : orphaned(false), tid(gettid())
+    {
+        if(pthread_getname_np(pthread_self(), name, sizeof(name)) != 0)
+            name[0] = 0;
+    }
+}
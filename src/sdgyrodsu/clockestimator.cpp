@@ -0,0 +1,154 @@
+#include "sdgyrodsu/clockestimator.h"
+#include "log/log.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace kmicki::log;
+
+namespace kmicki::sdgyrodsu
+{
+    const double ClockEstimator::cNominalPeriodUs = 4000.0;
+
+    // Samples needed before fit is trusted
+    static const uint64_t cLockSamples = 250;
+    // Effective window of the fit (~60 s at 250 Hz)
+    static const double cWindowSamples = 15000.0;
+    // Effective window of residual statistics (~2 s at 250 Hz)
+    static const double cDevWindowSamples = 500.0;
+    // Residual bigger than that many mean absolute deviations is an outlier
+    static const double cOutlierFactor = 6.0;
+    // Outlier threshold is never tighter than that (µs)
+    static const double cMinOutlierUs = 500.0;
+    // That many outliers in a row means clocks really diverged
+    static const int cMaxRejectedInRow = 250;
+    // Tick gap bigger than that means device restarted (~10 s at 250 Hz)
+    static const int64_t cMaxTickGap = 2500;
+
+    ClockEstimator::ClockEstimator()
+    : outliers(0), resyncs(0)
+    {
+        Reset();
+    }
+
+    void ClockEstimator::Reset()
+    {
+        started = false;
+        lastTicks = 0;
+        unwrapped = 0;
+        originHostUs = 0;
+        samples = 0;
+        rejectedInRow = 0;
+        meanX = meanY = covXX = covXY = 0.0;
+        absDev = sqDev = 0.0;
+    }
+
+    void ClockEstimator::Restart(uint64_t const& hostUs)
+    {
+        auto keepOutliers = outliers;
+        Reset();
+        outliers = keepOutliers;
+        started = true;
+        originHostUs = hostUs;
+        samples = 1;
+    }
+
+    double ClockEstimator::Predict(double const& x) const
+    {
+        return meanY + GetPeriodUs()*(x - meanX);
+    }
+
+    uint64_t ClockEstimator::Update(uint32_t const& ticks, uint64_t const& hostUs)
+    {
+        if(!started)
+        {
+            Restart(hostUs);
+            lastTicks = ticks;
+            return hostUs;
+        }
+
+        int64_t diff = (int32_t)(ticks - lastTicks);
+        if(diff <= 0 || diff > cMaxTickGap)
+        {
+            { KMICKI_LOGF(LogLevelDebug) << "ClockEstimator: Device clock jumped by " << diff << " ticks. Restarting fit."; }
+            ++resyncs;
+            Restart(hostUs);
+            lastTicks = ticks;
+            return hostUs;
+        }
+        lastTicks = ticks;
+        unwrapped += diff;
+
+        double x = (double)unwrapped;
+        double y = (double)(int64_t)(hostUs - originHostUs);
+
+        if(IsLocked())
+        {
+            double residual = y - Predict(x);
+            double threshold = std::max(cOutlierFactor*absDev,cMinOutlierUs);
+            if(std::abs(residual) > threshold)
+            {
+                ++outliers;
+                if(++rejectedInRow < cMaxRejectedInRow)
+                    return originHostUs + (uint64_t)std::llround(Predict(x));
+
+                Log("ClockEstimator: Lost track of device clock. Restarting fit.", LogLevelDebug);
+                ++resyncs;
+                Restart(hostUs);
+                return hostUs;
+            }
+            rejectedInRow = 0;
+
+            double wDev = 1.0/std::min((double)samples,cDevWindowSamples);
+            absDev += wDev*(std::abs(residual) - absDev);
+            sqDev += wDev*(residual*residual - sqDev);
+        }
+
+        // Origin sample (x = 0, y = 0) is already accounted for in the moments
+        ++samples;
+        double w = 1.0/std::min((double)samples,cWindowSamples);
+        double dx = x - meanX;
+        double dy = y - meanY;
+        meanX += w*dx;
+        meanY += w*dy;
+        covXX = (1.0-w)*(covXX + w*dx*dx);
+        covXY = (1.0-w)*(covXY + w*dx*dy);
+
+        if(!IsLocked())
+            return hostUs;
+
+        return originHostUs + (uint64_t)std::llround(Predict(x));
+    }
+
+    double ClockEstimator::GetPeriodUs() const
+    {
+        if(covXX <= 0.0)
+            return cNominalPeriodUs;
+        return covXY/covXX;
+    }
+
+    double ClockEstimator::GetDriftPpm() const
+    {
+        return (GetPeriodUs()/cNominalPeriodUs - 1.0)*1e6;
+    }
+
+    double ClockEstimator::GetJitterUs() const
+    {
+        return std::sqrt(sqDev);
+    }
+
+    uint64_t ClockEstimator::GetOutlierCount() const
+    {
+        return outliers;
+    }
+
+    uint64_t ClockEstimator::GetResyncCount() const
+    {
+        return resyncs;
+    }
+
+    bool ClockEstimator::IsLocked() const
+    {
+        return samples >= cLockSamples;
+    }
+}
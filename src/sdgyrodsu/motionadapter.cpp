@@ -2,226 +2,106 @@
 #include "motion/simplemotion.h"
 #include "sdgyrodsu/sdhidframe.h"
 #include "log/log.h"
-
-#include <iostream>
-#include <iomanip>
-#include <chrono>
+#include "trace/trace.h"
 
 using namespace kmicki::motion;
 using namespace kmicki::log;
 
-#define SD_SCANTIME_US 4000
-#define ACC_1G 0x4000
-#define GYRO_1DEGPERSEC 16
-#define GYRO_DEADZONE 8
-#define ACCEL_SMOOTH 0x1FF
-
 namespace kmicki::sdgyrodsu
 {
-    float SmoothAccel(float &last, int16_t curr)
+    MotionAdapter::MotionAdapter(hiddev::HidDevReader & _reader, uint32_t const& _deviceId)
+    : NoGyro(), reader(_reader), converter(_deviceId, NoGyro),
+      motion(), publishedState(), convertStats(),
+      convertSummary("convert", convertStats, metrics::DeviceLabels(_deviceId)),
+      overrunMetric("sdmotion_frames_overrun_total", "Frames lost because processing fell behind the frame ring", metrics::DeviceLabels(_deviceId)),
+      frameServe(nullptr)
     {
-        static const float acc1G = (float)ACC_1G;
-        if(abs(curr - last) < ACCEL_SMOOTH)
-        {
-            last = ((float)last*0.95+(float)curr*0.05);
-        }
-        else
-        {
-            last = (float)curr;
-        }
-        return last/acc1G;
+        SetConfig(pipeline::ThreadConfig::FromEnv("MOTION"));
+        Log("MotionAdapter: Initialized. Waiting for start of frame grab.", LogLevelDebug);
     }
 
-    uint64_t GetCurrentTimestamp()
+    MotionAdapter::~MotionAdapter()
     {
-        auto now = std::chrono::steady_clock::now();
-        auto duration = now.time_since_epoch();
-        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        StopFrameGrab();
     }
 
-    uint64_t ToTimestamp(uint32_t const& increment)
+    void MotionAdapter::StartFrameGrab()
     {
-        return (uint64_t)increment * SD_SCANTIME_US;
+        if(IsStarted())
+            return;
+        converter.Reset();
+        motion.Store(SimpleMotionData());
+        publishedState.Store(converter.GetState());
+        Log("MotionAdapter: Starting frame grab.", LogLevelDebug);
+        // Serve first, so that no frame is missed
+        frameServe = &reader.GetServe();
+        reader.Start();
+        Start();
     }
 
-    void MotionAdapter::ConvertMotionData(const SdHidFrame& frame, SimpleMotionData &data, 
-                                        float &lastAccelRtL, float &lastAccelFtB, float &lastAccelTtB,
-                                        uint32_t frameId)
+    bool MotionAdapter::GetMotionData(SimpleMotionData &motionData)
     {
-        static const float gyro1dps = (float)GYRO_1DEGPERSEC;
-
-        data.timestamp = GetCurrentTimestamp();
-        data.frame_id = frameId;
-        
-        // Convert accelerometer data (with smoothing)
-        data.accel_x = -SmoothAccel(lastAccelRtL, frame.AccelAxisRightToLeft);
-        data.accel_y = -SmoothAccel(lastAccelFtB, frame.AccelAxisFrontToBack);
-        data.accel_z = SmoothAccel(lastAccelTtB, frame.AccelAxisTopToBottom);
-        
-        // Convert gyroscope data
-        if(frame.Header & 0xFF == 0xDD)
-        {
-            // No gyro data available
-            data.gyro_pitch = 0.0f;
-            data.gyro_yaw = 0.0f;
-            data.gyro_roll = 0.0f;
-        }
-        else 
-        {
-            auto gyroRtL = frame.GyroAxisRightToLeft;
-            auto gyroFtB = frame.GyroAxisFrontToBack;
-            auto gyroTtB = frame.GyroAxisTopToBottom;
-
-            // Apply deadzone
-            if(gyroRtL < GYRO_DEADZONE && gyroRtL > -GYRO_DEADZONE)
-                gyroRtL = 0;
-            if(gyroFtB < GYRO_DEADZONE && gyroFtB > -GYRO_DEADZONE)
-                gyroFtB = 0;
-            if(gyroTtB < GYRO_DEADZONE && gyroTtB > -GYRO_DEADZONE)
-                gyroTtB = 0;
-
-            data.gyro_pitch = (float)gyroRtL / gyro1dps;
-            data.gyro_yaw = -(float)gyroFtB / gyro1dps;
-            data.gyro_roll = (float)gyroTtB / gyro1dps;
-        }
-        
-        // Calculate magnitudes
-        CalculateMagnitudes(data);
+        motionData = motion.Load();
+        return motionData.frame_id != 0;
     }
 
-    MotionAdapter::MotionAdapter(hiddev::HidDevReader & _reader, bool persistent)
-    : reader(_reader),
-      lastInc(0), frameCounter(0),
-      lastAccelRtL(0.0), lastAccelFtB(0.0), lastAccelTtB(0.0),
-      isPersistent(persistent), toReplicate(0), noGyroCooldown(0),
-      frameServe(nullptr)
+    MotionState MotionAdapter::GetState()
     {
-        Log("MotionAdapter: Initialized. Waiting for start of frame grab.", LogLevelDebug);
+        return publishedState.Load();
     }
 
-    void MotionAdapter::StartFrameGrab()
+    pipeline::StageStats const& MotionAdapter::GetConvertStats()
     {
-        lastInc = 0;
-        frameCounter = 0;
-        ignoreFirst = true;
-        Log("MotionAdapter: Starting frame grab.", LogLevelDebug);
-        reader.Start();
-        frameServe = &reader.GetServe();
+        return convertStats;
     }
 
-    bool MotionAdapter::GetMotionData(SimpleMotionData &motionData)
+    void MotionAdapter::Execute()
     {
-        static const int64_t cMaxDiffReplicate = 100;
-        static const int cNoGyroCooldownFrames = 1000;
-        static const int cMaxRepeatedLoop = 1000;
-
-        if(frameServe == nullptr)
-            return false;
-
-        if(noGyroCooldown > 0) --noGyroCooldown;
+        Log("MotionAdapter: Started.", LogLevelDebug);
 
         auto const& dataFrame = frameServe->GetPointer();
+        auto & state = converter.GetState();
+        SimpleMotionData motionData;
 
-        if(ignoreFirst)
+        while(ShouldContinue())
         {
-            auto lock = frameServe->GetConsumeLock();
-            ignoreFirst = false;
-        }
+            if(!frameServe->WaitForNext())
+                continue;
 
-        int repeatedLoop = cMaxRepeatedLoop;
-
-        while(true)
-        {
-            if(toReplicate == 0)
+            trace::Scope scope("MotionAdapter::Convert",dataFrame->Timestamp);
+            if(converter.Convert(*dataFrame, motionData))
             {
-                auto lock = frameServe->GetConsumeLock();
-                auto const& frame = GetSdFrame(*dataFrame);
-
-                // Check for gyro malfunction (all zeros)
-                if( noGyroCooldown <= 0
-                    &&  frame.AccelAxisFrontToBack == 0 && frame.AccelAxisRightToLeft == 0 
-                    &&  frame.AccelAxisTopToBottom == 0 && frame.GyroAxisFrontToBack == 0 
-                    &&  frame.GyroAxisRightToLeft == 0 && frame.GyroAxisTopToBottom == 0)
-                {
-                    NoGyro.SendSignal();
-                    noGyroCooldown = cNoGyroCooldownFrames;
-                }
-
-                int64_t diff = (int64_t)frame.Increment - (int64_t)lastInc;
-
-                if(lastInc != 0 && diff < 1 && diff > -100)
-                {
-                    if(repeatedLoop == cMaxRepeatedLoop)
-                    {
-                        Log("MotionAdapter: Frame was repeated. Ignoring...", LogLevelDebug);
-                        { LogF(LogLevelTrace) << std::setw(8) << std::setfill('0') << std::setbase(16)
-                                        << "Current increment: 0x" << frame.Increment << ". Last: 0x" << lastInc << "."; }
-                    }
-                    if(repeatedLoop <= 0)
-                    {
-                        Log("MotionAdapter: Frame is repeated continuously...");
-                        return false;
-                    }
-                    --repeatedLoop;
-                }
-                else
-                {
-                    if(lastInc != 0 && diff > 1)
-                    {
-                        LogF logMsg((diff > 6)?LogLevelDefault:LogLevelDebug);
-                        logMsg << "MotionAdapter: Missed " << (diff-1) << " frames.";
-                        if(diff > 1000)
-                            { LogF(LogLevelTrace) << std::setw(8) << std::setfill('0') << std::setbase(16)
-                                     << "Current increment: 0x" << frame.Increment << ". Last: 0x" << lastInc << "."; }
-                        if(diff <= cMaxDiffReplicate)
-                        {
-                            logMsg << " Replicating...";
-                            toReplicate = diff-1;
-                        }
-                    }
-
-                    ProcessFrame(frame, motionData);
-                    
-                    if(toReplicate > 0)
-                    {
-                        lastTimestamp = ToTimestamp(lastInc+1);
-                        motionData.timestamp = lastTimestamp;
-                        if(!isPersistent)
-                            data = motionData;
-                    }
-                        
-                    lastInc = frame.Increment;
-                    return true;
-                }
+                motion.Store(motionData);
+                convertStats.Record(dataFrame->Timestamp);
             }
-            else
+
+            auto overruns = frameServe->GetOverrunCount();
+            if(overruns != state.framesOverrun)
             {
-                // Replicated frame
-                --toReplicate;
-                lastTimestamp += SD_SCANTIME_US;
-                if(!isPersistent)
-                {
-                    motionData = data;
-                    motionData.timestamp = lastTimestamp;
-                }
-                else
-                {
-                    motionData.timestamp = lastTimestamp;
-                }
-
-                return true;
+                { LogF() << "MotionAdapter: Fell behind the frame ring. Lost " << (overruns - state.framesOverrun) << " frames."; }
+                overrunMetric.Increment(overruns - state.framesOverrun);
+                state.framesOverrun = overruns;
             }
+
+            publishedState.Store(state);
         }
+
+        { KMICKI_LOGF(LogLevelDebug) << "MotionAdapter: Convert " << convertStats.Describe(); }
+        Log("MotionAdapter: Stopped.", LogLevelDebug);
     }
 
-    void MotionAdapter::ProcessFrame(const SdHidFrame& frame, SimpleMotionData &motionData)
+    void MotionAdapter::FlushPipes()
     {
-        ConvertMotionData(frame, motionData, lastAccelRtL, lastAccelFtB, lastAccelTtB, ++frameCounter);
+        if(frameServe != nullptr)
+            frameServe->Flush();
     }
 
     void MotionAdapter::StopFrameGrab()
     {
+        if(!IsStarted() && frameServe == nullptr)
+            return;
         Log("MotionAdapter: Stopping frame grab.", LogLevelDebug);
+        Stop();
         if(frameServe != nullptr)
         {
             reader.StopServe(*frameServe);
@@ -234,4 +114,4 @@ namespace kmicki::sdgyrodsu
     {
         return true;
     }
-}
\ No newline at end of file
+}
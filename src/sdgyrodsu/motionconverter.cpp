@@ -0,0 +1,194 @@
+#include "sdgyrodsu/motionconverter.h"
+#include "log/log.h"
+#include "trace/trace.h"
+
+#include <iomanip>
+
+using namespace kmicki::motion;
+using namespace kmicki::log;
+
+#define ACC_1G 0x4000
+#define GYRO_1DEGPERSEC 16
+#define GYRO_DEADZONE 8
+#define ACCEL_SMOOTH 0x1FF
+
+namespace kmicki::sdgyrodsu
+{
+    float SmoothAccel(float &last, int16_t curr)
+    {
+        static const float acc1G = (float)ACC_1G;
+        if(abs(curr - last) < ACCEL_SMOOTH)
+        {
+            last = ((float)last*0.95+(float)curr*0.05);
+        }
+        else
+        {
+            last = (float)curr;
+        }
+        return last/acc1G;
+    }
+
+    void MotionConverter::ConvertMotionData(const SdHidFrame& frame, SimpleMotionData &data, 
+                                        float &lastAccelRtL, float &lastAccelFtB, float &lastAccelTtB,
+                                        uint32_t frameId)
+    {
+        static const float gyro1dps = (float)GYRO_1DEGPERSEC;
+
+        data.timestamp = hiddev::GetMonotonicTimestamp();
+        data.frame_id = frameId;
+        
+        // Convert accelerometer data (with smoothing)
+        data.accel_x = -SmoothAccel(lastAccelRtL, frame.AccelAxisRightToLeft);
+        data.accel_y = -SmoothAccel(lastAccelFtB, frame.AccelAxisFrontToBack);
+        data.accel_z = SmoothAccel(lastAccelTtB, frame.AccelAxisTopToBottom);
+        
+        // Convert gyroscope data
+        if(frame.Header & 0xFF == 0xDD)
+        {
+            // No gyro data available
+            data.gyro_pitch = 0.0f;
+            data.gyro_yaw = 0.0f;
+            data.gyro_roll = 0.0f;
+        }
+        else 
+        {
+            auto gyroRtL = frame.GyroAxisRightToLeft;
+            auto gyroFtB = frame.GyroAxisFrontToBack;
+            auto gyroTtB = frame.GyroAxisTopToBottom;
+
+            // Apply deadzone
+            if(gyroRtL < GYRO_DEADZONE && gyroRtL > -GYRO_DEADZONE)
+                gyroRtL = 0;
+            if(gyroFtB < GYRO_DEADZONE && gyroFtB > -GYRO_DEADZONE)
+                gyroFtB = 0;
+            if(gyroTtB < GYRO_DEADZONE && gyroTtB > -GYRO_DEADZONE)
+                gyroTtB = 0;
+
+            data.gyro_pitch = (float)gyroRtL / gyro1dps;
+            data.gyro_yaw = -(float)gyroFtB / gyro1dps;
+            data.gyro_roll = (float)gyroTtB / gyro1dps;
+        }
+        
+        // Calculate magnitudes
+        CalculateMagnitudes(data);
+
+        data.buttons1 = frame.Buttons1;
+        data.buttons2 = frame.Buttons2;
+        data.left_stick_x = frame.LeftStickX;
+        data.left_stick_y = frame.LeftStickY;
+        data.right_stick_x = frame.RightStickX;
+        data.right_stick_y = frame.RightStickY;
+        data.left_trigger = frame.L2Analog;
+        data.right_trigger = frame.R2Analog;
+        data.left_pad_x = frame.LeftTrackpadX;
+        data.left_pad_y = frame.LeftTrackpadY;
+        data.right_pad_x = frame.RightTrackpadX;
+        data.right_pad_y = frame.RightTrackpadY;
+    }
+
+    MotionConverter::MotionConverter(uint32_t const& _deviceId, pipeline::SignalOut & _noGyro)
+    : deviceId(_deviceId), noGyro(_noGyro),
+      lastInc(0), frameCounter(0),
+      lastAccelRtL(0.0), lastAccelFtB(0.0), lastAccelTtB(0.0),
+      noGyroCooldown(0), repeatedInRow(0), state(), clock(),
+      processedMetric("sdmotion_frames_processed_total", "Frames converted to motion data", metrics::DeviceLabels(_deviceId)),
+      repeatedMetric("sdmotion_frames_repeated_total", "Frames ignored because device repeated them", metrics::DeviceLabels(_deviceId)),
+      missedMetric("sdmotion_frames_missed_total", "Frames not delivered by device", metrics::DeviceLabels(_deviceId)),
+      periodMetric("sdmotion_sample_period_seconds", "Real sample period estimated against host clock", metrics::DeviceLabels(_deviceId)),
+      jitterMetric("sdmotion_sample_jitter_seconds", "RMS deviation of frame read times from fitted device clock", metrics::DeviceLabels(_deviceId)),
+      driftMetric("sdmotion_clock_drift_ppm", "Drift of device clock against host clock", metrics::DeviceLabels(_deviceId))
+    { }
+
+    void MotionConverter::Reset()
+    {
+        lastInc = 0;
+        frameCounter = 0;
+        repeatedInRow = 0;
+        state = MotionState();
+        clock.Reset();
+    }
+
+    MotionState & MotionConverter::GetState()
+    {
+        return state;
+    }
+
+    bool MotionConverter::Convert(frame_t const& frame, SimpleMotionData &motionData)
+    {
+        static const int cMaxRepeatedInRow = 1000;
+
+        auto const& sdFrame = GetSdFrame(frame);
+        auto framesMissed = state.framesMissed;
+        if(!HandleFrame(sdFrame, motionData))
+        {
+            if(++repeatedInRow == cMaxRepeatedInRow)
+                Log("MotionConverter: Frame is repeated continuously...");
+            return false;
+        }
+        repeatedInRow = 0;
+        if(state.framesMissed != framesMissed)
+            trace::ReportMissedFrames(frame.Timestamp);
+
+        motionData.device_id = deviceId;
+        motionData.sensor_timestamp = frame.Timestamp;
+        motionData.sample_timestamp = clock.Update(sdFrame.Increment, frame.Timestamp);
+        state.samplePeriodUs = clock.GetPeriodUs();
+        state.sampleJitterUs = clock.GetJitterUs();
+        state.clockDriftPpm = clock.GetDriftPpm();
+        state.clockOutliers = clock.GetOutlierCount();
+        state.clockResyncs = clock.GetResyncCount();
+        periodMetric.Set(state.samplePeriodUs * 1e-6);
+        jitterMetric.Set(state.sampleJitterUs * 1e-6);
+        driftMetric.Set(state.clockDriftPpm);
+        return true;
+    }
+
+    bool MotionConverter::HandleFrame(const SdHidFrame& frame, SimpleMotionData &motionData)
+    {
+        static const int cNoGyroCooldownFrames = 1000;
+
+        if(noGyroCooldown > 0) --noGyroCooldown;
+
+        // Check for gyro malfunction (all zeros)
+        if( noGyroCooldown <= 0
+            &&  frame.AccelAxisFrontToBack == 0 && frame.AccelAxisRightToLeft == 0 
+            &&  frame.AccelAxisTopToBottom == 0 && frame.GyroAxisFrontToBack == 0 
+            &&  frame.GyroAxisRightToLeft == 0 && frame.GyroAxisTopToBottom == 0)
+        {
+            noGyro.SendSignal();
+            noGyroCooldown = cNoGyroCooldownFrames;
+        }
+
+        int64_t diff = (int64_t)frame.Increment - (int64_t)lastInc;
+
+        if(lastInc != 0 && diff < 1 && diff > -100)
+        {
+            if(repeatedInRow == 0)
+            {
+                Log("MotionConverter: Frame was repeated. Ignoring...", LogLevelDebug);
+                { KMICKI_LOGF(LogLevelTrace) << std::setw(8) << std::setfill('0') << std::setbase(16)
+                                << "Current increment: 0x" << frame.Increment << ". Last: 0x" << lastInc << "."; }
+            }
+            ++state.framesRepeated;
+            repeatedMetric.Increment();
+            return false;
+        }
+
+        if(lastInc != 0 && diff > 1)
+        {
+            { LogF((diff > 6)?LogLevelDefault:LogLevelDebug) << "MotionConverter: Missed " << (diff-1) << " frames."; }
+            if(diff > 1000)
+                { KMICKI_LOGF(LogLevelTrace) << std::setw(8) << std::setfill('0') << std::setbase(16)
+                            << "Current increment: 0x" << frame.Increment << ". Last: 0x" << lastInc << "."; }
+            state.framesMissed += diff-1;
+            missedMetric.Increment(diff-1);
+        }
+
+        ConvertMotionData(frame, motionData, lastAccelRtL, lastAccelFtB, lastAccelTtB, ++frameCounter);
+        lastInc = frame.Increment;
+        ++state.framesProcessed;
+        processedMetric.Increment();
+        state.lastIncrement = lastInc;
+        return true;
+    }
+}
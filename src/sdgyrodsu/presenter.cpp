@@ -1,5 +1,5 @@
 #include "sdgyrodsu/presenter.h"
-#include "sdgyrodsu/motionadapter.h"
+#include "sdgyrodsu/motionconverter.h"
 #include "motion/simplemotion.h"
 
 #include <ncurses.h>
@@ -31,7 +31,7 @@ namespace kmicki::sdgyrodsu
 
         lastInc = frame.Increment;
 
-        MotionAdapter::ConvertMotionData(frame, md, lastAccelRtL, lastAccelFtB, lastAccelTtB, frame.Increment);
+        MotionConverter::ConvertMotionData(frame, md, lastAccelRtL, lastAccelFtB, lastAccelTtB, frame.Increment);
 
         int k=0;
         move(++k,0); printw("INC  : %10d         ",frame.Increment);
@@ -0,0 +1,133 @@
+#include "trace/trace.h"
+#include "pipeline/threadrings.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace kmicki::trace
+{
+    std::atomic<bool> enabled(false);
+
+    // Keep rings of that many exited threads (e.g. previous send threads).
+    static const int cMaxOrphanedRings = 4;
+
+    // Events of a single thread.
+    // Written by the thread only. Read by Dump() concurrently: it copies events
+    // and then discards the ones that could have been overwritten during copying.
+    struct ThreadEvents : pipeline::ThreadRingBase
+    {
+        ThreadEvents() : head(0) { }
+
+        std::array<Event,cEventsPerThread> events;
+        std::atomic<uint64_t> head;     // Number of events recorded so far
+    };
+
+    static pipeline::ThreadRings<ThreadEvents> rings(cMaxOrphanedRings);
+
+    void SetEnabled(bool _enabled)
+    {
+        enabled = _enabled;
+    }
+
+    void Record(EventType type, char const* name, uint64_t frameId)
+    {
+        auto & ring = rings.Get();
+
+        auto head = ring.head.load(std::memory_order_relaxed);
+        auto & event = ring.events[head % cEventsPerThread];
+        event.timestamp = pipeline::GetRingTimestamp();
+        event.name = name;
+        event.frameId = frameId;
+        event.type = type;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    static void WriteString(std::ostream & out, char const* str)
+    {
+        out << '"';
+        for(; *str != 0; ++str)
+        {
+            if(*str == '"' || *str == '\\')
+                out << '\\';
+            if((unsigned char)*str >= 0x20)
+                out << *str;
+        }
+        out << '"';
+    }
+
+    // Chrome trace timestamps are in microseconds.
+    static void WriteTimestamp(std::ostream & out, uint64_t timestamp)
+    {
+        auto fraction = timestamp % 1000;
+        out << timestamp / 1000 << '.' << (char)('0' + fraction / 100) << (char)('0' + fraction / 10 % 10) << (char)('0' + fraction % 10);
+    }
+
+    size_t Dump(std::ostream & out, double seconds)
+    {
+        std::vector<std::shared_ptr<ThreadEvents>> current;
+        rings.GetAll(current);
+
+        auto const pid = getpid();
+        auto const from = pipeline::GetRingTimestamp() - (uint64_t)(seconds * 1e9);
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << pid << ",\"args\":{\"name\":\"sdmotion\"}}";
+
+        size_t written = 0;
+        std::vector<Event> events;
+        events.reserve(cEventsPerThread);
+        for(auto const& ring : current)
+        {
+            events.clear();
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t first = (head > cEventsPerThread) ? head - cEventsPerThread : 0;
+            for(auto i = first; i < head; ++i)
+                events.push_back(ring->events[i % cEventsPerThread]);
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // Events overwritten by the thread during copying are not valid
+            uint64_t newHead = ring->head.load(std::memory_order_relaxed);
+            uint64_t valid = (newHead >= cEventsPerThread) ? newHead - cEventsPerThread + 1 : 0;
+            size_t skip = (valid > first) ? std::min<uint64_t>(valid - first, events.size()) : 0;
+
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+            WriteString(out, ring->name);
+            out << "}}";
+
+            for(auto event = events.begin() + skip; event != events.end(); ++event)
+            {
+                if(event->timestamp < from)
+                    continue;
+                out << ",\n{\"name\":";
+                WriteString(out, event->name);
+                out << ",\"cat\":\"sdmotion\",\"ph\":";
+                switch(event->type)
+                {
+                    case EventType::Begin:
+                        out << "\"B\"";
+                        break;
+                    case EventType::End:
+                        out << "\"E\"";
+                        break;
+                    default:
+                        out << "\"i\",\"s\":\"t\"";
+                        break;
+                }
+                out << ",\"ts\":";
+                WriteTimestamp(out, event->timestamp);
+                out << ",\"pid\":" << pid << ",\"tid\":" << ring->tid;
+                if(event->frameId != 0)
+                    out << ",\"args\":{\"frame\":" << event->frameId << "}";
+                out << "}";
+                ++written;
+            }
+        }
+
+        out << "\n]}\n";
+        return written;
+    }
+}
@@ -0,0 +1,125 @@
+#include "trace/tracedumper.h"
+#include "trace/trace.h"
+#include "log/log.h"
+
+#include <poll.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+using namespace kmicki::log;
+
+namespace kmicki::trace
+{
+    static const char* cDefaultDirectory = "/tmp";
+    static const double cDefaultSeconds = 5.0;
+
+    const std::chrono::seconds TraceDumper::cMinMissDumpPeriod(10);
+    // Delay of dump on missed frames, so that the trace shows recovery as well.
+    const std::chrono::milliseconds TraceDumper::cMissDumpDelay(200);
+
+    static std::atomic<TraceDumper*> activeDumper(nullptr);
+
+    void RequestDump()
+    {
+        if(auto dumper = activeDumper.load())
+            dumper->Request(false);
+    }
+
+    void ReportMissedFrames(uint64_t frameId)
+    {
+        if(!IsEnabled())
+            return;
+        Record(EventType::Instant, "Missed frames", frameId);
+        if(auto dumper = activeDumper.load())
+            dumper->Request(true);
+    }
+
+    TraceDumper::TraceDumper(std::string const& _directory, double _seconds, bool _onMiss)
+    : directory(_directory), seconds(_seconds), onMiss(_onMiss), dumpCount(0),
+      requestEvent(), requested(false), missRequested(false), lastMissDump()
+    {
+        SetConfig(pipeline::ThreadConfig::FromEnv("TRACE"));
+        activeDumper = this;
+        { LogF() << "TraceDumper: Dumping last " << seconds << " s of trace to " << directory 
+                 << (onMiss ? " on request and on missed frames." : " on request."); }
+        Start();
+    }
+
+    TraceDumper::~TraceDumper()
+    {
+        TraceDumper* self = this;
+        activeDumper.compare_exchange_strong(self, nullptr);
+        Stop();
+    }
+
+    TraceDumper * TraceDumper::FromEnv()
+    {
+        const char* trace = std::getenv("SDMOTION_TRACE");
+        if(trace == nullptr)
+            return nullptr;
+
+        std::string directory = cDefaultDirectory;
+        if(const char* dir = std::getenv("SDMOTION_TRACE_DIR"))
+            directory = dir;
+        double seconds = cDefaultSeconds;
+        if(const char* secs = std::getenv("SDMOTION_TRACE_SECONDS"))
+            seconds = std::max(std::atof(secs), 0.1);
+        const char* onMiss = std::getenv("SDMOTION_TRACE_ON_MISS");
+
+        SetEnabled(std::strcmp(trace, "1") == 0);
+        return new TraceDumper(directory, seconds, onMiss != nullptr && std::strcmp(onMiss, "1") == 0);
+    }
+
+    void TraceDumper::Request(bool missed)
+    {
+        if(missed)
+        {
+            if(!onMiss)
+                return;
+            missRequested = true;
+        }
+        else
+            requested = true;
+        requestEvent.Signal();
+    }
+
+    void TraceDumper::FlushPipes()
+    { }
+
+    void TraceDumper::Execute()
+    {
+        while(ShouldContinue())
+        {
+            pollfd fds[2] = { { requestEvent.GetFd(), POLLIN, 0 }, { GetStopFd(), POLLIN, 0 } };
+            if(poll(fds, 2, -1) <= 0 || !(fds[0].revents & POLLIN))
+                continue;
+            requestEvent.Clear();
+
+            if(requested.exchange(false))
+                Write("request");
+
+            if(missRequested.exchange(false) && std::chrono::steady_clock::now() - lastMissDump >= cMinMissDumpPeriod)
+            {
+                if(!SleepFor(cMissDumpDelay))
+                    break;
+                lastMissDump = std::chrono::steady_clock::now();
+                Write("missed frames");
+            }
+        }
+    }
+
+    void TraceDumper::Write(char const* reason)
+    {
+        auto path = directory + "/sdmotion-" + std::to_string(getpid()) + "-" + std::to_string(++dumpCount) + ".json";
+        std::ofstream file(path);
+        if(!file)
+        {
+            { LogF() << "TraceDumper: Could not write " << path << "."; }
+            return;
+        }
+        auto events = Dump(file, seconds);
+        { LogF() << "TraceDumper: Dumped " << events << " events (" << reason << ") to " << path << "."; }
+    }
+}